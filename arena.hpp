@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for scratch memory of a single task (e.g., rendering a
+// frame). Deallocation is a no-op; reset() releases everything at once,
+// keeping the blocks, so that a task repeated after reset() allocates
+// from the same blocks without touching the heap.
+class MonotonicArena final
+{
+public:
+    MonotonicArena() = default;
+
+    explicit MonotonicArena(size_t blockSize) :
+        blockSize_{ blockSize }
+    {}
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    auto operator=(const MonotonicArena&) -> MonotonicArena& = delete;
+
+    auto allocate(size_t bytes, size_t alignment)
+        -> void*
+    {
+        while (iblock_ < blocks_.size())
+        {
+            auto& block = blocks_[iblock_];
+            auto offset = (offset_ + alignment - 1) & ~(alignment - 1);
+            if (offset + bytes <= block.size)
+            {
+                offset_ = offset + bytes;
+                used_ += bytes;
+                return block.data.get() + offset;
+            }
+            ++iblock_;
+            offset_ = 0;
+        }
+
+        // Blocks are aligned for any fundamental type
+        assert(alignment <= alignof(std::max_align_t));
+        auto size = std::max(blockSize_, bytes);
+        blocks_.push_back({ std::make_unique<std::byte[]>(size), size });
+        iblock_ = blocks_.size() - 1;
+        offset_ = bytes;
+        used_ += bytes;
+        return blocks_.back().data.get();
+    }
+
+    auto reset() noexcept
+        -> void
+    {
+        iblock_ = 0;
+        offset_ = 0;
+        used_ = 0;
+    }
+
+    // Bytes allocated since the last reset
+    auto used() const noexcept
+        -> size_t
+    { return used_; }
+
+    // Bytes held in blocks
+    auto capacity() const noexcept
+        -> size_t
+    {
+        size_t result = 0;
+        for (const auto& block: blocks_)
+            result += block.size;
+        return result;
+    }
+
+private:
+    struct Block
+    {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    size_t blockSize_{ 64*1024 };
+    std::vector<Block> blocks_;
+    size_t iblock_{};
+    size_t offset_{};
+    size_t used_{};
+};
+
+
+// Allocates from a MonotonicArena, or from the heap if there is no arena.
+// Containers copied from a container using the arena use it too.
+template <typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ArenaAllocator(MonotonicArena* arena = nullptr) noexcept :
+        arena_{ arena }
+    {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& that) noexcept :
+        arena_{ that.arena() }
+    {}
+
+    auto allocate(size_t n)
+        -> T*
+    {
+        if (!arena_)
+            return std::allocator<T>{}.allocate(n);
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    auto deallocate(T* p, size_t n) noexcept
+        -> void
+    {
+        if (!arena_)
+            std::allocator<T>{}.deallocate(p, n);
+    }
+
+    auto arena() const noexcept
+        -> MonotonicArena*
+    { return arena_; }
+
+    template <typename U>
+    friend auto operator==(const ArenaAllocator& a, const ArenaAllocator<U>& b)
+        noexcept -> bool
+    { return a.arena() == b.arena(); }
+
+private:
+    MonotonicArena* arena_;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -1,248 +1,430 @@
 #include "batch.hpp"
 
 #include "anim_param.hpp"
-#include "interp_curves.hpp"
+#include "batch_csv.hpp"
+#include "batch_frames.hpp"
+#include "batch_output.hpp"
+#include "bounded_queue.hpp"
+#include "fractal_iter.hpp"
+#include "frame_hash.hpp"
+#include "geometry_cache.hpp"
+#include "parallel_frames.hpp"
+#include "parse_option.hpp"
+#include "render_context.hpp"
+#include "render_cost.hpp"
 #include "render_fractal.hpp"
 #include "throw.hpp"
+#include "trace.hpp"
+#include "vertex_file.hpp"
+#include "vertex_pack.hpp"
 
 #include <QImage>
 #include <QPainter>
 
+#include <atomic>
 #include <cmath>
+#include <condition_variable>
+#include <csignal>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <optional>
 #include <sstream>
+#include <unordered_map>
+#include <thread>
 
 
-using namespace std::string_view_literals;
+using namespace std::string_literals;
 
 namespace {
 
-auto renderFractalImage(std::span<const Vec2d> base,
-                        std::span<const Vec2d> gen,
-                        const FractalViewParam& param,
-                        const QSize& size)
-    -> QImage
-{
-    auto img = QImage{ size, QImage::Format_ARGB32 };
-    auto p = QPainter{ &img };
-    renderFractal(p, {QPoint{}, size}, base, gen, param);
-    return img;
-}
+auto hardwareThreads()
+    -> size_t
+{ return std::max(std::thread::hardware_concurrency(), 1u); }
 
-struct BatchLine
+struct BatchOptions
 {
-    std::vector<Vec2d> base;
-    std::vector<Vec2d> gen;
-    FractalViewParam viewParam;
-    QSize size;
-    AnimParam animParam;
-};
+    std::string traceFileName;
 
-inline auto field_names_of(TypeTag<QSize>)
-    -> std::array<std::string_view, 2>
-{ return { "width", "height" }; }
+    // Render statistics file; defaults to render_stats.csv in the output
+    // directory for PNG output, and to none for streamed output
+    std::string statsFileName;
 
-inline auto fields_of(QSize& p)
-    -> std::tuple<int&, int&>
-{ return std::tie(p.rwidth(), p.rheight()); }
+    FrameFormat format{ FrameFormat::Png };
 
-inline auto fields_of(const QSize& p)
-    -> std::tuple<int, int>
-{ return {p.width(), p.height()}; }
+    // Stream path for y4m and rgb formats; "-" is stdout
+    std::string streamPath{ "-" };
+    std::string frameRate{ "25" };
 
-auto lerp(double x0, double x1, double p)
-    -> double
-{ return x0*(1-p) + x1*p; }
+    // Content-addressed frame cache directory; empty disables caching
+    std::string cacheDir;
 
-auto lerp(size_t x0, size_t x1, double p)
-    -> size_t
-{ return std::lround(x0*(1-p) + x1*p); }
+    // Memory limit of the vertex cache shared by render workers, which
+    // lets frames differing in size or drawing style only reuse vertices;
+    // 0 disables it
+    size_t geometryCacheMiB{ GeometryCache::defaultMaxBytes >> 20 };
 
-auto lerp(int x0, int x1, double p)
-    -> int
-{ return std::lround(x0*(1-p) + x1*p); }
-
-auto lerp(bool x0, bool x1, double p)
-    -> bool
-{ return lerp(x0? 1.: 0., x1? 1.:0, p) >= 0.5; }
-
-auto lerp(const Vec2d& x0, const Vec2d& x1, double p)
-    -> Vec2d
-{ return { lerp(x0[0], x1[0], p), lerp(x0[1], x1[1], p) }; }
-
-auto lerp2dLine(const std::vector<Vec2d>& l0,
-                const std::vector<Vec2d>& l1,
-                const AnimParam& a0,
-                const AnimParam& a1,
-                double p)
-    -> std::vector<Vec2d>
+    // If set, the polyline of each frame is also exported to
+    // a vertex file in the output directory
+    std::optional<VertexFormat> vertexFormat;
+
+    // Frame numbers (as in output file names) to render, inclusive
+    size_t firstFrame{ 1 };
+    size_t lastFrame{ std::numeric_limits<size_t>::max() };
+
+    // Renders the shardIndex-th of shardCount contiguous parts
+    // of the selected frames (1-based)
+    size_t shardIndex{ 1 };
+    size_t shardCount{ 1 };
+
+    auto selectsAllFrames() const noexcept
+        -> bool
+    {
+        return firstFrame == 1 &&
+               lastFrame == std::numeric_limits<size_t>::max() &&
+               shardCount == 1;
+    }
+
+    // Worker counts of the render, encode and write pipeline stages
+    size_t renderJobs{ hardwareThreads() };
+    size_t encodeJobs{ hardwareThreads() };
+    size_t writeJobs{ 1 };
+
+    // Capacity of each queue between pipeline stages
+    size_t queueSize{ 4 };
+
+    // Maximum number of frames between render start and write completion;
+    // zero means limited by stage and queue sizes only
+    size_t maxInFlight{};
+};
+
+// Parses FIRST:LAST, where either number may be omitted
+auto parseFrameRange(const std::string& option,
+                     const std::string& text,
+                     BatchOptions& opts)
+    -> void
+{
+    auto colon = text.find(':');
+    if (colon == std::string::npos)
+        throw_("Invalid value '", text, "' for option ", option,
+               ", expected FIRST:LAST");
+    auto first = text.substr(0, colon);
+    auto last = text.substr(colon + 1);
+    if (!first.empty())
+        opts.firstFrame = parseOptionValue<size_t>(option, first);
+    if (!last.empty())
+        opts.lastFrame = parseOptionValue<size_t>(option, last);
+    if (opts.firstFrame == 0 || opts.lastFrame < opts.firstFrame)
+        throw_("Invalid frame range '", text, "'");
+}
+
+// Parses K/N
+auto parseShard(const std::string& option,
+                const std::string& text,
+                BatchOptions& opts)
+    -> void
+{
+    auto slash = text.find('/');
+    if (slash == std::string::npos)
+        throw_("Invalid value '", text, "' for option ", option,
+               ", expected K/N");
+    opts.shardIndex = parseOptionValue<size_t>(option, text.substr(0, slash));
+    opts.shardCount = parseOptionValue<size_t>(option, text.substr(slash + 1));
+    if (opts.shardIndex == 0 || opts.shardIndex > opts.shardCount)
+        throw_("Invalid shard '", text, "', expected 1 <= K <= N");
+}
+
+auto parseBatchOptions(const QStringList& args)
+    -> BatchOptions
 {
-    size_t n0 = l0.size();
-    size_t n1 = l1.size();
-    auto n = std::max(n0, n1);
-    auto result = std::vector<Vec2d>{};
-    result.reserve(n);
-    constexpr auto prep = +[](const Vec2d& v, const AnimParam& a)
-        -> Vec2d
+    auto result = BatchOptions{};
+    for (auto it=args.begin(), end=args.end(); it!=end; ++it)
     {
-        auto result = v;
-        if (a.reflectX)
-            result[0] = -result[0];
-        if (a.reflectY)
-            result[1] = -result[1];
-        return result;
-    };
-    for (size_t i=0; i<n; ++i)
+        auto option = it->toStdString();
+        auto value = [&]() -> std::string
+        {
+            if (std::next(it) == end)
+                throw_("Missing value for option ", option);
+            return (++it)->toStdString();
+        };
+
+        if (option == "--trace")
+            result.traceFileName = value();
+        else if (option == "--stats")
+            result.statsFileName = value();
+        else if (option == "--format")
+            result.format = parseFrameFormat(value());
+        else if (option == "--stream")
+            result.streamPath = value();
+        else if (option == "--fps")
+            result.frameRate = value();
+        else if (option == "--cache")
+            result.cacheDir = value();
+        else if (option == "--geometry-cache")
+            result.geometryCacheMiB = parseOptionValue<size_t>(option, value());
+        else if (option == "--vertices")
+            result.vertexFormat = parseVertexFormat(value());
+        else if (option == "--frames")
+            parseFrameRange(option, value(), result);
+        else if (option == "--shard")
+            parseShard(option, value(), result);
+        else if (option == "--jobs" || option == "--render-jobs")
+            result.renderJobs = parseOptionValue<size_t>(option, value());
+        else if (option == "--encode-jobs")
+            result.encodeJobs = parseOptionValue<size_t>(option, value());
+        else if (option == "--write-jobs")
+            result.writeJobs = parseOptionValue<size_t>(option, value());
+        else if (option == "--queue-size")
+            result.queueSize = parseOptionValue<size_t>(option, value());
+        else if (option == "--max-in-flight")
+            result.maxInFlight = parseOptionValue<size_t>(option, value());
+        else
+            throw_("Unknown batch option '", option, "'");
+    }
+
+    if (result.renderJobs == 0 ||
+        result.encodeJobs == 0 ||
+        result.writeJobs == 0 ||
+        result.queueSize == 0)
+        throw_("Worker counts and queue size must be positive");
+    if (result.format != FrameFormat::Png)
     {
-        auto i0 = localIndex(i, n, n0);
-        auto i1 = localIndex(i, n, n1);
-        auto v0 = prep(l0[i0], a0);
-        auto v1 = prep(l1[i1], a1);
-        result.push_back(lerp(v0, v1, p));
+        if (!result.cacheDir.empty())
+            throw_("Option --cache requires PNG output");
+        result.writeJobs = 1;   // Stream frames are written in order
     }
+    if (result.vertexFormat && !result.cacheDir.empty())
+        throw_("Option --vertices cannot be combined with --cache, "
+               "because cached frames are not rendered");
+    if (result.maxInFlight == 0)
+        result.maxInFlight =
+            result.renderJobs + result.encodeJobs + result.writeJobs +
+            2*result.queueSize;
     return result;
 }
 
-template <typename T>
-auto lerpStruct(const T& x0, const T& x1, double p)
-    -> T
+struct RenderedFrame
 {
-    auto result = T{};
-    auto f0 = fields_of(x0);
-    auto f1 = fields_of(x1);
-    auto f = fields_of(result);
-    constexpr auto fieldCount = std::tuple_size_v<decltype(f)>;
-    [&]<size_t... I>(std::index_sequence<I...>)
+    QImage image;
+    RenderFractlalResult renderResult;
+};
+
+struct EncodedFrame
+{
+    QSize size;
+    QByteArray data;
+    RenderFractlalResult renderResult;
+};
+
+auto renderFractalImage(const BatchLine& frame,
+                        const QSize& size,
+                        RenderScratch& scratch,
+                        ImagePool& imagePool,
+                        const RenderControl& control)
+    -> RenderedFrame
+{
+    auto span = TraceSpan{ "render" };
+    auto img = imagePool.acquire(size);
+    auto renderResult = RenderFractlalResult{};
     {
-        ((std::get<I>(f) = lerp(std::get<I>(f0), std::get<I>(f1), p)), ...);
-    }(std::make_index_sequence<fieldCount>());
-    return result;
+        auto p = QPainter{ &img };
+        renderResult = renderFractal(
+            p, {QPoint{}, size}, frame.base, frame.gen, frame.viewParam,
+            &scratch, &control);
+    }
+    return { std::move(img), std::move(renderResult) };
 }
 
+// Makes `to` refer to the contents of `from`, preferably via a hard link
+auto linkOrCopyFile(const std::filesystem::path& from,
+                    const std::filesystem::path& to)
+    -> void
+{
+    namespace fs = std::filesystem;
+
+    auto ec = std::error_code{};
+    if (fs::exists(to) && fs::equivalent(from, to))
+        return;
+    fs::remove(to);
+    fs::create_hard_link(from, to, ec);
+    if (ec)
+        fs::copy_file(from, to, fs::copy_options::overwrite_existing);
+}
 
-auto lerpBatchLine(const BatchLine& bl0,
-                          const BatchLine& bl1,
-                          double param)
-    -> BatchLine
+auto nameWorkerThread(const char* stage, size_t workerIndex)
+    -> void
 {
-    auto p = param*param*(3 - 2*param);
-
-    return {
-        .base = lerp2dLine(
-            bl0.base, bl1.base,
-            {}, {},
-            p),
-        .gen = lerp2dLine(
-            bl0.gen, bl1.gen,
-            bl0.animParam, bl1.animParam,
-            p),
-        .viewParam = lerpStruct(bl0.viewParam, bl1.viewParam, p),
-        .size = lerpStruct(bl0.size, bl1.size, p),
-        .animParam = {}
-    };
+    if (traceEnabled())
+        setTraceThreadName(stage + (" " + std::to_string(workerIndex)));
 }
 
-auto interpolateBatchLines(std::span<const BatchLine> batchLines)
-    -> std::vector<BatchLine>
+// Set on SIGINT; polled by InterruptWatcher
+std::atomic<bool> interrupted{ false };
+static_assert(std::atomic<bool>::is_always_lock_free);
+
+auto handleInterrupt(int)
+    -> void
 {
-    auto getBase = []( const BatchLine& batchLine )
-        -> const std::vector< Vec2d >&
-    { return batchLine.base; };
+    interrupted = true;
 
-    auto getGen = []( const BatchLine& batchLine )
-        -> const std::vector< Vec2d >
+    // A second interrupt terminates the process
+    std::signal(SIGINT, SIG_DFL);
+}
+
+// Handles SIGINT while alive, calling onInterrupt on a watcher thread.
+// Stop requests are made there, as they are not async-signal-safe.
+class InterruptWatcher final
+{
+public:
+    explicit InterruptWatcher(std::function<void()> onInterrupt)
     {
-        auto result = std::vector< Vec2d >( batchLine.gen );
-        for(auto& v: result)
-        {
-            if (batchLine.animParam.reflectX)
-                v[0] = -v[0];
-            if (batchLine.animParam.reflectY)
-                v[1] = -v[1];
-        }
-        return result;
-    };
+        interrupted = false;
+        previous_ = std::signal(SIGINT, handleInterrupt);
+        thread_ = std::jthread{
+            [this, onInterrupt=std::move(onInterrupt)](std::stop_token stop)
+            {
+                auto lock = std::unique_lock{ mutex_ };
+                while (!stop.stop_requested())
+                {
+                    if (interrupted)
+                        return onInterrupt();
+                    wakeUp_.wait_for(lock, stop, std::chrono::milliseconds{ 50 },
+                                     []{ return false; });
+                }
+            } };
+    }
 
-    auto getSubdiv = []( const BatchLine& batchLine )
-        -> size_t
-    { return batchLine.animParam.frameCountAfter; };
+    ~InterruptWatcher()
+    {
+        thread_.request_stop();
+        thread_.join();
+        std::signal(SIGINT, previous_);
+    }
 
-    auto getSlopeF = []( const BatchLine& batchLine )
-        -> double
-    { return batchLine.animParam.slopeFactor; };
+    InterruptWatcher(const InterruptWatcher&) = delete;
+    InterruptWatcher& operator=(const InterruptWatcher&) = delete;
 
-    auto baseCurves =
-        interpCurves(batchLines, getBase, getSubdiv, getSlopeF);
+private:
+    void (*previous_)(int){};
+    std::mutex mutex_;
+    std::condition_variable_any wakeUp_;
+    std::jthread thread_;
+};
 
-    auto genCurves =
-        interpCurves(batchLines, getGen, getSubdiv, getSlopeF);
+auto hex(uint64_t value)
+    -> std::string
+{
+    auto s = std::ostringstream{};
+    s << std::hex << std::setw(16) << std::setfill('0') << value;
+    return s.str();
+}
 
-    auto result = std::vector<BatchLine>{};
+auto writeRenderStatsHeader(std::ostream& s)
+    -> void
+{
+    s << "frame,bbox_s,render_s,path_s,stroke_s,vertices,vertices_per_s,"
+         "max_gen,scale,push,pop,peak_bytes,truncated,"
+         "vertex_budget,budget_limited,lod_tolerance,"
+         "predicted_exact_vertices,predicted_approx_vertices,approx_engine,"
+         "coverage_skips,coverage_saved_vertices,mirrored,geometry_cache_hits,"
+         "gen_vertices"
+      << std::endl;
+}
 
-    auto curvesAtFrame =
-        [](const std::vector<std::vector<Vec2d>>& curves, size_t iframe)
-            -> std::vector<Vec2d>
-    {
-        auto ncurves = curves.size();
-        auto result = std::vector<Vec2d>(ncurves);
-        for (auto icurve=0; icurve<ncurves; ++icurve)
-            result[icurve] = curves[icurve][iframe];
-        return result;
-    };
-
-    result.push_back(batchLines.front());
-    size_t iframe = 1;
-    auto nframes = baseCurves.front().size();
-    for (size_t iline=0, nlines=batchLines.size(); iline+1<nlines; ++iline)
-    {
-        const auto& bl0 = batchLines[iline];
-        const auto& bl1 = batchLines[iline+1];
-        auto subdiv = getSubdiv(bl0);
-        auto h = 1. / subdiv;
-        for (size_t isub=0; isub<subdiv; ++isub, ++iframe)
-        {
-            auto p = (isub+1) * h;
-            result.push_back(
-                {
-                    .base = curvesAtFrame(baseCurves, iframe),
-                    .gen = curvesAtFrame(genCurves, iframe),
-                    .viewParam = lerpStruct(bl0.viewParam, bl1.viewParam, p),
-                    .size = lerpStruct(bl0.size, bl1.size, p),
-                    .animParam = {}
-                });
-        }
-    }
-    assert(iframe == nframes);
-
-    // deBUG: Print interpolated generator curves
-    // auto ncurves = result[0].gen.size();
-    // for (iframe=0; iframe<nframes; ++iframe)
-    // {
-    //     std::cout << iframe;
-    //     for (size_t icurve=0; icurve<ncurves; ++icurve)
-    //     {
-    //         const auto& v = result[iframe].gen[icurve];
-    //         std::cout << '\t' << v[0] << '\t' << v[1];
-    //     }
-    //     std::cout << std::endl;
-    // }
+auto writeRenderStats(std::ostream& s,
+                      size_t frame,
+                      const RenderFractlalResult& r)
+    -> void
+{
+    auto sec = [](std::chrono::nanoseconds dt)
+    { return std::chrono::duration<double>(dt).count(); };
+
+    s << frame << ','
+      << sec(r.computeBbTime) << ','
+      << sec(r.renderTime) << ','
+      << sec(r.pathTime) << ','
+      << sec(r.strokeTime) << ','
+      << totalVertexCount(r) << ','
+      << vertexRate(r) << ','
+      << r.maxGen << ','
+      << r.scale << ','
+      << r.pushCount << ','
+      << r.popCount << ','
+      << r.peakAllocatedBytes << ','
+      << r.truncated << ','
+      << r.vertexBudget << ','
+      << r.budgetLimited << ','
+      << r.lodTolerance << ','
+      << r.cost.exact.vertexCount << ','
+      << r.cost.approx.vertexCount << ','
+      << r.approxEngine << ','
+      << r.coverageSkipCount << ','
+      << r.coverageSavedVertices << ','
+      << r.mirrored << ','
+      << r.geometryCacheHits << ',';
+    // Space-separated, so that the histogram occupies a single column
+    for (size_t gen=0, n=r.genVertexCount.size(); gen<n; ++gen)
+        s << (gen? " ": "") << r.genVertexCount[gen];
+    s << '\n';
+}
 
-    return result;
+auto frameSize(const BatchLine& batchLine)
+    -> QSize
+{
+    auto size = batchLine.size;
+
+    // Make image width and height even, because ffmpeg may want it
+    size.rwidth() &= ~1;
+    size.rheight() &= ~1;
+
+    return size;
 }
 
+// Identifies the image of a frame: everything rendering depends on
+auto frameHash(const BatchLine& frame)
+    -> uint64_t
+{
+    auto h = FrameHash{};
+    h << rendererVersion << frame.base << frame.gen;
+    std::apply([&](const auto&... field) { ((h << field), ...); },
+               fields_of(frame.viewParam));
+    auto size = frameSize(frame);
+    h << size.width() << size.height();
+    return h.value();
+}
+
+// A unique frame image to render, and the frames that show it
+struct FrameJob
+{
+    uint64_t hash{};
+    std::vector<size_t> frames;
+};
+
 } // anonymous namespace
 
-auto batch(const QString& batchFileName)
+auto batch(const QString& batchFileName, const QStringList& options)
     -> int
 {
     namespace fs = std::filesystem;
 
     try
     {
+        auto opts = parseBatchOptions(options);
+        auto traceSession = TraceSession{ opts.traceFileName };
+        if (traceEnabled())
+            setTraceThreadName("main");
+
+        auto streaming = opts.format != FrameFormat::Png;
+
+        // Keep stdout clean when frames are streamed there
+        auto& log =
+            streaming && opts.streamPath == "-"? std::cerr: std::cout;
+
         const auto outputDirName = "gen_fractal.out";
 
         auto outputFileName = [&](size_t number)
@@ -255,129 +437,347 @@ auto batch(const QString& batchFileName)
             return QString::fromStdString(fs::path(outputDirName) / s.str());
         };
 
-        auto in = std::ifstream(batchFileName.toStdString());
-        if (!in.is_open())
-            throw_("Failed to open input file '",
-                   batchFileName.toStdString(), "'");
+        auto vertexFileName = [&](size_t number)
+            -> fs::path
+        {
+            auto s = std::ostringstream{};
+            s << "vert_"
+              << std::setw(6) << std::setfill('0') << number
+              << (opts.vertexFormat->quantizationBits? ".gfvp": ".bin");
+            return fs::path(outputDirName) / s.str();
+        };
+
+        auto batchLines = readBatchFile(batchFileName, log);
+
+        auto frameSource = BatchFrameSource{ std::move(batchLines) };
+
+        // Selected frame indices [beginFrame, endFrame); frame number
+        // (as in file names) is index + 1
+        auto frameCount = frameSource.frameCount();
+        auto beginFrame = std::min(opts.firstFrame - 1, frameCount);
+        auto endFrame = std::min(opts.lastFrame, frameCount);
+        {
+            auto n = endFrame - beginFrame;
+            auto shardOffset = [&](size_t k)
+            { return beginFrame + n * k / opts.shardCount; };
+            endFrame = shardOffset(opts.shardIndex);
+            beginFrame = shardOffset(opts.shardIndex - 1);
+        }
+        if (!opts.selectsAllFrames())
+            log << "Selected frames " << beginFrame+1 << " to " << endFrame
+                << " of " << frameCount << std::endl;
 
-        size_t lineNumber = 0;
-        auto batchLines = std::vector<BatchLine>{};
-        while (true)
+        auto stream = std::unique_ptr<FrameStream>{};
+        if (streaming)
         {
-            ++lineNumber;
+            stream = std::make_unique<FrameStream>(
+                opts.streamPath, opts.format, opts.frameRate);
+            log << "Streaming frames to '" << opts.streamPath << "'"
+                << std::endl;
+            if (opts.vertexFormat)
+                fs::create_directories(outputDirName);
+        }
+        else
+        {
+            // With a frame cache, an existing output directory
+            // is updated, which resumes an interrupted run.
+            // Frame ranges and shards may share the directory.
+            if (fs::exists(outputDirName) &&
+                opts.cacheDir.empty() &&
+                opts.selectsAllFrames())
+                throw_("Output directory '", outputDirName,
+                       "' already exists");
+
+            fs::create_directories(outputDirName);
+            if (!opts.cacheDir.empty())
+                fs::create_directories(opts.cacheDir);
+
+            log << "Generating images in directory '" << outputDirName << "'"
+                << std::endl;
+
+            if (opts.statsFileName.empty())
+                opts.statsFileName =
+                    fs::path(outputDirName) / (
+                        opts.selectsAllFrames()
+                            ? "render_stats.csv"s
+                            : "render_stats_" + std::to_string(beginFrame+1) +
+                              "-" + std::to_string(endFrame) + ".csv");
+        }
 
-            std::string line;
-            std::getline(in, line);
-            if (in.fail())
-                break;
-            if (line.empty())
-                continue;
+        auto stats = std::ofstream{};
+        if (!opts.statsFileName.empty())
+        {
+            stats.open(opts.statsFileName);
+            if (!stats.is_open())
+                throw_("Failed to open output file ", opts.statsFileName);
+            writeRenderStatsHeader(stats);
+        }
 
-            if (lineNumber == 1)
-                continue;   // Skip header
+        auto cacheFileName = [&](uint64_t hash)
+        { return fs::path(opts.cacheDir) / (hex(hash) + ".png"); };
 
-            size_t pos = 0;
-            auto nextToken = [&]()-> std::optional<std::string>
-            {
-                if (pos == std::string::npos || pos == line.size())
-                    return std::nullopt;
-
-                auto pos2 = line.find_first_of(',', pos);
-                auto n = (pos2 == std::string::npos ? line.size() : pos2) - pos;
-                auto token = line.substr(pos, n);
-                pos = pos2 == std::string::npos? std::string::npos: pos2 + 1;
-                return token;
-            };
-
-            auto nextValue =
-                [&]<typename T>(T& value)
-                -> bool
-            {
-                auto tok = nextToken();
-                if (!tok || *tok == "*"sv)
-                    return false;
-                std::istringstream s{ *tok };
-                s >> value;
-                if (s.fail())
-                    throw_("Failed to parse value '", *tok,
-                           "', line ", lineNumber);
-                return true;
-            };
-
-            auto ensureNextValue =
-                [&]<typename T>(T& value)
+        // Render each distinct image once. Streams can only reuse an image
+        // for consecutive frames; files can reuse it anywhere.
+        auto jobs = std::vector<FrameJob>{};
+        {
+            auto span = TraceSpan{ "plan frames" };
+            auto jobByHash = std::unordered_map<uint64_t, size_t>{};
+            size_t cachedFrameCount = 0;
+            for (auto iframe=beginFrame; iframe<endFrame; ++iframe)
             {
-                if (!nextValue(value))
-                    throw_("Too few values in line ", lineNumber);
-            };
+                auto hash = frameHash(frameSource.frame(iframe));
+                if (!opts.cacheDir.empty() && fs::exists(cacheFileName(hash)))
+                {
+                    linkOrCopyFile(
+                        cacheFileName(hash),
+                        outputFileName(iframe+1).toStdString());
+                    ++cachedFrameCount;
+                    continue;
+                }
 
-            auto read2dLine = [&]() -> std::vector<Vec2d>
-            {
-                auto result = std::vector<Vec2d>{};
-                while (true)
+                auto it = jobByHash.find(hash);
+                if (it != jobByHash.end() &&
+                    (!stream || jobs[it->second].frames.back()+1 == iframe))
                 {
-                    double x;
-                    double y;
-                    if (!nextValue(x))
-                        break;
-                    if (!nextValue(y))
-                        throw_("Odd number of 2d line coordinates, line ",
-                               lineNumber);
-                    result.emplace_back(x, y);
+                    jobs[it->second].frames.push_back(iframe);
+                    continue;
                 }
-                return result;
-            };
 
-            auto readStruct = [&]<typename T>(TypeTag<T> tag) -> T
-            {
-                T result;
+                jobByHash[hash] = jobs.size();
+                jobs.push_back({ .hash = hash, .frames = { iframe } });
+            }
 
-                auto fields = fields_of(result);
-                constexpr auto fieldCount = std::tuple_size_v<decltype(fields)>;
-                [&]<size_t... I>(std::index_sequence<I...>)
-                {
-                    (ensureNextValue(std::get<I>(fields)), ...);
-                }(std::make_index_sequence<fieldCount>());
-
-                return result;
-            };
-
-            batchLines.push_back({
-                .base         = read2dLine(),
-                .gen          = read2dLine(),
-                .viewParam    = readStruct(Type<FractalViewParam>),
-                .size         = readStruct(Type<QSize>),
-                .animParam    = readStruct(Type<AnimParam>)});
-
-            if (nextToken())
-                std::cout << "NOTE: Ignoring extra elements in line "
-                          << lineNumber << std::endl;
+            log << "Rendering " << jobs.size() << " distinct images for "
+                << endFrame - beginFrame - cachedFrameCount << " frames";
+            if (cachedFrameCount > 0)
+                log << ", " << cachedFrameCount << " frames found in cache";
+            log << std::endl;
         }
 
-        if (fs::exists(outputDirName))
-            throw_("Output directory '", outputDirName, "' already exists");
-
-        if (!fs::create_directory(outputDirName))
-            throw_("Failed to create output directory '", outputDirName, "'");
+        // Called in job order, after the job's frames have been written
+        auto frameDone =
+            [&](size_t ijob, const RenderFractlalResult& renderResult)
+        {
+            if (stats.is_open())
+                writeRenderStats(
+                    stats, jobs[ijob].frames.front()+1, renderResult);
+        };
+        auto orderedFrameDone =
+            OrderedCompletion<RenderFractlalResult, decltype(frameDone)>{
+                frameDone };
+
+        // Frames flow through three stages, each with its own workers:
+        // render -> (queue) -> encode -> (queue) -> write.
+        // Tokens limit the total number of frames in flight.
+        auto encodeQueue = BoundedQueue<std::pair<size_t, RenderedFrame>>{
+            opts.queueSize };
+        auto writeQueue = BoundedQueue<std::pair<size_t, EncodedFrame>>{
+            opts.queueSize };
+        auto inFlightTokens = BoundedQueue<int>{ opts.maxInFlight };
+        for (size_t i=0; i<opts.maxInFlight; ++i)
+            inFlightTokens.push(0);
+
+        // Stream frames must be written in order; frames waiting for their
+        // predecessors keep their in-flight tokens
+        auto writeStreamFrame = [&](size_t ijob, EncodedFrame& frame)
+        {
+            for (size_t i=0, n=jobs[ijob].frames.size(); i<n; ++i)
+                stream->write(frame.size, frame.data);
+            frameDone(ijob, frame.renderResult);
+            inFlightTokens.push(0);
+        };
+        auto orderedStreamFrames =
+            OrderedCompletion<EncodedFrame, decltype(writeStreamFrame)>{
+                writeStreamFrame };
 
-        std::cout << "Generating images in directory '" << outputDirName << "'"
-                  << std::endl;
+        auto errors = WorkerErrors{};
+        auto cancelAll = [&]
+        {
+            encodeQueue.cancel();
+            writeQueue.cancel();
+            inFlightTokens.cancel();
+        };
 
-        size_t iframe = 0;
-        for (auto& interpolatedLine: interpolateBatchLines(batchLines))
+        // Ctrl+C stops rendering mid-frame; frames completely rendered
+        // are still written
+        auto stopRendering = std::stop_source{};
+        auto renderControl = RenderControl{ .stop = stopRendering.get_token() };
+        auto interruptWatcher = InterruptWatcher{ [&]
         {
-            auto size = interpolatedLine.size;
+            stopRendering.request_stop();
+            inFlightTokens.cancel();
+        } };
 
-            // Make image width and height even, because ffmpeg may want it
-            size.rwidth() &= ~1;
-            size.rheight() &= ~1;
+        // Images are recycled once encoded
+        auto imagePool = ImagePool{ QImage::Format_ARGB32, opts.maxInFlight };
 
-            renderFractalImage(interpolatedLine.base,
-                               interpolatedLine.gen,
-                               interpolatedLine.viewParam,
-                               size)
-                .save(outputFileName(++iframe));
-        }
+        auto geometryCache = GeometryCache{ opts.geometryCacheMiB << 20 };
+
+        // Engine warnings are similar for all frames; show the first one
+        auto engineWarningOnce = std::once_flag{};
+
+        auto nextJob = std::atomic<size_t>{ 0 };
+        auto renderWorkers = startWorkers(
+            opts.renderJobs,
+            [&](size_t workerIndex)
+            {
+                nameWorkerThread("render", workerIndex);
+                errors.run([&]
+                {
+                    auto context = RenderContext{};
+                    if (opts.geometryCacheMiB > 0)
+                        context.scratch.geometryCache = &geometryCache;
+
+                    // Frames are content-addressed, so time budgets
+                    // must not depend on which worker renders them
+                    context.scratch.vertexRate = defaultVertexRate;
+                    context.scratch.fixedVertexRate = true;
+                    while (inFlightTokens.pop())
+                    {
+                        auto ijob = nextJob++;
+                        if (ijob >= jobs.size())
+                        {
+                            // Pass the token on to workers still waiting
+                            inFlightTokens.push(0);
+                            return;
+                        }
+
+                        auto iframe = jobs[ijob].frames.front();
+                        auto frameSpan = TraceSpan{
+                            "render frame", "frame",
+                            static_cast<long long>(iframe+1) };
+                        frameSource.frame(iframe, context.frame);
+
+                        auto frame = renderFractalImage(
+                            context.frame,
+                            frameSize(context.frame),
+                            context.scratch,
+                            imagePool,
+                            renderControl);
+                        if (frame.renderResult.cancelled)
+                            return;
+
+                        const auto& renderResult = frame.renderResult;
+                        if (renderResult.refused)
+                            throw_("Frame ", iframe+1, ": ",
+                                   renderResult.engineWarning);
+                        if (!renderResult.engineWarning.empty())
+                            std::call_once(engineWarningOnce, [&]
+                            {
+                                log << "WARNING: Frame " << iframe+1 << ": "
+                                    << renderResult.engineWarning
+                                    << " (not reported for further frames)"
+                                    << std::endl;
+                            });
+
+                        if (opts.vertexFormat)
+                        {
+                            const auto& job = jobs[ijob];
+                            auto fileName = vertexFileName(iframe+1);
+                            auto exportTo = [&](auto&& writer)
+                            {
+                                exportFractalVertices(
+                                    writer,
+                                    context.frame.base,
+                                    context.frame.gen,
+                                    context.frame.viewParam,
+                                    frame.renderResult);
+                                writer.close();
+                            };
+                            if (auto bits = opts.vertexFormat->quantizationBits)
+                                exportTo(PackedVertexWriter{
+                                    fileName,
+                                    curveBounds(context.frame.base,
+                                                context.frame.gen),
+                                    bits });
+                            else
+                                exportTo(VertexFileWriter{
+                                    fileName, opts.vertexFormat->precision });
+                            for (auto jframe: job.frames)
+                                linkOrCopyFile(
+                                    fileName, vertexFileName(jframe+1));
+                        }
+                        if (!encodeQueue.push({ ijob, std::move(frame) }))
+                            return;
+                    }
+                }, cancelAll);
+            },
+            [&]{ encodeQueue.close(); });
+
+        auto encodeWorkers = startWorkers(
+            opts.encodeJobs,
+            [&](size_t workerIndex)
+            {
+                nameWorkerThread("encode", workerIndex);
+                errors.run([&]
+                {
+                    while (auto item = encodeQueue.pop())
+                    {
+                        auto& [ijob, frame] = *item;
+                        auto encoded = EncodedFrame{
+                            .size = frame.image.size(),
+                            .data = encodeFrame(frame.image, opts.format),
+                            .renderResult = std::move(frame.renderResult)
+                        };
+                        imagePool.recycle(std::move(frame.image));
+                        if (!writeQueue.push({ ijob, std::move(encoded) }))
+                            return;
+                    }
+                }, cancelAll);
+            },
+            [&]{ writeQueue.close(); });
+
+        auto writeWorkers = startWorkers(
+            opts.writeJobs,
+            [&](size_t workerIndex)
+            {
+                nameWorkerThread("write", workerIndex);
+                errors.run([&]
+                {
+                    while (auto item = writeQueue.pop())
+                    {
+                        auto& [ijob, frame] = *item;
+                        if (stream)
+                        {
+                            orderedStreamFrames.complete(
+                                ijob, std::move(frame));
+                            continue;
+                        }
+
+                        const auto& job = jobs[ijob];
+                        auto firstFile =
+                            fs::path(outputFileName(job.frames.front()+1)
+                                .toStdString());
+                        if (opts.cacheDir.empty())
+                            writeFileAtomically(firstFile, frame.data);
+                        else
+                        {
+                            writeFileAtomically(
+                                cacheFileName(job.hash), frame.data);
+                            linkOrCopyFile(cacheFileName(job.hash), firstFile);
+                        }
+                        for (auto iframe: job.frames)
+                            linkOrCopyFile(
+                                firstFile,
+                                outputFileName(iframe+1).toStdString());
+
+                        orderedFrameDone.complete(
+                            ijob, std::move(frame.renderResult));
+                        inFlightTokens.push(0);
+                    }
+                }, cancelAll);
+            },
+            []{});
+
+        renderWorkers.clear();
+        encodeWorkers.clear();
+        writeWorkers.clear();
+        errors.rethrow();
+        if (stopRendering.stop_requested())
+            throw_("Interrupted; frames rendered before have been written");
+
+        if (stream)
+            stream->close();
 
         return EXIT_SUCCESS;
     }
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <QString>
+#include <QStringList>
 
-auto batch(const QString& batchFileName)
+// Renders animation frames described by a batch file; options are the
+// remaining command line arguments
+auto batch(const QString& batchFileName, const QStringList& options)
     -> int;
@@ -0,0 +1,373 @@
+#include "batch_csv.hpp"
+
+#include "throw.hpp"
+#include "trace.hpp"
+
+#include <QFile>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+
+using namespace std::string_view_literals;
+
+namespace {
+
+// Position of the token being parsed, for error messages
+struct CsvLocation
+{
+    size_t line{};
+    size_t column{};
+    std::string_view columnName;
+};
+
+auto operator<<(std::ostream& s, const CsvLocation& location)
+    -> std::ostream&
+{
+    s << "line " << location.line << ", column " << location.column;
+    if (!location.columnName.empty())
+        s << " (" << location.columnName << ")";
+    return s;
+}
+
+template <typename T>
+auto parseNumber(std::string_view token, const CsvLocation& location)
+    -> T
+{
+    auto value = T{};
+    auto end = token.data() + token.size();
+    auto [ptr, ec] = std::from_chars(token.data(), end, value);
+    if (ec != std::errc{} || ptr != end)
+        throw_("Failed to parse value '", token, "', ", location);
+    return value;
+}
+
+auto parseValue(std::string_view token,
+                double& value,
+                const CsvLocation& location)
+    -> void
+{ value = parseNumber<double>(token, location); }
+
+auto parseValue(std::string_view token,
+                size_t& value,
+                const CsvLocation& location)
+    -> void
+{ value = parseNumber<size_t>(token, location); }
+
+auto parseValue(std::string_view token,
+                int& value,
+                const CsvLocation& location)
+    -> void
+{ value = parseNumber<int>(token, location); }
+
+auto parseValue(std::string_view token,
+                bool& value,
+                const CsvLocation& location)
+    -> void
+{
+    if (token == "0"sv)
+        value = false;
+    else if (token == "1"sv)
+        value = true;
+    else
+        throw_("Failed to parse boolean value '", token, "', ", location);
+}
+
+// Splits text into lines, and lines into comma-separated tokens
+class Tokenizer final
+{
+public:
+    explicit Tokenizer(std::string_view text) :
+        text_{ text }
+    {}
+
+    auto nextLine()
+        -> bool
+    {
+        if (pos_ >= text_.size())
+            return false;
+        auto end = text_.find('\n', pos_);
+        if (end == std::string_view::npos)
+            end = text_.size();
+        line_ = text_.substr(pos_, end - pos_);
+        if (!line_.empty() && line_.back() == '\r')
+            line_.remove_suffix(1);
+        pos_ = end + 1;
+        ++location_.line;
+        location_.column = 0;
+        tokenPos_ = line_.empty()? std::string_view::npos: 0;
+        return true;
+    }
+
+    auto lineEmpty() const noexcept
+        -> bool
+    { return line_.empty(); }
+
+    auto nextToken()
+        -> std::optional<std::string_view>
+    {
+        if (tokenPos_ == std::string_view::npos)
+            return std::nullopt;
+        auto end = line_.find(',', tokenPos_);
+        auto token = line_.substr(
+            tokenPos_,
+            (end == std::string_view::npos? line_.size(): end) - tokenPos_);
+        tokenPos_ = end == std::string_view::npos? end: end + 1;
+        ++location_.column;
+        return token;
+    }
+
+    auto location() const noexcept
+        -> const CsvLocation&
+    { return location_; }
+
+    auto setColumnName(std::string_view name) noexcept
+        -> void
+    { location_.columnName = name; }
+
+private:
+    std::string_view text_;
+    size_t pos_{};
+    std::string_view line_;
+    size_t tokenPos_{ std::string_view::npos };
+    CsvLocation location_;
+};
+
+using FieldSetter =
+    void(*)(BatchLine&, std::string_view, const CsvLocation&);
+
+template <auto member, size_t I>
+auto setField(BatchLine& batchLine,
+              std::string_view token,
+              const CsvLocation& location)
+    -> void
+{ parseValue(token, std::get<I>(fields_of(batchLine.*member)), location); }
+
+struct FieldColumnInfo
+{
+    std::string_view name;
+    FieldSetter set;
+};
+
+template <auto member, typename T>
+auto appendFieldColumns(std::vector<FieldColumnInfo>& result, TypeTag<T> tag)
+    -> void
+{
+    auto names = field_names_of(tag);
+    [&]<size_t... I>(std::index_sequence<I...>)
+    {
+        (result.push_back({ names[I], &setField<member, I> }), ...);
+    }(std::make_index_sequence<std::tuple_size_v<decltype(names)>>());
+}
+
+auto fieldColumns()
+    -> const std::vector<FieldColumnInfo>&
+{
+    static const auto result = []
+    {
+        auto result = std::vector<FieldColumnInfo>{};
+        appendFieldColumns<&BatchLine::viewParam>(
+            result, Type<FractalViewParam>);
+        appendFieldColumns<&BatchLine::size>(result, Type<QSize>);
+        appendFieldColumns<&BatchLine::animParam>(result, Type<AnimParam>);
+        return result;
+    }();
+    return result;
+}
+
+struct LineColumnInfo
+{
+    std::string_view name;
+    std::vector<Vec2d> BatchLine::* line;
+};
+
+constexpr LineColumnInfo lineColumns[] = {
+    { "base", &BatchLine::base },
+    { "gen", &BatchLine::gen }
+};
+
+// Fields having no sensible default value
+constexpr std::string_view requiredFields[] = { "width", "height" };
+
+// A column group in the header: a 2d line or a single field
+struct Column
+{
+    std::string_view name;
+    std::vector<Vec2d> BatchLine::* line{};
+    FieldSetter set{};
+    bool required{};
+};
+
+auto parseHeader(Tokenizer& tokenizer, std::ostream& log)
+    -> std::vector<Column>
+{
+    auto result = std::vector<Column>{};
+    auto expectToken = [&](std::string_view expected)
+    {
+        auto token = tokenizer.nextToken();
+        if (token != expected)
+            throw_("Expected '", expected, "' in header, ",
+                   tokenizer.location());
+    };
+
+    while (auto token = tokenizer.nextToken())
+    {
+        if (token->ends_with("_x#"sv))
+        {
+            auto name = token->substr(0, token->size() - 3);
+            auto it = std::find_if(
+                std::begin(lineColumns), std::end(lineColumns),
+                [&](const LineColumnInfo& c) { return c.name == name; });
+            if (it == std::end(lineColumns))
+                throw_("Unknown 2d line '", name, "' in header, ",
+                       tokenizer.location());
+            expectToken(std::string{ name } + "_y#...");
+            expectToken("*"sv);
+            if (std::any_of(
+                    result.begin(), result.end(),
+                    [&](const Column& c) { return c.line == it->line; }))
+                throw_("Duplicate 2d line '", name, "' in header, ",
+                       tokenizer.location());
+            result.push_back({ .name = it->name, .line = it->line });
+            continue;
+        }
+
+        const auto& fields = fieldColumns();
+        auto it = std::find_if(
+            fields.begin(), fields.end(),
+            [&](const FieldColumnInfo& c) { return c.name == *token; });
+        if (it == fields.end())
+        {
+            log << "NOTE: Ignoring unknown column '" << *token << "', "
+                << tokenizer.location() << std::endl;
+            result.push_back({});
+            continue;
+        }
+        if (std::any_of(
+                result.begin(), result.end(),
+                [&](const Column& c) { return c.set == it->set; }))
+            throw_("Duplicate column '", *token, "' in header, ",
+                   tokenizer.location());
+        result.push_back({
+            .name = it->name,
+            .set = it->set,
+            .required = std::ranges::find(requiredFields, it->name) !=
+                        std::end(requiredFields) });
+    }
+
+    for (const auto& lineColumn: lineColumns)
+        if (std::none_of(
+                result.begin(), result.end(),
+                [&](const Column& c) { return c.line == lineColumn.line; }))
+            throw_("Missing 2d line '", lineColumn.name, "' in header");
+
+    for (auto name: requiredFields)
+        if (std::none_of(
+                result.begin(), result.end(),
+                [&](const Column& c) { return c.set && c.name == name; }))
+            throw_("Missing column '", name, "' in header");
+
+    return result;
+}
+
+} // anonymous namespace
+
+auto parseBatchLines(std::string_view text, std::ostream& log)
+    -> std::vector<BatchLine>
+{
+    auto tokenizer = Tokenizer{ text };
+    if (!tokenizer.nextLine())
+        throw_("Batch file is empty");
+    auto columns = parseHeader(tokenizer, log);
+
+    auto result = std::vector<BatchLine>{};
+    result.reserve(std::count(text.begin(), text.end(), '\n'));
+
+    while (tokenizer.nextLine())
+    {
+        if (tokenizer.lineEmpty())
+            continue;
+
+        auto& batchLine = result.emplace_back();
+        for (const auto& column: columns)
+        {
+            tokenizer.setColumnName(column.name);
+            if (column.line)
+            {
+                auto& line = batchLine.*column.line;
+                while (true)
+                {
+                    auto x = tokenizer.nextToken();
+                    if (!x)
+                        throw_("Unterminated 2d line, ",
+                               tokenizer.location());
+                    if (*x == "*"sv)
+                        break;
+                    auto y = tokenizer.nextToken();
+                    if (!y || *y == "*"sv)
+                        throw_("Odd number of 2d line coordinates, ",
+                               tokenizer.location());
+                    line.emplace_back(
+                        parseNumber<double>(*x, tokenizer.location()),
+                        parseNumber<double>(*y, tokenizer.location()));
+                }
+                continue;
+            }
+
+            auto token = tokenizer.nextToken();
+            if (!token)
+                throw_("Too few values, ", tokenizer.location());
+            if (token->empty())
+            {
+                if (column.required)
+                    throw_("Missing value, ", tokenizer.location());
+                continue;
+            }
+            if (column.set)
+                column.set(batchLine, *token, tokenizer.location());
+        }
+        tokenizer.setColumnName({});
+
+        if (tokenizer.nextToken())
+            log << "NOTE: Ignoring extra elements in line "
+                << tokenizer.location().line << std::endl;
+    }
+
+    return result;
+}
+
+auto readBatchFile(const QString& fileName, std::ostream& log)
+    -> std::vector<BatchLine>
+{
+    auto span = TraceSpan{ "read batch file" };
+
+    auto file = QFile{ fileName };
+    if (!file.open(QIODevice::ReadOnly))
+        throw_("Failed to open input file '", fileName.toStdString(), "'");
+
+    // Not every file can be mapped (e.g., a pipe); read these instead
+    auto size = file.size();
+    auto data = size > 0? file.map(0, size): nullptr;
+    auto contents = QByteArray{};
+    if (!data)
+        contents = file.readAll();
+
+    auto text = data
+        ? std::string_view{ reinterpret_cast<const char*>(data),
+                            static_cast<size_t>(size) }
+        : std::string_view{ contents.constData(),
+                            static_cast<size_t>(contents.size()) };
+
+    try
+    {
+        return parseBatchLines(text, log);
+    }
+    catch (const std::exception& e)
+    {
+        throw_("Failed to read batch file '", fileName.toStdString(),
+               "': ", e.what());
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "batch_frames.hpp"
+
+#include <QString>
+
+#include <iosfwd>
+#include <string_view>
+#include <vector>
+
+// Batch files are CSV files written by the state log of FractalView.
+// The header names the columns: each 2d line takes a variable number of
+// columns, e.g. `base_x#,base_y#...,*`, and is terminated by `*` in every
+// line; the remaining columns are fields named by `field_names_of`.
+// Fields missing in the header, or having empty values, take their default
+// values; 2d lines and frame size are required.
+
+auto parseBatchLines(std::string_view text, std::ostream& log)
+    -> std::vector<BatchLine>;
+
+// Memory-maps the file and parses it with parseBatchLines
+auto readBatchFile(const QString& fileName, std::ostream& log)
+    -> std::vector<BatchLine>;
@@ -0,0 +1,131 @@
+#include "batch_frames.hpp"
+
+#include "throw.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+
+auto lerp(double x0, double x1, double p)
+    -> double
+{ return x0*(1-p) + x1*p; }
+
+auto lerp(size_t x0, size_t x1, double p)
+    -> size_t
+{ return std::lround(x0*(1-p) + x1*p); }
+
+auto lerp(int x0, int x1, double p)
+    -> int
+{ return std::lround(x0*(1-p) + x1*p); }
+
+auto lerp(bool x0, bool x1, double p)
+    -> bool
+{ return lerp(x0? 1.: 0., x1? 1.:0, p) >= 0.5; }
+
+template <typename T>
+auto lerpStruct(const T& x0, const T& x1, double p)
+    -> T
+{
+    auto result = T{};
+    auto f0 = fields_of(x0);
+    auto f1 = fields_of(x1);
+    auto f = fields_of(result);
+    constexpr auto fieldCount = std::tuple_size_v<decltype(f)>;
+    [&]<size_t... I>(std::index_sequence<I...>)
+    {
+        ((std::get<I>(f) = lerp(std::get<I>(f0), std::get<I>(f1), p)), ...);
+    }(std::make_index_sequence<fieldCount>());
+    return result;
+}
+
+auto getBase(const BatchLine& batchLine)
+    -> const std::vector< Vec2d >&
+{ return batchLine.base; }
+
+auto getGen(const BatchLine& batchLine)
+    -> std::vector< Vec2d >
+{
+    auto result = std::vector< Vec2d >( batchLine.gen );
+    for(auto& v: result)
+    {
+        if (batchLine.animParam.reflectX)
+            v[0] = -v[0];
+        if (batchLine.animParam.reflectY)
+            v[1] = -v[1];
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+BatchFrameSource::BatchFrameSource(std::vector<BatchLine> keyframes) :
+    keyframes_{ std::move(keyframes) }
+{
+    if (keyframes_.empty())
+        throw_("No frames to interpolate");
+
+    auto span = TraceSpan{ "interpolate batch lines" };
+
+    pieceFrames_.reserve(keyframes_.size());
+    size_t iframe = 1;
+    for (size_t iline=0, nlines=keyframes_.size(); iline+1<nlines; ++iline)
+    {
+        pieceFrames_.push_back(iframe);
+        iframe += keyframes_[iline].animParam.frameCountAfter;
+    }
+    pieceFrames_.push_back(iframe);
+
+    if (keyframes_.size() > 1)
+    {
+        auto kfs = std::span<const BatchLine>{ keyframes_ };
+        base_ = CurveInterpolator<Vec2d>(kfs, getBase);
+        gen_ = CurveInterpolator<Vec2d>(kfs, getGen);
+    }
+}
+
+auto BatchFrameSource::frameCount() const noexcept
+    -> size_t
+{ return pieceFrames_.back(); }
+
+auto BatchFrameSource::frame(size_t index) const
+    -> BatchLine
+{
+    auto result = BatchLine{};
+    frame(index, result);
+    return result;
+}
+
+auto BatchFrameSource::frame(size_t index, BatchLine& result) const
+    -> void
+{
+    assert(index < frameCount());
+    if (index == 0)
+    {
+        result = keyframes_.front();
+        return;
+    }
+
+    // Find the last piece starting at or before index; pieces
+    // with no frames start where the next piece starts
+    auto it = std::upper_bound(
+        pieceFrames_.begin(), std::prev(pieceFrames_.end()), index);
+    auto piece = static_cast<size_t>(it - pieceFrames_.begin()) - 1;
+    const auto& bl0 = keyframes_[piece];
+    const auto& bl1 = keyframes_[piece+1];
+
+    auto isub = index - pieceFrames_[piece];
+    auto p = static_cast<double>(isub+1) / bl0.animParam.frameCountAfter;
+    auto curveParam = easedParam(
+        p, bl0.animParam.slopeFactor, bl1.animParam.slopeFactor);
+
+    result.base.resize(base_.curveCount());
+    result.gen.resize(gen_.curveCount());
+    base_.eval(result.base, piece, curveParam);
+    gen_.eval(result.gen, piece, curveParam);
+    result.viewParam = lerpStruct(bl0.viewParam, bl1.viewParam, p);
+    result.size = lerpStruct(bl0.size, bl1.size, p);
+    result.animParam = {};
+}
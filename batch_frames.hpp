@@ -0,0 +1,65 @@
+#pragma once
+
+#include "anim_param.hpp"
+#include "fractalview_param.h"
+#include "interp_curves.hpp"
+#include "vec2.hpp"
+
+#include <QSize>
+
+#include <array>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Batch file line: a keyframe of the animation, or a single frame
+struct BatchLine
+{
+    std::vector<Vec2d> base;
+    std::vector<Vec2d> gen;
+    FractalViewParam viewParam;
+    QSize size;
+    AnimParam animParam;
+};
+
+inline auto field_names_of(TypeTag<QSize>)
+    -> std::array<std::string_view, 2>
+{ return { "width", "height" }; }
+
+inline auto fields_of(QSize& p)
+    -> std::tuple<int&, int&>
+{ return std::tie(p.rwidth(), p.rheight()); }
+
+inline auto fields_of(const QSize& p)
+    -> std::tuple<int, int>
+{ return {p.width(), p.height()}; }
+
+
+// Animation frames interpolated between keyframes. Frames are evaluated
+// on demand, in any order; frame 0 is the first keyframe, followed by
+// frameCountAfter frames for each keyframe but the last one.
+class BatchFrameSource final
+{
+public:
+    explicit BatchFrameSource(std::vector<BatchLine> keyframes);
+
+    auto frameCount() const noexcept
+        -> size_t;
+
+    auto frame(size_t index) const
+        -> BatchLine;
+
+    // Same as above, reusing memory held by result
+    auto frame(size_t index, BatchLine& result) const
+        -> void;
+
+private:
+    std::vector<BatchLine> keyframes_;
+
+    // Index of the first frame of each piece between keyframes,
+    // followed by the total number of frames
+    std::vector<size_t> pieceFrames_;
+
+    CurveInterpolator<Vec2d> base_;
+    CurveInterpolator<Vec2d> gen_;
+};
@@ -0,0 +1,250 @@
+#include "batch_output.hpp"
+
+#include "throw.hpp"
+#include "trace.hpp"
+
+#include <QBuffer>
+
+#include <fstream>
+#include <iostream>
+#include <regex>
+
+namespace {
+
+auto encodePng(const QImage& image)
+    -> QByteArray
+{
+    auto result = QByteArray{};
+    auto buffer = QBuffer{ &result };
+    buffer.open(QIODevice::WriteOnly);
+    if (!image.save(&buffer, "PNG"))
+        throw_("Failed to encode PNG image");
+    return result;
+}
+
+auto encodeRgb(const QImage& image)
+    -> QByteArray
+{
+    auto rgb = image.convertToFormat(QImage::Format_RGB888);
+    auto w = rgb.width();
+    auto h = rgb.height();
+    auto rowBytes = 3 * w;
+    auto result = QByteArray{};
+    result.resize(static_cast<qsizetype>(rowBytes) * h);
+    auto* dst = result.data();
+    for (int y=0; y<h; ++y, dst+=rowBytes)
+        std::copy_n(rgb.constScanLine(y), rowBytes, dst);
+    return result;
+}
+
+// BT.601 limited range, 8-bit fixed point coefficients
+struct Yuv
+{
+    static auto y(int r, int g, int b) -> char
+    { return static_cast<char>(((66*r + 129*g + 25*b + 128) >> 8) + 16); }
+
+    static auto u(int r, int g, int b) -> char
+    { return static_cast<char>(((-38*r - 74*g + 112*b + 128) >> 8) + 128); }
+
+    static auto v(int r, int g, int b) -> char
+    { return static_cast<char>(((112*r - 94*g - 18*b + 128) >> 8) + 128); }
+};
+
+auto encodeY4mFrame(const QImage& image)
+    -> QByteArray
+{
+    auto rgb = image.convertToFormat(QImage::Format_RGB32);
+    auto w = rgb.width();
+    auto h = rgb.height();
+    if ((w | h) & 1)
+        throw_("Y4M output requires even frame width and height");
+
+    static constexpr auto frameHeader = std::string_view{ "FRAME\n" };
+    auto lumaSize = static_cast<qsizetype>(w) * h;
+    auto chromaSize = lumaSize / 4;
+    auto result = QByteArray{};
+    result.resize(frameHeader.size() + lumaSize + 2*chromaSize);
+    auto* out = std::copy(frameHeader.begin(), frameHeader.end(), result.data());
+    auto* yPlane = out;
+    auto* uPlane = yPlane + lumaSize;
+    auto* vPlane = uPlane + chromaSize;
+
+    auto channel = [](const uchar* line, int x, int shift)
+    { return static_cast<int>(line[4*x + shift]); };
+
+    for (int y=0; y<h; y+=2)
+    {
+        // Format_RGB32 is 0xffRRGGBB in native byte order
+        const uchar* lines[2] = { rgb.constScanLine(y), rgb.constScanLine(y+1) };
+        for (int x=0; x<w; x+=2)
+        {
+            int rs = 0, gs = 0, bs = 0;
+            for (int dy=0; dy<2; ++dy)
+                for (int dx=0; dx<2; ++dx)
+                {
+                    auto pixel =
+                        reinterpret_cast<const uint32_t*>(lines[dy])[x+dx];
+                    int r = (pixel >> 16) & 0xff;
+                    int g = (pixel >> 8) & 0xff;
+                    int b = pixel & 0xff;
+                    yPlane[(y+dy)*w + x+dx] = Yuv::y(r, g, b);
+                    rs += r;
+                    gs += g;
+                    bs += b;
+                }
+            auto ic = (y/2)*(w/2) + x/2;
+            uPlane[ic] = Yuv::u(rs/4, gs/4, bs/4);
+            vPlane[ic] = Yuv::v(rs/4, gs/4, bs/4);
+        }
+    }
+    return result;
+}
+
+auto writeFile(const QString& fileName, const QByteArray& data)
+    -> void
+{
+    auto span = TraceSpan{ "write file" };
+    auto s = std::ofstream(fileName.toStdString(), std::ios::binary);
+    s.write(data.constData(), data.size());
+    s.close();
+    if (s.fail())
+        throw_("Failed to write file '", fileName.toStdString(), "'");
+}
+
+} // anonymous namespace
+
+
+
+auto parseFrameFormat(const std::string& name)
+    -> FrameFormat
+{
+    if (name == "png")
+        return FrameFormat::Png;
+    if (name == "y4m")
+        return FrameFormat::Y4m;
+    if (name == "rgb")
+        return FrameFormat::Rgb;
+    throw_("Unknown frame format '", name, "', expected png, y4m or rgb");
+}
+
+auto encodeFrame(const QImage& image, FrameFormat format)
+    -> QByteArray
+{
+    auto span = TraceSpan{ "encode frame" };
+    switch (format)
+    {
+    case FrameFormat::Png:
+        return encodePng(image);
+    case FrameFormat::Y4m:
+        return encodeY4mFrame(image);
+    case FrameFormat::Rgb:
+        return encodeRgb(image);
+    }
+    throw_("Invalid frame format");
+}
+
+auto writeFileAtomically(const std::filesystem::path& path,
+                         const QByteArray& data)
+    -> void
+{
+    auto tmpPath = path;
+    tmpPath += ".tmp";
+    writeFile(QString::fromStdString(tmpPath), data);
+    std::filesystem::rename(tmpPath, path);
+}
+
+
+
+FrameStream::FrameStream(const std::string& path,
+                         FrameFormat format,
+                         const std::string& frameRate):
+    path_{ path },
+    format_{ format },
+    frameRate_{ frameRate }
+{
+    if (format_ == FrameFormat::Png)
+        throw_("PNG frames cannot be streamed");
+
+    static const auto rateRegex = std::regex{ "[1-9][0-9]*(:[1-9][0-9]*)?" };
+    if (!std::regex_match(frameRate_, rateRegex))
+        throw_("Invalid frame rate '", frameRate_, "', expected N or N:D");
+    if (frameRate_.find(':') == std::string::npos)
+        frameRate_ += ":1";
+
+    if (path_ == "-")
+        file_ = stdout;
+    else
+    {
+        file_ = std::fopen(path_.c_str(), "wb");
+        if (!file_)
+            throw_("Failed to open output stream '", path_, "'");
+    }
+}
+
+FrameStream::~FrameStream()
+{
+    if (file_ && file_ != stdout)
+        std::fclose(file_);
+}
+
+auto FrameStream::write(const QSize& size, const QByteArray& data)
+    -> void
+{
+    auto span = TraceSpan{ "write stream frame" };
+
+    if (frameCount_ == 0)
+    {
+        size_ = size;
+        if (format_ == FrameFormat::Y4m)
+        {
+            auto header =
+                "YUV4MPEG2 W" + std::to_string(size.width()) +
+                " H" + std::to_string(size.height()) +
+                " F" + frameRate_ +
+                " Ip A1:1 C420jpeg\n";
+            writeBytes(header.data(), header.size());
+        }
+        else
+        {
+            auto rate = frameRate_;
+            rate[rate.find(':')] = '/';
+            std::cerr << "Streaming rgb24 video " << size.width() << 'x'
+                      << size.height() << " at " << rate << " fps; read"
+                      << " it with: ffmpeg -f rawvideo -pix_fmt rgb24 -s "
+                      << size.width() << 'x' << size.height()
+                      << " -framerate " << rate
+                      << " -i " << path_ << " ..." << std::endl;
+        }
+    }
+    else if (size != size_)
+        throw_("Frame ", frameCount_+1, " size ",
+               size.width(), 'x', size.height(),
+               " differs from stream frame size ",
+               size_.width(), 'x', size_.height());
+
+    writeBytes(data.constData(), data.size());
+    ++frameCount_;
+}
+
+auto FrameStream::close()
+    -> void
+{
+    if (!file_)
+        return;
+    if (std::fflush(file_) != 0)
+        throw_("Failed to write output stream '", path_, "'");
+    if (file_ != stdout)
+    {
+        auto file = file_;
+        file_ = nullptr;
+        if (std::fclose(file) != 0)
+            throw_("Failed to close output stream '", path_, "'");
+    }
+}
+
+auto FrameStream::writeBytes(const char* data, size_t size)
+    -> void
+{
+    if (std::fwrite(data, 1, size, file_) != size)
+        throw_("Failed to write output stream '", path_, "'");
+}
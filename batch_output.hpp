@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+// How batch mode emits frames: PNG files in the output directory,
+// or a single raw video stream
+enum class FrameFormat
+{
+    Png,
+    Y4m,    // YUV4MPEG2, 4:2:0, BT.601 limited range
+    Rgb     // Headerless packed rgb24
+};
+
+auto parseFrameFormat(const std::string& name)
+    -> FrameFormat;
+
+// Encodes frame image as a file (PNG) or as a stream frame payload
+auto encodeFrame(const QImage& image, FrameFormat format)
+    -> QByteArray;
+
+// Writes to a temporary file first, so that an interrupted run
+// never leaves a partially written file under the final name
+auto writeFileAtomically(const std::filesystem::path& path,
+                         const QByteArray& data)
+    -> void;
+
+
+// Raw video stream written to stdout ("-"), a file or a named pipe.
+// All frames must have the same size; the stream header is written
+// before the first frame.
+class FrameStream final
+{
+public:
+    // frameRate is "N" or "N:D" frames per second
+    FrameStream(const std::string& path,
+                FrameFormat format,
+                const std::string& frameRate);
+
+    ~FrameStream();
+
+    FrameStream(const FrameStream&) = delete;
+    FrameStream& operator=(const FrameStream&) = delete;
+
+    auto write(const QSize& size, const QByteArray& data)
+        -> void;
+
+    auto close()
+        -> void;
+
+private:
+    auto writeBytes(const char* data, size_t size)
+        -> void;
+
+    std::string path_;
+    FrameFormat format_;
+    std::string frameRate_;
+    FILE* file_{};
+    QSize size_;
+    size_t frameCount_{};
+};
@@ -0,0 +1,468 @@
+#include "bench.hpp"
+
+#include "generator_file.hpp"
+#include "parse_option.hpp"
+#include "render_fractal.hpp"
+#include "throw.hpp"
+
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QPainter>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Values of one view parameter to bench with
+struct ParamValues
+{
+    std::string name;
+    std::vector<std::string> values;
+};
+
+struct BenchOptions
+{
+    // Empty means examples/*.txt
+    std::vector<std::string> files;
+
+    std::vector<ParamValues> params;
+
+    QSize size{ 1024, 768 };
+    size_t warmupRuns{ 1 };
+    size_t measuredRuns{ 5 };
+
+    std::string jsonFileName;
+    std::string baselineFileName;
+
+    // Percent by which a median may exceed its baseline
+    double threshold{ 10 };
+};
+
+// Parses name=v1,v2,...
+auto parseParamValues(const std::string& text)
+    -> ParamValues
+{
+    auto eq = text.find('=');
+    if (eq == std::string::npos || eq == 0 || eq + 1 == text.size())
+        throw_("Invalid value '", text, "' for option --param, "
+               "expected name=v1,v2,...");
+    auto result = ParamValues{ text.substr(0, eq), {} };
+    auto s = std::istringstream{ text.substr(eq + 1) };
+    for (auto value = std::string{}; std::getline(s, value, ',');)
+        result.values.push_back(value);
+    return result;
+}
+
+auto parseBenchOptions(const QStringList& args)
+    -> BenchOptions
+{
+    auto result = BenchOptions{};
+    for (auto it=args.begin(), end=args.end(); it!=end; ++it)
+    {
+        auto option = it->toStdString();
+        auto value = [&]() -> std::string
+        {
+            if (std::next(it) == end)
+                throw_("Missing value for option ", option);
+            return (++it)->toStdString();
+        };
+
+        if (option == "--param")
+            result.params.push_back(parseParamValues(value()));
+        else if (option == "--size")
+            result.size = parseSizeOption(option, value());
+        else if (option == "--warmup")
+            result.warmupRuns = parseOptionValue<size_t>(option, value());
+        else if (option == "--runs")
+            result.measuredRuns = parseOptionValue<size_t>(option, value());
+        else if (option == "--json")
+            result.jsonFileName = value();
+        else if (option == "--baseline")
+            result.baselineFileName = value();
+        else if (option == "--threshold")
+            result.threshold = parseOptionValue<double>(option, value());
+        else if (option.starts_with("--"))
+            throw_("Unknown bench option '", option, "'");
+        else
+            result.files.push_back(option);
+    }
+
+    if (result.measuredRuns == 0)
+        throw_("Measured runs must be positive");
+    if (result.size.width() <= 0 || result.size.height() <= 0)
+        throw_("Invalid image size ",
+               result.size.width(), 'x', result.size.height());
+    if (result.params.empty())
+        result.params.push_back({ "approx", { "0", "1" } });
+    return result;
+}
+
+auto setViewParam(FractalViewParam& param,
+                  const std::string& name,
+                  const std::string& value)
+    -> void
+{
+    auto found = setViewParamField(param, name, [&](auto& field)
+    {
+        field = parseOptionValue<std::remove_cvref_t<decltype(field)>>(
+            "--param " + name, value);
+    });
+    if (!found)
+        throw_("Unknown view parameter '", name, "'");
+}
+
+// A point of the parameter matrix
+struct BenchCase
+{
+    std::string label;      // E.g. "approx=1 antialiasing=0"
+    FractalViewParam param;
+};
+
+auto benchCases(const std::vector<ParamValues>& params)
+    -> std::vector<BenchCase>
+{
+    auto result = std::vector<BenchCase>{ {} };
+    for (const auto& p: params)
+    {
+        auto expanded = std::vector<BenchCase>{};
+        for (const auto& c: result)
+            for (const auto& value: p.values)
+            {
+                auto next = c;
+                setViewParam(next.param, p.name, value);
+                if (!next.label.empty())
+                    next.label += ' ';
+                next.label += p.name + '=' + value;
+                expanded.push_back(std::move(next));
+            }
+        result = std::move(expanded);
+    }
+    return result;
+}
+
+auto exampleFiles()
+    -> std::vector<std::string>
+{
+    namespace fs = std::filesystem;
+    auto result = std::vector<std::string>{};
+    for (const auto& entry: fs::directory_iterator{ "examples" })
+        if (entry.is_regular_file() && entry.path().extension() == ".txt")
+            result.push_back(entry.path().generic_string());
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+// Times of one phase over the measured runs, in seconds
+struct PhaseStats
+{
+    double min{};
+    double median{};
+    double p95{};
+};
+
+auto phaseStats(std::vector<double> times)
+    -> PhaseStats
+{
+    std::sort(times.begin(), times.end());
+    auto n = times.size();
+    return {
+        times.front(),
+        n % 2? times[n/2]: (times[n/2 - 1] + times[n/2]) / 2,
+        times[static_cast<size_t>(std::ceil(0.95 * n)) - 1] };
+}
+
+struct BenchResult
+{
+    std::string file;
+    std::string label;
+    PhaseStats bbox;
+    PhaseStats render;
+    size_t vertexCount{};
+    bool approxEngine{};
+    bool truncated{};
+
+    // Vertices per second of median render time
+    auto vertexRate() const
+        -> double
+    { return render.median > 0? vertexCount / render.median: 0; }
+};
+
+auto seconds(std::chrono::nanoseconds dt)
+    -> double
+{ return std::chrono::duration<double>(dt).count(); }
+
+auto runCase(const FractalGenerator& gen,
+             const BenchCase& benchCase,
+             const BenchOptions& opts)
+    -> BenchResult
+{
+    auto base = std::vector<Vec2d>{ {0., 0.}, {1., 0.} };
+
+    // Scratch memory is reused between runs, as by FractalView; there is
+    // no geometry cache, so that every run generates its vertices
+    auto scratch = RenderScratch{};
+    auto image = QImage{ opts.size, QImage::Format_ARGB32_Premultiplied };
+
+    auto result = BenchResult{};
+    auto bboxTimes = std::vector<double>{};
+    auto renderTimes = std::vector<double>{};
+    for (size_t run=0, n=opts.warmupRuns+opts.measuredRuns; run<n; ++run)
+    {
+        auto renderResult = RenderFractlalResult{};
+        {
+            auto p = QPainter{ &image };
+            renderResult = renderFractal(
+                p, image.rect(), base, gen, benchCase.param, &scratch);
+        }
+        if (renderResult.refused)
+            throw_(renderResult.engineWarning);
+        if (run < opts.warmupRuns)
+            continue;
+
+        bboxTimes.push_back(seconds(renderResult.computeBbTime));
+        renderTimes.push_back(seconds(renderResult.renderTime));
+        result.vertexCount = totalVertexCount(renderResult);
+        result.approxEngine = renderResult.approxEngine;
+        result.truncated = result.truncated || renderResult.truncated;
+    }
+    result.bbox = phaseStats(std::move(bboxTimes));
+    result.render = phaseStats(std::move(renderTimes));
+    return result;
+}
+
+auto toJson(const PhaseStats& stats)
+    -> QJsonObject
+{
+    auto result = QJsonObject{};
+    result.insert("min", stats.min);
+    result.insert("median", stats.median);
+    result.insert("p95", stats.p95);
+    return result;
+}
+
+auto toJson(const std::vector<BenchResult>& results, const BenchOptions& opts)
+    -> QJsonDocument
+{
+    auto cases = QJsonArray{};
+    for (const auto& r: results)
+    {
+        auto item = QJsonObject{};
+        item.insert("file", QString::fromStdString(r.file));
+        item.insert("param", QString::fromStdString(r.label));
+        item.insert("bbox_s", toJson(r.bbox));
+        item.insert("render_s", toJson(r.render));
+        item.insert("vertices", static_cast<double>(r.vertexCount));
+        item.insert("vertices_per_s", r.vertexRate());
+        item.insert("approx_engine", r.approxEngine);
+        item.insert("truncated", r.truncated);
+        cases.append(item);
+    }
+
+    auto result = QJsonObject{};
+    result.insert("renderer_version", rendererVersion);
+    result.insert("width", opts.size.width());
+    result.insert("height", opts.size.height());
+    result.insert("warmup", static_cast<double>(opts.warmupRuns));
+    result.insert("runs", static_cast<double>(opts.measuredRuns));
+    result.insert("cases", cases);
+    return QJsonDocument{ result };
+}
+
+auto readJsonFile(const std::string& fileName)
+    -> QJsonObject
+{
+    auto s = std::ifstream{ fileName, std::ios::binary };
+    if (!s.is_open())
+        throw_("Failed to open baseline file '", fileName, "'");
+    auto text = std::string{ std::istreambuf_iterator<char>{ s }, {} };
+
+    auto error = QJsonParseError{};
+    auto doc = QJsonDocument::fromJson(
+        QByteArray::fromStdString(text), &error);
+    if (error.error != QJsonParseError::NoError || !doc.isObject())
+        throw_("Failed to parse baseline file '", fileName, "': ",
+               error.errorString().toStdString());
+    return doc.object();
+}
+
+// Medians shorter than this are compared as if they took this long,
+// so that timer noise in trivial cases is not reported
+constexpr double noiseFloor = 1e-3;
+
+// Prints the comparison of medians with the baseline; returns the number
+// of regressions
+auto compareWithBaseline(const std::vector<BenchResult>& results,
+                         const BenchOptions& opts,
+                         std::ostream& log)
+    -> size_t
+{
+    auto baseline = readJsonFile(opts.baselineFileName);
+    if (baseline.value("renderer_version").toInteger() != rendererVersion)
+        log << "WARNING: baseline is from renderer version "
+            << baseline.value("renderer_version").toInteger()
+            << ", current version is " << rendererVersion << std::endl;
+    if (baseline.value("width").toInteger() != opts.size.width() ||
+        baseline.value("height").toInteger() != opts.size.height())
+        log << "WARNING: baseline image size differs" << std::endl;
+
+    auto baselineMedians =
+        std::unordered_map<std::string, std::pair<double, double>>{};
+    for (const auto& value: baseline.value("cases").toArray())
+    {
+        auto item = value.toObject();
+        auto key = item.value("file").toString().toStdString() + '\n' +
+                   item.value("param").toString().toStdString();
+        baselineMedians[key] = {
+            item.value("bbox_s").toObject().value("median").toDouble(),
+            item.value("render_s").toObject().value("median").toDouble() };
+    }
+
+    auto regressions = size_t{};
+    auto limit = 1 + opts.threshold / 100;
+    log << "\nComparison with baseline '" << opts.baselineFileName
+        << "', threshold " << opts.threshold << "%:\n";
+    for (const auto& r: results)
+    {
+        auto it = baselineMedians.find(r.file + '\n' + r.label);
+        if (it == baselineMedians.end())
+        {
+            log << "  " << r.file << " [" << r.label << "]: not in baseline\n";
+            continue;
+        }
+        auto check = [&](const char* phase, double current, double base)
+        {
+            auto ratio = std::max(current, noiseFloor) /
+                         std::max(base, noiseFloor);
+            if (ratio <= limit)
+                return;
+            ++regressions;
+            log << "  REGRESSION " << r.file << " [" << r.label << "] "
+                << phase << ": " << base << " s -> " << current << " s (+"
+                << std::fixed << std::setprecision(1) << (ratio - 1) * 100
+                << "%)" << std::defaultfloat << std::setprecision(6) << '\n';
+        };
+        check("bbox", r.bbox.median, it->second.first);
+        check("render", r.render.median, it->second.second);
+    }
+    if (regressions == 0)
+        log << "  no regressions\n";
+    log << std::flush;
+    return regressions;
+}
+
+auto printResult(std::ostream& s, const BenchResult& r)
+    -> void
+{
+    auto ms = [&](double t) -> std::ostream&
+    { return s << std::setw(9) << std::fixed << std::setprecision(2) << t * 1e3; };
+
+    s << std::left << std::setw(40) << (r.file + " [" + r.label + "]")
+      << std::right;
+    ms(r.bbox.min); ms(r.bbox.median); ms(r.bbox.p95);
+    ms(r.render.min); ms(r.render.median); ms(r.render.p95);
+    s << std::setw(12) << r.vertexCount
+      << std::setw(10) << std::setprecision(1) << r.vertexRate() * 1e-6
+      << (r.truncated? " truncated": "")
+      << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
+} // anonymous namespace
+
+auto bench(const QStringList& options)
+    -> int
+{
+    auto& log = std::cout;
+    try
+    {
+        auto opts = parseBenchOptions(options);
+        auto explicitFiles = !opts.files.empty();
+        if (!explicitFiles)
+            opts.files = exampleFiles();
+        auto cases = benchCases(opts.params);
+
+        log << "Rendering " << opts.files.size() << " files, "
+            << cases.size() << " parameter sets, at "
+            << opts.size.width() << 'x' << opts.size.height() << ", "
+            << opts.warmupRuns << " warm-up and "
+            << opts.measuredRuns << " measured runs; times in ms\n\n"
+            << std::left << std::setw(40) << "file [param]" << std::right;
+        for (auto heading: { "bb min", "bb med", "bb p95",
+                             "rd min", "rd med", "rd p95" })
+            log << std::setw(9) << heading;
+        log << std::setw(12) << "vertices" << std::setw(10) << "Mvert/s"
+            << std::endl;
+
+        auto results = std::vector<BenchResult>{};
+        auto failed = false;
+        for (const auto& file: opts.files)
+        {
+            auto gen = FractalGenerator{};
+            try
+            { gen = readGeneratorFile(file); }
+            catch (const std::exception&)
+            {
+                // Examples include notes that are not generator files
+                if (explicitFiles)
+                    throw;
+                log << "Skipping " << file << ": not a generator file"
+                    << std::endl;
+                continue;
+            }
+
+            for (const auto& benchCase: cases)
+            {
+                try
+                {
+                    auto result = runCase(gen, benchCase, opts);
+                    result.file = file;
+                    result.label = benchCase.label;
+                    printResult(log, result);
+                    results.push_back(std::move(result));
+                }
+                catch (const std::exception& e)
+                {
+                    log << file << " [" << benchCase.label << "]: ERROR: "
+                        << e.what() << std::endl;
+                    failed = true;
+                }
+            }
+        }
+
+        if (!opts.jsonFileName.empty())
+        {
+            auto json = toJson(results, opts).toJson();
+            auto s = std::ofstream{ opts.jsonFileName, std::ios::binary };
+            s.write(json.constData(), json.size());
+            if (!s)
+                throw_("Failed to write '", opts.jsonFileName, "'");
+            log << "\nWrote '" << opts.jsonFileName << "'" << std::endl;
+        }
+
+        auto regressions = opts.baselineFileName.empty()
+            ? size_t{}
+            : compareWithBaseline(results, opts, log);
+
+        return failed || regressions > 0? EXIT_FAILURE: EXIT_SUCCESS;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
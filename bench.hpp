@@ -0,0 +1,22 @@
+#pragma once
+
+#include <QStringList>
+
+// Renders generator files (examples/*.txt by default) under a matrix of
+// view parameters, and reports bounding box and render times and vertex
+// rates. Options and file names are the remaining command line arguments:
+//
+//      --param name=v1,v2,...  Values of a view parameter, named as in
+//                              batch files; repeated, the matrix is their
+//                              product. Default: approx=0,1
+//      --size WxH              Image size, default 1024x768
+//      --warmup N              Unmeasured runs per case, default 1
+//      --runs M                Measured runs per case, default 5
+//      --json FILE             Writes results as JSON
+//      --baseline FILE         Compares medians with a JSON file written
+//                              by --json, and fails on regressions
+//      --threshold PCT         Allowed regression, default 10
+//
+// Returns nonzero if a file fails to render or a case regresses.
+auto bench(const QStringList& options)
+    -> int;
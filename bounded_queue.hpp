@@ -0,0 +1,90 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+// Multi-producer, multi-consumer FIFO queue of limited capacity.
+// close() lets consumers drain the remaining items, while cancel() makes
+// all pending and future push() and pop() calls fail immediately.
+template <typename T>
+class BoundedQueue final
+{
+public:
+    explicit BoundedQueue(size_t capacity):
+        capacity_{ capacity > 0? capacity: 1 }
+    {}
+
+    // Blocks while the queue is full; returns false if the queue
+    // has been closed or cancelled
+    auto push(T item)
+        -> bool
+    {
+        auto lock = std::unique_lock{ mutex_ };
+        notFull_.wait(lock, [&]{
+            return closed_ || items_.size() < capacity_; });
+        if (closed_)
+            return false;
+        items_.push_back(std::move(item));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // Like push(), but returns false instead of blocking while the queue
+    // is full; item is moved from only if pushed
+    auto tryPush(T& item)
+        -> bool
+    {
+        auto lock = std::lock_guard{ mutex_ };
+        if (closed_ || items_.size() >= capacity_)
+            return false;
+        items_.push_back(std::move(item));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // Blocks while the queue is empty; returns nullopt once the queue
+    // is closed and drained, or cancelled
+    auto pop()
+        -> std::optional<T>
+    {
+        auto lock = std::unique_lock{ mutex_ };
+        notEmpty_.wait(lock, [&]{ return closed_ || !items_.empty(); });
+        if (cancelled_ || items_.empty())
+            return std::nullopt;
+        auto result = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return result;
+    }
+
+    auto close()
+        -> void
+    {
+        auto lock = std::lock_guard{ mutex_ };
+        closed_ = true;
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+
+    auto cancel()
+        -> void
+    {
+        auto lock = std::lock_guard{ mutex_ };
+        closed_ = cancelled_ = true;
+        items_.clear();
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::deque<T> items_;
+    bool closed_{ false };
+    bool cancelled_{ false };
+};
@@ -71,6 +71,24 @@ void ControlsDialog::setApproxMaxVertices(size_t maxVertices)
 void ControlsDialog::setAdjustScale(double adjustScale)
 { ui->spinAdjustScale->setValue(adjustScale); }
 
+void ControlsDialog::setVertexBudget(size_t vertexBudget)
+{ ui->spinVertexBudget->setValue(vertexBudget); }
+
+void ControlsDialog::setTimeBudget(size_t timeBudgetMs)
+{ ui->spinTimeBudget->setValue(timeBudgetMs); }
+
+void ControlsDialog::setAutoEngine(bool enabled)
+{ ui->checkAutoEngine->setChecked(enabled); }
+
+void ControlsDialog::setCoverageCulling(bool enabled)
+{ ui->checkCoverage->setChecked(enabled); }
+
+void ControlsDialog::setMirrorSymmetry(bool enabled)
+{ ui->checkSymmetry->setChecked(enabled); }
+
+void ControlsDialog::setBalancedRefinement(bool enabled)
+{ ui->checkBalanced->setChecked(enabled); }
+
 void ControlsDialog::emitPointCoordsEdited()
 {
     if (settingPointCoords_)
@@ -107,3 +125,21 @@ void ControlsDialog::on_spinApproxMaxVertices_valueChanged(int arg1)
 void ControlsDialog::on_spinAdjustScale_valueChanged(double arg1)
 { emit adjustScaleEdited(arg1); }
 
+void ControlsDialog::on_spinVertexBudget_valueChanged(int arg1)
+{ emit vertexBudgetEdited(arg1); }
+
+void ControlsDialog::on_spinTimeBudget_valueChanged(int arg1)
+{ emit timeBudgetEdited(arg1); }
+
+void ControlsDialog::on_checkAutoEngine_stateChanged(int arg1)
+{ emit autoEngineChanged(arg1 == Qt::Checked); }
+
+void ControlsDialog::on_checkCoverage_stateChanged(int arg1)
+{ emit coverageCullingChanged(arg1 == Qt::Checked); }
+
+void ControlsDialog::on_checkSymmetry_stateChanged(int arg1)
+{ emit mirrorSymmetryChanged(arg1 == Qt::Checked); }
+
+void ControlsDialog::on_checkBalanced_stateChanged(int arg1)
+{ emit balancedRefinementChanged(arg1 == Qt::Checked); }
+
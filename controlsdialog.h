@@ -26,6 +26,12 @@ signals:
     void approxMaxGenEdited(size_t maxGen);
     void approxMaxVerticesEdited(size_t maxVertices);
     void adjustScaleEdited(double adjustScale);
+    void vertexBudgetEdited(size_t vertexBudget);
+    void timeBudgetEdited(size_t timeBudgetMs);
+    void autoEngineChanged(bool enabled);
+    void coverageCullingChanged(bool enabled);
+    void mirrorSymmetryChanged(bool enabled);
+    void balancedRefinementChanged(bool enabled);
 
 public slots:
     void setPointCoords(double x, double y);
@@ -39,6 +45,12 @@ public slots:
     void setApproxMaxGen(size_t maxGen);
     void setApproxMaxVertices(size_t maxVertices);
     void setAdjustScale(double adjustScale);
+    void setVertexBudget(size_t vertexBudget);
+    void setTimeBudget(size_t timeBudgetMs);
+    void setAutoEngine(bool enabled);
+    void setCoverageCulling(bool enabled);
+    void setMirrorSymmetry(bool enabled);
+    void setBalancedRefinement(bool enabled);
 
 private slots:
     void on_generations_valueChanged(int arg1);
@@ -53,6 +65,12 @@ private slots:
     void on_spinApproxMaxGen_valueChanged(int arg1);
     void on_spinApproxMaxVertices_valueChanged(int arg1);
     void on_spinAdjustScale_valueChanged(double arg1);
+    void on_spinVertexBudget_valueChanged(int arg1);
+    void on_spinTimeBudget_valueChanged(int arg1);
+    void on_checkAutoEngine_stateChanged(int arg1);
+    void on_checkCoverage_stateChanged(int arg1);
+    void on_checkSymmetry_stateChanged(int arg1);
+    void on_checkBalanced_stateChanged(int arg1);
 
 private:
     void emitPointCoordsEdited();
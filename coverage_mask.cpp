@@ -0,0 +1,116 @@
+#include "coverage_mask.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+auto CoverageMask::reset(int width, int height)
+    -> void
+{
+    width_ = std::max(width, 0);
+    height_ = std::max(height, 0);
+    pixels_.assign(static_cast<size_t>(width_) * height_, 0);
+
+    auto levelCount = size_t{};
+    while ((std::max(width_, height_) - 1) >> levelCount > 0)
+        ++levelCount;
+    counts_.resize(levelCount);
+    for (size_t level=1; level<=levelCount; ++level)
+    {
+        auto w = ((width_ - 1) >> level) + 1;
+        auto h = ((height_ - 1) >> level) + 1;
+        counts_[level-1].assign(static_cast<size_t>(w) * h, 0);
+    }
+}
+
+auto CoverageMask::markSegment(const Vec2d& a, const Vec2d& b, double penWidth)
+    -> void
+{
+    if (width_ == 0 || height_ == 0)
+        return;
+
+    // Pixels closer to the segment than d are marked
+    auto d = std::max(0.5 * penWidth - 0.5, 0.);
+
+    // Clip the segment to the mask with margins (Liang-Barsky)
+    auto t0 = 0.;
+    auto t1 = 1.;
+    auto dr = b - a;
+    auto clip = [&](double p, double q)
+    {
+        if (p == 0)
+            return q >= 0;
+        auto t = q / p;
+        if (p < 0)
+            t0 = std::max(t0, t);
+        else
+            t1 = std::min(t1, t);
+        return t0 <= t1;
+    };
+    if (!(clip(-dr[0], a[0] + d) &&
+          clip(dr[0], width_ + d - a[0]) &&
+          clip(-dr[1], a[1] + d) &&
+          clip(dr[1], height_ + d - a[1])))
+        return;
+
+    // Half-pixel steps
+    auto length = (t1 - t0) * dr.norm();
+    auto steps = static_cast<int>(std::ceil(2 * length));
+    for (auto i=0; i<=steps; ++i)
+    {
+        auto p = a + dr * (t0 + (t1 - t0) * (steps? double(i) / steps: 0.));
+        auto x0 = std::max(static_cast<int>(std::floor(p[0] - d)), 0);
+        auto x1 = std::min(static_cast<int>(std::floor(p[0] + d)), width_-1);
+        auto y0 = std::max(static_cast<int>(std::floor(p[1] - d)), 0);
+        auto y1 = std::min(static_cast<int>(std::floor(p[1] + d)), height_-1);
+        for (auto y=y0; y<=y1; ++y)
+            for (auto x=x0; x<=x1; ++x)
+                markPixel(x, y);
+    }
+}
+
+auto CoverageMask::isCovered(double x0, double y0, double x1, double y1) const
+    -> bool
+{
+    auto ix0 = std::max(static_cast<int>(std::floor(x0)), 0);
+    auto iy0 = std::max(static_cast<int>(std::floor(y0)), 0);
+    auto ix1 = std::min(static_cast<int>(std::floor(x1)), width_ - 1);
+    auto iy1 = std::min(static_cast<int>(std::floor(y1)), height_ - 1);
+    if (!(x1 >= 0 && y1 >= 0) || ix0 > ix1 || iy0 > iy1)
+        return true;
+    return isCovered(counts_.size(), 0, 0, ix0, iy0, ix1, iy1);
+}
+
+auto CoverageMask::cellArea(size_t level, int cx, int cy) const noexcept
+    -> uint32_t
+{
+    auto w = std::min(width_, (cx + 1) << level) - (cx << level);
+    auto h = std::min(height_, (cy + 1) << level) - (cy << level);
+    return static_cast<uint32_t>(w) * h;
+}
+
+auto CoverageMask::isCovered(size_t level, int cx, int cy,
+                             int x0, int y0, int x1, int y1) const
+    -> bool
+{
+    auto cellX0 = cx << level;
+    auto cellY0 = cy << level;
+    if (cellX0 > x1 || cellY0 > y1 ||
+        ((cx + 1) << level) <= x0 || ((cy + 1) << level) <= y0 ||
+        cellX0 >= width_ || cellY0 >= height_)
+        return true;
+
+    if (level == 0)
+        return pixels_[static_cast<size_t>(cy) * width_ + cx] != 0;
+
+    auto count = counts_[level-1][cellIndex(level, cx, cy)];
+    if (count == cellArea(level, cx, cy))
+        return true;
+    if (count == 0)
+        return false;
+
+    for (auto j=0; j<2; ++j)
+        for (auto i=0; i<2; ++i)
+            if (!isCovered(level-1, 2*cx + i, 2*cy + j, x0, y0, x1, y1))
+                return false;
+    return true;
+}
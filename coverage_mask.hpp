@@ -0,0 +1,71 @@
+#pragma once
+
+#include "vec2.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Pixels painted so far, with the number of painted pixels kept for each
+// power-of-two block, so that large regions are checked at once
+class CoverageMask final
+{
+public:
+    // Clears the mask and sets its size, keeping the memory allocated
+    auto reset(int width, int height)
+        -> void;
+
+    auto width() const noexcept
+        -> int
+    { return width_; }
+
+    auto height() const noexcept
+        -> int
+    { return height_; }
+
+    auto markPixel(int x, int y)
+        -> void
+    {
+        auto& pixel = pixels_[static_cast<size_t>(y) * width_ + x];
+        if (pixel)
+            return;
+        pixel = 1;
+        for (size_t level=1, n=counts_.size(); level<=n; ++level)
+            ++counts_[level-1][cellIndex(level, x >> level, y >> level)];
+    }
+
+    // Marks pixels covered by a segment stroked with the given pen width
+    auto markSegment(const Vec2d& a, const Vec2d& b, double penWidth)
+        -> void;
+
+    // True if all pixels of the box, which is clipped to the mask,
+    // are marked
+    auto isCovered(double x0, double y0, double x1, double y1) const
+        -> bool;
+
+    auto markedPixelCount() const noexcept
+        -> size_t
+    { return counts_.empty()? 0: counts_.back().front(); }
+
+private:
+    auto cellIndex(size_t level, int cx, int cy) const noexcept
+        -> size_t
+    {
+        auto levelWidth = ((width_ - 1) >> level) + 1;
+        return static_cast<size_t>(cy) * levelWidth + cx;
+    }
+
+    auto cellArea(size_t level, int cx, int cy) const noexcept
+        -> uint32_t;
+
+    auto isCovered(size_t level, int cx, int cy,
+                   int x0, int y0, int x1, int y1) const
+        -> bool;
+
+    int width_{};
+    int height_{};
+    std::vector<uint8_t> pixels_;
+
+    // counts_[level-1] holds marked pixel counts of blocks of 2^level pixels
+    // squared; the last level has a single block
+    std::vector<std::vector<uint32_t>> counts_;
+};
@@ -4,37 +4,130 @@
 #include <span>
 #include <vector>
 
-template <typename Point>
-auto cubicSlopes(std::span<const Point> y)
-    -> std::vector<Point>
+// Solves for node slopes of cubic splines having natural end conditions:
+//      2 m[0]   +   m[1]               = 3 (y[1] - y[0])
+//        m[i-1] + 4 m[i] + m[i+1]      = 3 (y[i+1] - y[i-1])
+//                   m[n-2] + 2 m[n-1]  = 3 (y[n-1] - y[n-2])
+// The matrix only depends on the node count n, so it is factorized once,
+// and any number of curves is solved together. Curve data is row-major,
+// [node][curve], so that each elimination step runs over contiguous
+// memory of all curves.
+class CubicSlopeSolver final
 {
-    auto n = y.size();
-    assert(n > 1);
-    std::vector<double> b( n, 4. );
-    b.front() = b.back() = 2;
-    std::vector<Point> f(n);
-
-    f.front() = 3*(y[1] - y[0]);
-    for (size_t i=1; i+1<n; ++i)
-        f[i] = 3*(y[i+1] - y[i-1]);
-    f.back() = 3*(y[n-1] - y[n-2]);
-
-    for (size_t i=1; i<n; ++i)
+public:
+    explicit CubicSlopeSolver(size_t n) :
+        k_( n ),
+        b_( n, 4. )
     {
-        auto k = 1. / b[i-1];
-        b[i] -= k;
-        f[i] -= k*f[i-1];
+        assert(n > 1);
+        b_.front() = b_.back() = 2;
+        for (size_t i=1; i<n; ++i)
+        {
+            k_[i] = 1. / b_[i-1];
+            b_[i] -= k_[i];
+        }
     }
 
-    auto m = std::vector<Point>( n );
-    m.back() = f.back() / b.back();
+    auto size() const noexcept
+        -> size_t
+    { return b_.size(); }
 
-    for (size_t i=n-2; i!=~0ul; --i)
-        m[i] = (f[i] - m[i+1]) / b[i];
+    template <typename Point>
+    auto solve(std::span<const Point> y,
+               size_t curveCount,
+               std::span<Point> m) const
+        -> void
+    {
+        auto n = size();
+        auto nc = curveCount;
+        assert(y.size() == n * nc);
+        assert(m.size() == n * nc);
+        auto row = [&](auto& v, size_t i) { return v.data() + i*nc; };
+
+        // Right-hand sides, with forward elimination
+        {
+            auto y0 = row(y, 0);
+            auto y1 = row(y, 1);
+            auto f = row(m, 0);
+            for (size_t c=0; c<nc; ++c)
+                f[c] = 3*(y1[c] - y0[c]);
+        }
+        for (size_t i=1; i<n; ++i)
+        {
+            auto yPrev = row(y, i-1);
+            auto yNext = row(y, i+1<n? i+1: i);
+            auto fPrev = row(m, i-1);
+            auto f = row(m, i);
+            auto k = k_[i];
+            for (size_t c=0; c<nc; ++c)
+                f[c] = 3*(yNext[c] - yPrev[c]) - k*fPrev[c];
+        }
+
+        // Back substitution
+        {
+            auto f = row(m, n-1);
+            auto b = b_[n-1];
+            for (size_t c=0; c<nc; ++c)
+                f[c] = f[c] / b;
+        }
+        for (size_t i=n-2; i!=~0ul; --i)
+        {
+            auto mNext = row(m, i+1);
+            auto f = row(m, i);
+            auto b = b_[i];
+            for (size_t c=0; c<nc; ++c)
+                f[c] = (f[c] - mNext[c]) / b;
+        }
+    }
 
+private:
+    std::vector<double> k_;     // Elimination factors
+    std::vector<double> b_;     // Diagonal after elimination
+};
+
+template <typename Point>
+auto cubicSlopes(std::span<const Point> y)
+    -> std::vector<Point>
+{
+    auto m = std::vector<Point>( y.size() );
+    CubicSlopeSolver(y.size()).solve<Point>(y, 1, m);
     return m;
 }
 
+// Cubic Hermite basis functions at local parameter xi in [0, 1]
+struct HermiteBasis
+{
+    double f1;
+    double f2;
+    double f3;
+    double f4;
+};
+
+inline auto hermiteBasis(double xi)
+    -> HermiteBasis
+{
+    auto xi2 = xi * xi;
+    auto xi3 = xi2 * xi;
+    auto f1 = 1 - 3*xi2 + 2*xi3;
+    auto f2 = 1 - f1;
+    auto f3 = xi - 2*xi2 + xi3;
+    auto f4 = xi3 - xi2;
+    return { f1, f2, f3, f4 };
+}
+
+template <typename T>
+auto hermite(const HermiteBasis& fs,
+             const T& y0, const T& y1,
+             const T& m0, const T& m1)
+    -> T
+{ return fs.f1*y0 + fs.f2 * y1 + fs.f3*m0 + fs.f4*m1; }
+
+// Maps local parameter xi of a piece to the curve parameter, easing in and
+// out according to slope factors at the piece ends
+inline auto easedParam(double xi, double slopeF0, double slopeF1)
+    -> double
+{ return hermite(hermiteBasis(xi), 0., 1., slopeF0, slopeF1); }
+
 template <typename Point, typename SlopeF, typename Subdiv>
 auto cubicInterp(std::span<const Point> y,
                  std::span<const Point> m,
@@ -45,31 +138,6 @@ auto cubicInterp(std::span<const Point> y,
     size_t n = m.size();
     std::vector<Point> result;
 
-    struct Fs
-    {
-        double f1;
-        double f2;
-        double f3;
-        double f4;
-    };
-
-    auto fs = [](double xi) -> Fs
-    {
-        auto xi2 = xi * xi;
-        auto xi3 = xi2 * xi;
-        auto f1 = 1 - 3*xi2 + 2*xi3;
-        auto f2 = 1 - f1;
-        auto f3 = xi - 2*xi2 + xi3;
-        auto f4 = xi3 - xi2;
-        return { f1, f2, f3, f4 };
-    };
-
-    auto interp =
-        []<typename T>(const Fs& fs,
-                       const T& y0, const T& y1,
-                       const T& m0, const T& m1) -> T
-    { return fs.f1*y0 + fs.f2 * y1 + fs.f3*m0 + fs.f4*m1; };
-
     result.push_back(y[0]);
 
     auto sf0 = slopeF(0);
@@ -79,11 +147,10 @@ auto cubicInterp(std::span<const Point> y,
         auto subdivVal = subdiv(piece);
         for (size_t i=1; i<=subdivVal; ++i)
         {
-            auto fxi = fs(static_cast<double>(i) / subdivVal);
-            auto p = interp(fxi, 0., 1., sf0, sf1);
-            auto fp = fs(p);
+            auto p = easedParam(static_cast<double>(i) / subdivVal, sf0, sf1);
+            auto fp = hermiteBasis(p);
             result.push_back(
-                interp(fp, y[piece], y[piece+1], m[piece], m[piece+1]));
+                hermite(fp, y[piece], y[piece+1], m[piece], m[piece+1]));
         }
         sf0 = sf1;
     }
@@ -1,11 +1,11 @@
 #include "document.h"
 
+#include "generator_file.hpp"
+
 #include <QFileDialog>
 #include <QMessageBox>
-#include <QRegularExpression>
 
 #include <fstream>
-#include <sstream>
 
 Document::Document(QObject *parent)
     : QObject{ parent }
@@ -29,62 +29,19 @@ auto Document::fileName() const
 
 auto Document::open(const QString& fileName) -> void
 {
-    auto critical = [&](auto... args) -> void
+    try
+    {
+        auto fg = readGeneratorFile(fileName.toStdString());
+        fractalGenerator_.setFractalGenerator(fg);
+        fileName_ = fileName;
+    }
+    catch (const std::exception& e)
     {
-        auto s = std::ostringstream{};
-        ((s << args), ...);
-
         QMessageBox::critical(
             qobject_cast<QWidget*>(parent()),
             {},
-            QString::fromUtf8(s.str()));
-    };
-
-    auto s = std::ifstream{fileName.toStdString()};
-    if (!s.is_open())
-        return critical("Failed to open input file ", fileName.toStdString());
-
-    size_t lineNumber = 0;
-
-    auto parseFailure =
-        [&](const std::string& line) -> void
-    {
-        critical(
-            "Failed to parse input file\n",
-            fileName.toStdString(), ":", lineNumber, ": ", line);
-    };
-
-    FractalGenerator fg;
-    static const auto cellSep = QRegularExpression{"[ \t,]+"};
-    while (true)
-    {
-        ++lineNumber;
-        auto line = std::string{};
-        std::getline(s, line);
-        if (line.empty() || s.fail())
-            break;
-
-        auto cells = QString::fromStdString(line).split(cellSep);
-        if (cells.size() != 2)
-            return parseFailure(line);
-        auto ok_x = false;
-        auto x = cells[0].toDouble(&ok_x);
-        auto ok_y = false;
-        auto y = cells[1].toDouble(&ok_y);
-        if (!(ok_x && ok_y))
-        {
-            if (lineNumber == 1)
-                continue;
-            return parseFailure(line);
-        }
-        fg.emplace_back(x, y);
+            QString::fromUtf8(e.what()));
     }
-    if (fg.size() < 2)
-        return critical(
-            "Too few points in generator read from file ",
-            fileName.toStdString());
-    fractalGenerator_.setFractalGenerator(fg);
-    fileName_ = fileName;
 }
 
 auto Document::saveAs(const QString& fileName) -> void
@@ -0,0 +1,166 @@
+#include "fractal_cost.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <vector>
+
+namespace {
+
+// Log2 of generator segment lengths relative to the generator span;
+// zero-length segments are skipped as they never get subdivided
+auto logRatios(std::span<const Vec2d> gen)
+    -> std::vector<double>
+{
+    auto result = std::vector<double>{};
+    auto span = (gen.back() - gen.front()).norm();
+    for (size_t i=1, n=gen.size(); i<n; ++i)
+    {
+        auto len = (gen[i] - gen[i-1]).norm();
+        if (len > 0)
+            result.push_back(std::log2(len / span));
+    }
+    return result;
+}
+
+// Segments of similar lengths, merged to keep the estimation cheap
+struct SegmentBin
+{
+    double count{};
+    double logLenSum{};    // Sum of log2(length) * count
+};
+
+constexpr auto binsPerOctave = 16.;
+
+} // anonymous namespace
+
+auto similarityDimension(std::span<const Vec2d> gen)
+    -> double
+{
+    auto logR = logRatios(gen);
+    if (logR.empty() ||
+        std::any_of(logR.begin(), logR.end(),
+                    [](double x) { return !(x < 0); }))
+        return std::numeric_limits<double>::infinity();
+
+    auto f = [&](double d)
+    {
+        auto result = 0.;
+        for (auto x: logR)
+            result += std::exp2(d * x);
+        return result;
+    };
+
+    // f decreases with d
+    auto d0 = 0.;
+    auto d1 = maxSimilarityDimension;
+    if (f(d0) <= 1)
+        return d0;
+    if (f(d1) >= 1)
+        return d1;
+    for (auto iter=0; iter<50; ++iter)
+    {
+        auto d = 0.5 * (d0 + d1);
+        (f(d) > 1? d0: d1) = d;
+    }
+    return 0.5 * (d0 + d1);
+}
+
+auto exactVertexCount(std::span<const Vec2d> base,
+                      std::span<const Vec2d> gen,
+                      size_t generation)
+    -> double
+{
+    return (base.size() - 1) * std::pow(gen.size() - 1., generation) + 1;
+}
+
+auto estimateApproxVertexCount(std::span<const Vec2d> base,
+                               std::span<const Vec2d> gen,
+                               double minLength,
+                               size_t maxGen)
+    -> double
+{
+    auto logR = logRatios(gen);
+    auto zeroSegmentCount = static_cast<double>(gen.size() - 1 - logR.size());
+    auto logMinLength = std::log2(minLength);
+
+    // FractalApprox subdivides segments longer than minLength;
+    // the base counts as the first generation
+    auto leaves = 0.;
+    auto bins = std::map<long, SegmentBin>{};
+    auto add = [&](double logLen, double count)
+    {
+        if (!(logLen > logMinLength))
+        {
+            leaves += count;
+            return;
+        }
+        auto& bin = bins[std::lround(logLen * binsPerOctave)];
+        bin.count += count;
+        bin.logLenSum += logLen * count;
+    };
+
+    // Like FractalApprox, only the first base segment counts
+    if (base.size() > 1)
+        add(std::log2((base[1] - base[0]).norm()), 1);
+
+    auto nextBins = std::map<long, SegmentBin>{};
+    for (size_t generation=1; generation<maxGen && !bins.empty(); ++generation)
+    {
+        std::swap(bins, nextBins);
+        bins.clear();
+        for (const auto& [key, bin]: nextBins)
+        {
+            auto logLen = bin.logLenSum / bin.count;
+            for (auto x: logR)
+                add(logLen + x, bin.count);
+            leaves += zeroSegmentCount * bin.count;
+        }
+    }
+    for (const auto& [key, bin]: bins)
+        leaves += bin.count;
+
+    return leaves + 1;
+}
+
+auto approxLodForBudget(std::span<const Vec2d> base,
+                       std::span<const Vec2d> gen,
+                       const ApproxLod& finest,
+                       double vertexBudget)
+    -> ApproxLod
+{
+    auto maxGen = finest.maxGen;
+    auto estimate = [&](double minLength)
+    { return estimateApproxVertexCount(base, gen, minLength, maxGen); };
+
+    auto t0 = finest.minLength;
+    auto n0 = estimate(t0);
+    if (n0 <= vertexBudget)
+        return finest;
+
+    // Vertex count is about proportional to minLength^-D; refine the
+    // exponent with secant steps in log-log coordinates
+    auto d = std::clamp(similarityDimension(gen), 1., maxSimilarityDimension);
+    auto t1 = t0 * std::pow(n0 / vertexBudget, 1 / d);
+    for (auto iter=0; iter<4; ++iter)
+    {
+        auto n1 = estimate(t1);
+        if (n1 <= vertexBudget && n1 > 0.9 * vertexBudget)
+            return { t1, maxGen };
+        auto slope = std::log(n0 / n1) / std::log(t1 / t0);
+        if (!(slope > 0.1))
+            break;   // Count hardly depends on minLength, maxGen limits it
+        t0 = t1;
+        n0 = n1;
+        t1 = t0 * std::pow(n0 / vertexBudget, 1 / slope);
+    }
+
+    // Make sure the budget is met; generators having segments that do not
+    // shrink need fewer generations rather than a larger tolerance
+    for (auto iter=0; iter<8 && estimate(t1) > vertexBudget; ++iter)
+        t1 *= 1.25;
+    while (maxGen > 1 && estimate(t1) > vertexBudget)
+        --maxGen;
+    return { t1, maxGen };
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "vec2.hpp"
+
+#include <span>
+
+// Rendering cost of fractal curves, estimated from the generator's
+// growth rate without generating vertices.
+
+// Similarity dimension D of the curve, such that sum r_i^D = 1, where r_i
+// are generator segment lengths relative to the generator span. Returns
+// infinity if the generator has no shrinking segments, and is clamped to
+// [0, maxSimilarityDimension] otherwise.
+constexpr inline auto maxSimilarityDimension = 8.;
+
+auto similarityDimension(std::span<const Vec2d> gen)
+    -> double;
+
+// Number of vertices produced by FractalNGen for the given generation
+auto exactVertexCount(std::span<const Vec2d> base,
+                      std::span<const Vec2d> gen,
+                      size_t generation)
+    -> double;
+
+// Estimated number of vertices produced by FractalApprox with
+// the given minLength and maxGen, which traverses the first base
+// segment only
+auto estimateApproxVertexCount(std::span<const Vec2d> base,
+                               std::span<const Vec2d> gen,
+                               double minLength,
+                               size_t maxGen)
+    -> double;
+
+// Level of detail parameters of FractalApprox
+struct ApproxLod
+{
+    double minLength;
+    size_t maxGen;
+};
+
+// Finest level of detail, not finer than `finest`, for which FractalApprox
+// is estimated to produce at most vertexBudget vertices
+auto approxLodForBudget(std::span<const Vec2d> base,
+                        std::span<const Vec2d> gen,
+                        const ApproxLod& finest,
+                        double vertexBudget)
+    -> ApproxLod;
@@ -1,14 +1,26 @@
 #pragma once
 
+#include "arena.hpp"
+#include "bbox2.hpp"
+#include "fractal_cost.hpp"
 #include "vec2.hpp"
 #include "vec2_qt.hpp"
 
 #include <QTransform> // TODO: Replace with a custom matrix type
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <functional>
 #include <iterator>
+#include <limits>
+#include <memory>
 // #include <ranges>
 #include <span>
+#include <stop_token>
 #include <vector>
 
 namespace detail {
@@ -31,9 +43,172 @@ inline auto generatorTransform(const Vec2d& b0,
     return QTransform{ fc, -fs, fs, fc, dx, dy };
 }
 
+// Reflection about the perpendicular bisector of segment (a, b)
+struct BisectorReflection final
+{
+    BisectorReflection() = default;
+
+    BisectorReflection(const Vec2d& a, const Vec2d& b) :
+        center{ 0.5 * (a + b) },
+        axis{ (b - a).unit() }
+    {}
+
+    auto operator()(const Vec2d& v) const noexcept
+        -> Vec2d
+    { return v - 2 * ((v - center) * axis) * axis; }
+
+    Vec2d center;
+    Vec2d axis;
+};
+
+// Where the current vertex of a fractal iterator is relative to the
+// midpoint of a mirror-symmetric curve
+enum class CurveMidpoint
+{
+    None,       // Before the midpoint
+    Vertex,     // At the midpoint
+    Segment,    // At the start of the segment crossing the midpoint
+    End         // At the end of the curve
+};
+
+// Levels are the generation states, starting with the base; each level
+// is at its vertex pointed to by `begin`. Only the first baseSegmentCount
+// base segments are traversed.
+template <typename State>
+auto curveMidpoint(std::span<const State> levels,
+                   std::span<const Vec2d> base,
+                   size_t baseSegmentCount,
+                   std::span<const Vec2d> generator)
+    -> CurveMidpoint
+{
+    auto index = [&](size_t level)
+    {
+        return static_cast<size_t>(
+            levels[level].begin - (level == 0? base: generator).data());
+    };
+
+    // For an even segment count, the midpoint is a vertex; otherwise
+    // it is in the middle segment, recursively
+    for (size_t level=0, n=levels.size(); level<n; ++level)
+    {
+        auto segmentCount =
+            level == 0? baseSegmentCount: generator.size() - 1;
+        if (segmentCount % 2 == 0)
+        {
+            if (index(level) != segmentCount / 2)
+                return CurveMidpoint::None;
+            for (++level; level<n; ++level)
+                if (index(level) != 0)
+                    return CurveMidpoint::None;
+            return CurveMidpoint::Vertex;
+        }
+        if (index(level) != segmentCount / 2)
+            return CurveMidpoint::None;
+    }
+    return CurveMidpoint::Segment;
+}
+
 } // namespace detail
 
 
+// True if the polyline is mirror-symmetric about the perpendicular bisector
+// of its endpoints, up to the tolerance relative to the chord length.
+// If the generator is, so is the curve built on any segment, and if the
+// base is too, so is the whole curve (see FractalHalf).
+inline auto isMirrorSymmetric(std::span<const Vec2d> polyline,
+                              double tolerance = 1e-6)
+    -> bool
+{
+    if (polyline.size() < 2)
+        return false;
+    auto chordLength = (polyline.back() - polyline.front()).norm();
+    if (!(chordLength > 0))
+        return false;
+
+    auto reflect = detail::BisectorReflection{
+        polyline.front(), polyline.back() };
+    for (size_t i=0, n=polyline.size(); i<n; ++i)
+        if ((reflect(polyline[i]) - polyline[n-1-i]).norm() >
+            tolerance * chordLength)
+            return false;
+    return true;
+}
+
+
+// Radius, relative to the chord length, of a disc centered at the chord
+// midpoint that contains the curve built on the chord with the generator,
+// and each of its approximating polylines. Infinity if some generator
+// segment is not shorter than the chord.
+inline auto attractorBoundRadius(std::span<const Vec2d> generator)
+    -> double
+{
+    auto chordLength = (generator.back() - generator.front()).norm();
+    auto center = 0.5 * (generator.front() + generator.back());
+
+    // The disc of radius R contains the discs of all segments
+    // if |c_i - c| + r_i R <= R for each segment i
+    auto result = 0.5;
+    for (size_t i=1, n=generator.size(); i<n; ++i)
+    {
+        auto r = (generator[i] - generator[i-1]).norm() / chordLength;
+        if (!(r < 1))
+            return std::numeric_limits<double>::infinity();
+        auto d = (0.5 * (generator[i] + generator[i-1]) - center).norm() /
+                 chordLength;
+        result = std::max(result, d / (1 - r));
+    }
+    return result;
+}
+
+// Box containing the curve built on base with the generator, and each of
+// its approximating polylines; the box of base if no such bound is known
+inline auto curveBounds(std::span<const Vec2d> base,
+                        std::span<const Vec2d> generator)
+    -> Bbox2d
+{
+    auto result = Bbox2d{};
+    for (const auto& v: base)
+        result << v;
+    auto radius = attractorBoundRadius(generator);
+    if (!std::isfinite(radius))
+        return result;
+    for (size_t i=1, n=base.size(); i<n; ++i)
+    {
+        auto center = 0.5 * (base[i-1] + base[i]);
+        auto r = radius * (base[i] - base[i-1]).norm();
+        result << center - Vec2d{ r, r } << center + Vec2d{ r, r };
+    }
+    return result;
+}
+
+
+// Fractal iterators given a stop token check it once per this many
+// vertices, which costs next to nothing; a power of two
+constexpr inline size_t stopCheckInterval = 4096;
+
+// Counters collected by fractal iterators while they run
+struct FractalIterStats final
+{
+    // Number of vertices emitted at each generation (index = generation)
+    std::vector<size_t> genVertexCount;
+
+    // Pushes and pops of the approximate engines' pending work: generation
+    // states of FractalApprox, segments queued for refinement and refined
+    // by FractalBalanced
+    size_t pushCount{};
+    size_t popCount{};
+
+    // Bytes held by the iterator's internal state
+    size_t stateBytes{};
+
+    // True if FractalApprox stopped at maxOrdinal with unvisited subtrees
+    bool truncated{};
+
+    // True if the iterator stopped early at a stop request
+    bool cancelled{};
+};
+
+
 template <typename Impl>
 class FractalIterator final
 {
@@ -87,13 +262,19 @@ class FractalNGen final
 {
 public:
 
+    // On a stop request, jumps to the end of the current base segment
+    // and ends there
     FractalNGen(std::span<const Vec2d> base,
                 std::span<const Vec2d> generator,
-                size_t generation):
+                size_t generation,
+                MonotonicArena* arena = nullptr,
+                std::stop_token stop = {}):
         base_{ base },
         generator_{ generator },
         generation_{ generation },
-        value_{ base.front() }
+        stop_{ std::move(stop) },
+        value_{ base.front() },
+        state_{ ArenaAllocator<GenerationState>{ arena } }
     {
         assert(base_.size() > 1);
         assert(generator_.size() > 1);
@@ -124,6 +305,15 @@ public:
             return;
         }
 
+        if ((ordinal_ & (stopCheckInterval - 1)) == 0 &&
+            stop_.stop_requested())
+        {
+            cancelled_ = true;
+            value_ = state_.front().v1;
+            isLast_ = true;
+            return;
+        }
+
         auto gen = generation_;
         for (; gen!=~0ul; --gen)
         {
@@ -159,6 +349,34 @@ public:
         -> size_t
     { return generation_; }
 
+    auto stats() const
+        -> FractalIterStats
+    {
+        auto result = FractalIterStats{
+            .genVertexCount = std::vector<size_t>(generation_ + 1, 0),
+            .stateBytes = state_.capacity() * sizeof(GenerationState),
+            .cancelled = cancelled_
+        };
+        result.genVertexCount.back() = ordinal_ + (is_end_? 0: 1);
+        return result;
+    }
+
+    // --- Used by FractalHalf
+
+    // Endpoints of the curve
+    auto chord() const noexcept
+        -> std::array<Vec2d, 2>
+    { return { base_.front(), base_.back() }; }
+
+    auto midpoint() const
+        -> detail::CurveMidpoint
+    {
+        if (isLast_)
+            return detail::CurveMidpoint::End;
+        return detail::curveMidpoint(
+            std::span{ state_ }, base_, base_.size() - 1, generator_);
+    }
+
 private:
     struct GenerationState final
     {
@@ -213,13 +431,15 @@ private:
     std::span<const Vec2d> base_;
     std::span<const Vec2d> generator_;
     size_t generation_{};
+    std::stop_token stop_;
     size_t ordinal_{};
     bool isLast_{ false };
     bool is_end_{ false };
+    bool cancelled_{ false };
 
     Vec2d value_;
 
-    std::vector<GenerationState> state_;
+    ArenaVector<GenerationState> state_;
 };
 
 struct FractalApproxParam final
@@ -227,6 +447,22 @@ struct FractalApproxParam final
     size_t maxGen{ 30 };
     size_t maxOrdinal{ 10'000'000 };
     double minLength{ 1 };
+
+    // Scratch memory for the iterator state; null to use the heap
+    MonotonicArena* arena{};
+
+    // If not empty, segments whose attractor bound disc misses the box
+    // are not subdivided, as they are not visible
+    Bbox2d cullBox;
+
+    // If set, segments whose attractor bound disc (center, radius) it
+    // reports as covered, e.g., by what has been drawn already,
+    // are not subdivided
+    std::function<bool(const Vec2d&, double)> isCovered;
+
+    // On a stop request, the iterator jumps to the end of the curve and
+    // ends there, as at maxOrdinal
+    std::stop_token stop;
 };
 
 class FractalApprox final
@@ -238,18 +474,26 @@ public:
                 const FractalApproxParam& param):
         base_{ base },
         generator_{ generator },
-        baseLen_( lengths(base) ),
-        genLen_( lengths(generator) ),
+        baseLen_( lengths(base, param.arena) ),
+        genLen_( lengths(generator, param.arena) ),
         genDist_{ (generator.back() - generator.front()).norm() },
+        boundRadius_{
+            param.cullBox.empty && !param.isCovered
+                ? std::numeric_limits<double>::infinity()
+                : attractorBoundRadius(generator) },
         param_{ param },
-        value_{ base.front() }
+        value_{ base.front() },
+        state_{ ArenaAllocator<GenerationState>{ param.arena } },
+        genVertexCount_{ ArenaAllocator<size_t>{ param.arena } }
     {
         assert(base_.size() > 1);
         assert(generator_.size() > 1);
         state_.reserve(param_.maxGen + 1);
+        genVertexCount_.resize(std::max<size_t>(param_.maxGen, 1), 0);
 
         state_.push_back(baseState());
         maybeRecurse();
+        ++genVertexCount_[state_.size() - 1];
     }
 
     FractalApprox(detail::EndIterTag):
@@ -272,23 +516,35 @@ public:
             return;
         }
 
-        if (ordinal_ < param_.maxOrdinal)
+        if ((ordinal_ & (stopCheckInterval - 1)) == 0 &&
+            param_.stop.stop_requested())
+            cancelled_ = true;
+        else if (ordinal_ < param_.maxOrdinal)
+        {
             while (state_.size() > 1)
             {
                 auto& st = state_.back();
                 if (st.isLast())
                 {
                     state_.pop_back();
+                    ++popCount_;
                     continue;
                 }
 
                 st.next();
                 maybeRecurse();
                 value_ = state_.back().v0;
+                ++genVertexCount_[state_.size() - 1];
                 return;
             }
+        }
+        else
+            truncated_ = std::any_of(
+                state_.begin() + 1, state_.end(),
+                [](const GenerationState& st) { return !st.isLast(); });
 
         value_ = state_.front().v1;
+        ++genVertexCount_.front();
         isLast_ = true;
     }
 
@@ -309,6 +565,43 @@ public:
         -> size_t
     { return actualMaxGen_; }
 
+    auto stats() const
+        -> FractalIterStats
+    {
+        auto genVertexCount = std::vector<size_t>(
+            genVertexCount_.begin(), genVertexCount_.end());
+        while (genVertexCount.size() > 1 && genVertexCount.back() == 0)
+            genVertexCount.pop_back();
+
+        return {
+            .genVertexCount = std::move(genVertexCount),
+            .pushCount = pushCount_,
+            .popCount = popCount_,
+            .stateBytes =
+                state_.capacity() * sizeof(GenerationState) +
+                (baseLen_.capacity() + genLen_.capacity()) * sizeof(double) +
+                genVertexCount_.capacity() * sizeof(size_t),
+            .truncated = truncated_,
+            .cancelled = cancelled_
+        };
+    }
+
+    // --- Used by FractalHalf
+
+    // Endpoints of the curve: only the first base segment is traversed
+    auto chord() const noexcept
+        -> std::array<Vec2d, 2>
+    { return { base_[0], base_[1] }; }
+
+    auto midpoint() const
+        -> detail::CurveMidpoint
+    {
+        if (isLast_)
+            return detail::CurveMidpoint::End;
+        return detail::curveMidpoint(
+            std::span{ state_ }, base_, 1, generator_);
+    }
+
 private:
     struct GenerationState final
     {
@@ -343,12 +636,35 @@ private:
         -> void
     {
         while (state_.size() < param_.maxGen &&
-               state_.back().length() > param_.minLength)
+               state_.back().length() > param_.minLength &&
+               needsRefinement(state_.back()))
+        {
             state_.push_back(recurseState(state_.back()));
+            ++pushCount_;
+        }
         actualMaxGen_ = std::max(actualMaxGen_, state_.size());
     }
 
 
+    auto needsRefinement(const GenerationState& state) const
+        -> bool
+    {
+        if (!std::isfinite(boundRadius_))
+            return true;
+
+        auto c = 0.5 * (state.v0 + state.v1);
+        auto r = boundRadius_ * (state.v1 - state.v0).norm();
+        if (!param_.cullBox.empty)
+        {
+            const auto& box = param_.cullBox;
+            auto dx = std::max({ box.min[0] - c[0], 0., c[0] - box.max[0] });
+            auto dy = std::max({ box.min[1] - c[1], 0., c[1] - box.max[1] });
+            if (dx*dx + dy*dy > r*r)
+                return false;
+        }
+        return !(param_.isCovered && param_.isCovered(c, r));
+    }
+
     auto baseState() const
         -> GenerationState
     {
@@ -379,10 +695,10 @@ private:
         };
     }
 
-    static auto lengths(std::span<const Vec2d> v)
-        -> std::vector<double>
+    static auto lengths(std::span<const Vec2d> v, MonotonicArena* arena)
+        -> ArenaVector<double>
     {
-        auto result = std::vector<double>{};
+        auto result = ArenaVector<double>{ ArenaAllocator<double>{ arena } };
         assert(!v.empty());
         result.reserve(v.size() - 1);
         for (size_t i=1, n=v.size(); i<n; ++i)
@@ -392,9 +708,10 @@ private:
 
     std::span<const Vec2d> base_;
     std::span<const Vec2d> generator_;
-    std::vector<double> baseLen_;
-    std::vector<double> genLen_;
+    ArenaVector<double> baseLen_;
+    ArenaVector<double> genLen_;
     double genDist_;
+    double boundRadius_;
     FractalApproxParam param_{};
     size_t ordinal_{};
     bool isLast_{ false };
@@ -402,8 +719,438 @@ private:
 
     Vec2d value_;
 
-    std::vector<GenerationState> state_;
+    ArenaVector<GenerationState> state_;
     size_t actualMaxGen_{};
+
+    ArenaVector<size_t> genVertexCount_;
+    size_t pushCount_{};
+    size_t popCount_{};
+    bool truncated_{ false };
+    bool cancelled_{ false };
+};
+
+// Spreads up to maxOrdinal vertices over the whole curve, rather than
+// drawing the first part of it at full detail as FractalApprox does when
+// it reaches maxOrdinal: segments are refined longest first, through
+// a priority queue, so that the vertex count limits the detail uniformly.
+// Below maxOrdinal, the vertices are those of FractalApprox.
+//
+// The refinement tree is built in the constructor, taking about 50 bytes
+// per vertex on the heap; copies of the iterator share it. Like
+// FractalApprox, only the first base segment is traversed. isCovered is
+// ignored, as segments are not refined in curve order; arena is unused.
+class FractalBalanced final
+{
+public:
+
+    FractalBalanced(std::span<const Vec2d> base,
+                    std::span<const Vec2d> generator,
+                    const FractalApproxParam& param):
+        generator_{ generator },
+        boundRadius_{
+            param.cullBox.empty
+                ? std::numeric_limits<double>::infinity()
+                : attractorBoundRadius(generator) },
+        param_{ param }
+    {
+        assert(base.size() > 1);
+        assert(generator_.size() > 1);
+        refine(base[0], base[1]);
+        path_.push_back(0);
+        descend();
+    }
+
+    FractalBalanced(detail::EndIterTag):
+        is_end_{ true }
+    {}
+
+    auto deref() const noexcept
+        -> const Vec2d&
+    { return value_; }
+
+    auto inc() noexcept
+        -> void
+    {
+        assert(!is_end_);
+        ++ordinal_;
+
+        if (isLast_)
+        {
+            is_end_ = true;
+            return;
+        }
+
+        const auto& nodes = tree_->nodes;
+        if ((ordinal_ & (stopCheckInterval - 1)) == 0 &&
+            param_.stop.stop_requested())
+        {
+            cancelled_ = true;
+            value_ = nodes.front().v1;
+            isLast_ = true;
+            return;
+        }
+
+        // Next sibling of the innermost node having one
+        auto childCount = generator_.size() - 1;
+        while (path_.size() > 1)
+        {
+            auto node = path_.back();
+            auto parent = path_[path_.size() - 2];
+            if (node + 1 < nodes[parent].firstChild + childCount)
+            {
+                path_.back() = node + 1;
+                descend();
+                return;
+            }
+            path_.pop_back();
+        }
+
+        value_ = nodes.front().v1;
+        isLast_ = true;
+    }
+
+    auto equal(const FractalBalanced& that) const noexcept
+        -> bool
+    {
+        if (is_end_ != that.is_end_)
+            return false;
+        if (is_end_)
+            return true;
+
+        return ordinal_ == that.ordinal_;
+    }
+
+    // ---
+
+    auto actualMaxGen() const noexcept
+        -> size_t
+    { return tree_->genVertexCount.size(); }
+
+    auto stats() const
+        -> FractalIterStats
+    {
+        return {
+            .genVertexCount = tree_->genVertexCount,
+            .pushCount = tree_->pushCount,
+            .popCount = tree_->popCount,
+            .stateBytes = tree_->peakBytes,
+            .truncated = tree_->truncated,
+            .cancelled = tree_->cancelled || cancelled_
+        };
+    }
+
+private:
+    // Segment of the curve, refined if firstChild is nonzero;
+    // children are consecutive
+    struct Node final
+    {
+        Vec2d v0;
+        Vec2d v1;
+        uint32_t firstChild;
+        uint32_t gen;
+    };
+
+    struct Tree final
+    {
+        std::vector<Node> nodes;    // The base segment first
+        std::vector<size_t> genVertexCount;
+        size_t pushCount{};     // Segments queued for refinement
+        size_t popCount{};      // Segments refined
+        size_t peakBytes{};
+        bool truncated{};
+        bool cancelled{};
+    };
+
+    // Priority of refining a segment: 8 per octave of its length,
+    // from the sign-less bits of the length, which order like lengths
+    static auto lengthClass(double length) noexcept
+        -> uint32_t
+    { return static_cast<uint32_t>(std::bit_cast<uint64_t>(length) >> 49); }
+
+    auto needsRefinement(const Node& node, double length) const
+        -> bool
+    {
+        if (node.gen + 1 >= param_.maxGen)
+            return false;
+        if (!(length > param_.minLength))
+            return false;
+        if (param_.cullBox.empty || !std::isfinite(boundRadius_))
+            return true;
+
+        const auto& box = param_.cullBox;
+        auto c = 0.5 * (node.v0 + node.v1);
+        auto r = boundRadius_ * length;
+        auto dx = std::max({ box.min[0] - c[0], 0., c[0] - box.max[0] });
+        auto dy = std::max({ box.min[1] - c[1], 0., c[1] - box.max[1] });
+        return dx*dx + dy*dy <= r*r;
+    }
+
+    // Refines segments longest first, a length class at a time; the
+    // segments of the class where maxOrdinal is reached are picked evenly
+    // along the curve, so that no part of it gets more detail
+    auto refine(const Vec2d& v0, const Vec2d& v1)
+        -> void
+    {
+        auto tree = std::make_shared<Tree>();
+        auto& nodes = tree->nodes;
+        auto childCount = generator_.size() - 1;
+
+        // Growing the nodes doubles the time to refine
+        auto segment = std::array{ v0, v1 };
+        auto expectedVertexCount = std::fmin(
+            estimateApproxVertexCount(
+                segment, generator_, param_.minLength, param_.maxGen),
+            static_cast<double>(param_.maxOrdinal));
+        nodes.reserve(
+            static_cast<size_t>(expectedVertexCount)
+                / std::max<size_t>(childCount - 1, 1) * childCount + 1);
+
+        // Segments to refine by length class, from the root's class down;
+        // longer segments are in the first bucket
+        auto rootClass = lengthClass((v1 - v0).norm());
+        auto buckets = std::vector<std::vector<uint32_t>>{};
+        auto cursor = size_t{};
+        auto push = [&](uint32_t index)
+        {
+            const auto& node = nodes[index];
+            auto length = (node.v1 - node.v0).norm();
+            if (!needsRefinement(node, length))
+                return;
+            auto c = lengthClass(length);
+            auto bucket = size_t{ c < rootClass? rootClass - c: 0 };
+            if (bucket >= buckets.size())
+                buckets.resize(bucket + 1);
+            buckets[bucket].push_back(index);
+            cursor = std::min(cursor, bucket);
+            ++tree->pushCount;
+        };
+
+        nodes.push_back({ v0, v1, 0, 0 });
+        push(0);
+
+        // Each refinement replaces a segment with childCount ones
+        auto maxNodeCount = size_t{ std::numeric_limits<uint32_t>::max() };
+        auto vertexCount = size_t{ 2 };
+        auto refineNode = [&](uint32_t index)
+        {
+            auto node = nodes[index];
+            auto t = detail::generatorTransform(
+                node.v0, node.v1, generator_.front(), generator_.back());
+            auto firstChild = static_cast<uint32_t>(nodes.size());
+            nodes[index].firstChild = firstChild;
+            auto c0 = node.v0;
+            for (size_t i=1; i<=childCount; ++i)
+            {
+                auto c1 = i == childCount
+                    ? node.v1
+                    : toVec2d(t.map(toQPointF(generator_[i])));
+                nodes.push_back({ c0, c1, 0, node.gen + 1 });
+                c0 = c1;
+            }
+            for (size_t i=0; i<childCount; ++i)
+                push(firstChild + static_cast<uint32_t>(i));
+            vertexCount += childCount - 1;
+            ++tree->popCount;
+        };
+
+        auto batch = std::vector<uint32_t>{};
+        auto peakQueueBytes = size_t{};
+        while (cursor < buckets.size() && !tree->truncated)
+        {
+            if (buckets[cursor].empty())
+            {
+                ++cursor;
+                continue;
+            }
+
+            // Children of the batch may land in the bucket again
+            batch.swap(buckets[cursor]);
+            buckets[cursor].clear();
+            peakQueueBytes = std::max(
+                peakQueueBytes, batch.capacity() * sizeof(uint32_t));
+
+            auto affordable = std::min(
+                (param_.maxOrdinal - std::min(vertexCount, param_.maxOrdinal))
+                    / std::max<size_t>(childCount - 1, 1),
+                (maxNodeCount - nodes.size()) / childCount);
+            auto count = batch.size();
+            if (affordable < count)
+            {
+                tree->truncated = true;
+                count = affordable;
+            }
+            for (size_t i=0; i<count; ++i)
+            {
+                if ((tree->popCount & (stopCheckInterval - 1)) == 0 &&
+                    param_.stop.stop_requested())
+                {
+                    tree->cancelled = true;
+                    cursor = buckets.size();
+                    break;
+                }
+                refineNode(batch[i * batch.size() / count]);
+            }
+        }
+
+        tree->peakBytes =
+            nodes.capacity() * sizeof(Node) +
+            buckets.capacity() * sizeof(std::vector<uint32_t>) +
+            peakQueueBytes;
+
+        // Leaves start the vertices; the last vertex ends the base segment
+        auto& genVertexCount = tree->genVertexCount;
+        genVertexCount.resize(1, 1);
+        for (const auto& node: nodes)
+            if (node.firstChild == 0)
+            {
+                if (genVertexCount.size() <= node.gen)
+                    genVertexCount.resize(node.gen + 1, 0);
+                ++genVertexCount[node.gen];
+            }
+
+        tree_ = std::move(tree);
+    }
+
+    // Goes down to the first leaf of the node at the end of path_
+    auto descend()
+        -> void
+    {
+        const auto& nodes = tree_->nodes;
+        while (nodes[path_.back()].firstChild != 0)
+            path_.push_back(nodes[path_.back()].firstChild);
+        value_ = nodes[path_.back()].v0;
+    }
+
+    std::span<const Vec2d> generator_;
+    double boundRadius_{};
+    FractalApproxParam param_{};
+    std::shared_ptr<const Tree> tree_;
+
+    // Node indices from the base segment down to the current leaf
+    std::vector<uint32_t> path_;
+
+    size_t ordinal_{};
+    bool isLast_{ false };
+    bool is_end_{ false };
+    bool cancelled_{ false };
+
+    Vec2d value_;
+};
+
+// Traverses the first half of a mirror-symmetric curve (see
+// isMirrorSymmetric()) with the engine Impl, up to the midpoint, then one
+// more vertex, the reflection of the one before it, so that strokes
+// joining at the midpoint are complete. The other half is the reflection
+// of this one about the perpendicular bisector of the curve chord.
+template <typename Impl>
+class FractalHalf final
+{
+public:
+    template <typename... Args>
+    explicit FractalHalf(Args&&... args):
+        engine_{ std::forward<Args>(args)... }
+    {
+        auto chord = engine_.chord();
+        reflect_ = detail::BisectorReflection{ chord[0], chord[1] };
+        value_ = engine_.deref();
+        checkMidpoint();
+    }
+
+    FractalHalf(detail::EndIterTag tag):
+        engine_{ tag },
+        is_end_{ true }
+    {}
+
+    auto deref() const noexcept
+        -> const Vec2d&
+    { return value_; }
+
+    auto inc()
+        -> void
+    {
+        assert(!is_end_);
+        ++ordinal_;
+
+        switch (phase_)
+        {
+        case Phase::Half:
+            previous_ = value_;
+            engine_.inc();
+            value_ = engine_.deref();
+            checkMidpoint();
+            return;
+        case Phase::Closing:
+            value_ = closing_;
+            phase_ = Phase::Done;
+            return;
+        case Phase::Done:
+            is_end_ = true;
+            return;
+        }
+    }
+
+    auto equal(const FractalHalf& that) const noexcept
+        -> bool
+    {
+        if (is_end_ != that.is_end_)
+            return false;
+        if (is_end_)
+            return true;
+
+        return ordinal_ == that.ordinal_;
+    }
+
+    // ---
+
+    auto actualMaxGen() const noexcept
+        -> size_t
+    { return engine_.actualMaxGen(); }
+
+    auto stats() const
+        -> FractalIterStats
+    { return engine_.stats(); }
+
+    // False if the engine reached the end of the curve before its
+    // midpoint, e.g., at FractalApprox maxOrdinal; then the whole curve
+    // has been traversed, and must not be mirrored
+    auto isHalf() const noexcept
+        -> bool
+    { return isHalf_; }
+
+private:
+    enum class Phase { Half, Closing, Done };
+
+    auto checkMidpoint()
+        -> void
+    {
+        switch (engine_.midpoint())
+        {
+        case detail::CurveMidpoint::None:
+            return;
+        case detail::CurveMidpoint::Vertex:
+            closing_ = reflect_(previous_);
+            break;
+        case detail::CurveMidpoint::Segment:
+            closing_ = reflect_(value_);
+            break;
+        case detail::CurveMidpoint::End:
+            phase_ = Phase::Done;
+            isHalf_ = false;
+            return;
+        }
+        phase_ = Phase::Closing;
+    }
+
+    Impl engine_;
+    detail::BisectorReflection reflect_;
+    Phase phase_{ Phase::Half };
+    bool isHalf_{ true };
+    size_t ordinal_{};
+    bool is_end_{ false };
+
+    Vec2d value_;
+    Vec2d previous_;
+    Vec2d closing_;
 };
 
 using FractalNGenIterator =
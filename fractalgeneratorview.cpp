@@ -1,6 +1,7 @@
 #include "fractalgeneratorview.h"
 
 #include "scoped_true.hpp"
+#include "uniform_grid.hpp"
 #include "vec2_qt.hpp"
 
 #include <QGraphicsItem>
@@ -8,7 +9,9 @@
 #include <QGraphicsObject>
 #include <QMouseEvent>
 
+#include <algorithm>
 #include <functional>
+#include <unordered_map>
 
 namespace {
 
@@ -47,9 +50,11 @@ struct HandleLines
 class HandleItem : public QGraphicsRectItem
 {
 public:
+    static constexpr auto size = 10.;
+
     HandleItem(const Vec2d& pos,
                HandleLines lines,
-               std::function<void()> onPosChanged,
+               std::function<void(HandleItem*)> onPosChanged,
                QGraphicsItem* parent = nullptr) :
         QGraphicsRectItem( rectFromCenter(pos), parent ),
         lines_{ lines },
@@ -80,9 +85,17 @@ public:
         -> void
     { lines_.after = line; }
 
+    auto center() const
+        -> QPointF
+    { return rect().center() + pos(); }
+
+    auto setCenter(const QPointF& p)
+        -> void
+    { setPos(p - rect().center()); }
+
     auto update()
     {
-        auto p = rect().center() + pos();
+        auto p = center();
 
         if (lines_.before)
         {
@@ -99,7 +112,7 @@ public:
         }
 
         if (onPosChanged_)
-            onPosChanged_();
+            onPosChanged_(this);
     }
 
 protected:
@@ -111,8 +124,6 @@ protected:
     }
 
 private:
-    static constexpr auto size = 10.;
-
     static auto rectFromCenter(const Vec2d& pos)
         -> QRectF
     {
@@ -121,9 +132,25 @@ private:
     }
 
     HandleLines lines_;
-    std::function<void()> onPosChanged_;
+    std::function<void(HandleItem*)> onPosChanged_;
 };
 
+auto lineBox(const QLineF& line)
+    -> Bbox2d
+{
+    auto result = Bbox2d{};
+    result << toVec2d(line.p1()) << toVec2d(line.p2());
+    return result;
+}
+
+auto handleBox(const HandleItem* h)
+    -> Bbox2d
+{
+    auto c = toVec2d(h->center());
+    constexpr auto dr = Vec2d{HandleItem::size/2., HandleItem::size/2.};
+    return { .min = c - dr, .max = c + dr, .empty = false };
+}
+
 } // anonymous namespace
 
 
@@ -161,19 +188,25 @@ struct FractalGeneratorView::Impl
 
     auto makeHandleItem(const Vec2d& v, const HandleLines& lines)
         -> HandleItem*
-    { return new HandleItem{ v, lines, [&]{ updateGeneratorObject(); } }; }
+    {
+        return new HandleItem{
+            v, lines, [&](HandleItem* h){ onHandleMoved(h); } };
+    }
 
     auto makeScene()
         -> void
     {
-        auto handleSize = 8;
-        auto handleSize2 = QSizeF(handleSize, handleSize);
-        auto dr = Vec2d{handleSize/2., handleSize/2.};
         scene_.clear();
         lines_.clear();
         handles_.clear();
+        lineIndex_.clear();
+        handleIndex_.clear();
+        hoveredLine_ = nullptr;
+        hoveredHandle_ = nullptr;
+        currentHandle_ = nullptr;
 
-        const auto& fg = fractalGeneratorObject_->fractalGenerator();
+        points_ = fractalGeneratorObject_->fractalGenerator();
+        const auto& fg = points_;
 
         for (size_t index=1, n=fg.size(); index<n; ++index)
         {
@@ -193,20 +226,174 @@ struct FractalGeneratorView::Impl
             handles_.push_back(item);
             scene_.addItem(item);
         }
+
+        renumberItems(0);
+        reindex();
+    }
+
+    // Rebuilds spatial indices, choosing the cell size such that there are
+    // a few vertices per cell
+    auto reindex()
+        -> void
+    {
+        auto bbox = Bbox2d{};
+        for (const auto& v: points_)
+            bbox << v;
+        auto cellSize = std::max(
+            HandleItem::size,
+            bbox.size().norm() / std::sqrt(std::max<size_t>(points_.size(), 1)));
+
+        lineGrid_.reset(cellSize);
+        for (auto* item: lines_)
+            lineGrid_.insert(item, lineBox(item->line()));
+
+        handleGrid_.reset(cellSize);
+        for (auto* h: handles_)
+            handleGrid_.insert(h, handleBox(h));
+
+        indexedCount_ = points_.size();
+    }
+
+    // Cell size chosen by reindex() is fine while the number of vertices
+    // does not change much
+    auto maybeReindex()
+        -> void
+    {
+        auto n = points_.size();
+        if (n > 2*indexedCount_ || 2*n < indexedCount_)
+            reindex();
+    }
+
+    // Updates positions of the items from index on, after inserting
+    // or erasing at index
+    auto renumberItems(size_t index)
+        -> void
+    {
+        for (auto i=index, n=lines_.size(); i<n; ++i)
+            lineIndex_[lines_[i]] = i;
+        for (auto i=index, n=handles_.size(); i<n; ++i)
+            handleIndex_[handles_[i]] = i;
+    }
+
+    auto setLine(QGraphicsLineItem* item, const QLineF& line)
+        -> void
+    {
+        item->setLine(line);
+        lineGrid_.insert(item, lineBox(line));
+    }
+
+    // Inserts a vertex between existing ones, 0 < index < points_.size()
+    auto insertVertex(size_t index, const Vec2d& v)
+        -> HandleItem*
+    {
+        Q_ASSERT(index > 0 && index < points_.size());
+
+        auto* lineItemBefore = lines_[index-1];
+        auto lineBefore = lineItemBefore->line();
+        auto p2 = lineBefore.p2();
+        lineBefore.setP2(toQPointF(v));
+        setLine(lineItemBefore, lineBefore);
+
+        auto* lineItemAfter = makeLineItem(v, toVec2d(p2));
+        scene_.addItem(lineItemAfter);
+        lines_.insert(lines_.begin() + index, lineItemAfter);
+        lineGrid_.insert(lineItemAfter, lineBox(lineItemAfter->line()));
+
+        handles_[index]->setLineBefore(lineItemAfter);
+
+        auto* newHandle = makeHandleItem(v, { lineItemBefore, lineItemAfter });
+        scene_.addItem(newHandle);
+        handles_.insert(handles_.begin() + index, newHandle);
+        handleGrid_.insert(newHandle, handleBox(newHandle));
+
+        points_.insert(points_.begin() + index, v);
+        renumberItems(index);
+        return newHandle;
+    }
+
+    // Removes a vertex other than the first and the last one
+    auto eraseVertex(size_t index)
+        -> void
+    {
+        Q_ASSERT(index > 0 && index+1 < points_.size());
+
+        auto* handleItem = handles_[index];
+        if (hoveredHandle_ == handleItem)
+            hoveredHandle_ = nullptr;
+        if (currentHandle_ == handleItem)
+            currentHandle_ = nullptr;
+        handleGrid_.remove(handleItem);
+        handleIndex_.erase(handleItem);
+        scene_.removeItem(handleItem);
+        delete handleItem;
+        handles_.erase(handles_.begin() + index);
+
+        auto* lineItemAfter = lines_[index];
+        if (hoveredLine_ == lineItemAfter)
+            hoveredLine_ = nullptr;
+        lineGrid_.remove(lineItemAfter);
+        lineIndex_.erase(lineItemAfter);
+        scene_.removeItem(lineItemAfter);
+        delete lineItemAfter;
+        lines_.erase(lines_.begin() + index);
+        renumberItems(index);
+
+        points_.erase(points_.begin() + index);
+
+        auto* lineItem = lines_[index-1];
+        auto line = lineItem->line();
+        line.setP2(toQPointF(points_[index]));
+        setLine(lineItem, line);
+
+        handles_[index]->setLineBefore(lineItem);
+    }
+
+    auto moveVertex(size_t index, const Vec2d& v)
+        -> void
+    {
+        auto* h = handles_[index];
+        h->setCenter(toQPointF(v));
+        handleGrid_.insert(h, handleBox(h));
+
+        auto lines = h->lines();
+        if (lines.before)
+        {
+            auto line = lines.before->line();
+            line.setP2(toQPointF(v));
+            setLine(lines.before, line);
+        }
+        if (lines.after)
+        {
+            auto line = lines.after->line();
+            line.setP1(toQPointF(v));
+            setLine(lines.after, line);
+        }
+
+        points_[index] = v;
     }
 
     auto hoverHandle(HandleItem* h)
         -> void
     {
-        for (auto* h2: handles_)
-            h2->setBrush(h2 == h? Qt::red: Qt::gray);
+        if (h == hoveredHandle_)
+            return;
+        if (hoveredHandle_)
+            hoveredHandle_->setBrush(Qt::gray);
+        if (h)
+            h->setBrush(Qt::red);
+        hoveredHandle_ = h;
     }
 
     auto hoverLine(QGraphicsLineItem* line)
         -> void
     {
-        for (auto* line2: lines_)
-            line2->setPen(line2 == line? QPen(Qt::red, 2): QPen(Qt::black, 2));
+        if (line == hoveredLine_)
+            return;
+        if (hoveredLine_)
+            hoveredLine_->setPen(QPen(Qt::black, 2));
+        if (line)
+            line->setPen(QPen(Qt::red, 2));
+        hoveredLine_ = line;
     }
 
     auto trackClosestObject(const QPointF& pos)
@@ -221,38 +408,40 @@ struct FractalGeneratorView::Impl
     auto trackHoveredHandle(const QPointF& pos)
         -> bool
     {
-        for (auto it=handles_.rbegin(); it!=handles_.rend(); ++it)
+        // Of overlapping handles, prefer the one closest to the cursor
+        HandleItem* hovered = nullptr;
+        auto hoveredDist = 0.;
+        auto v = toVec2d(pos);
+        handleGrid_.forEachAt(v, [&](HandleItem* h)
         {
-            auto* h = *it;
-            if (h->contains(h->mapFromScene(pos)))
+            if (!h->contains(h->mapFromScene(pos)))
+                return;
+            auto d = (toVec2d(h->center()) - v).norm();
+            if (!hovered || d < hoveredDist)
             {
-                hoverHandle(h);
-                return true;
+                hovered = h;
+                hoveredDist = d;
             }
-        }
+        });
 
-        hoverHandle(nullptr);
-        return false;
+        hoverHandle(hovered);
+        return hovered != nullptr;
     }
 
     auto closestLine(const Vec2d& v)
         -> size_t
     {
-        const auto& fg = fractalGeneratorObject_->fractalGenerator();
-
-        size_t closestIndex = ~0;
-        auto closestDist = 0.;
-        for (size_t index=0, n=fg.size(); index+1<n; ++index)
-        {
-            auto d = distanceToLine(v, { fg[index], fg[index+1] });
-            if (closestIndex == ~0 || d < closestDist)
+        auto* item = lineGrid_.nearest(
+            v,
+            [&](QGraphicsLineItem* item)
             {
-                closestIndex = index;
-                closestDist = d;
-            }
-        }
-
-        return closestIndex;
+                auto line = item->line();
+                return distanceToLine(
+                    v, { toVec2d(line.p1()), toVec2d(line.p2()) });
+            });
+        if (!item)
+            return ~0;
+        return lineIndex_.at(item);
     }
 
     auto trackClosestLine(const QPointF& pos)
@@ -301,7 +490,7 @@ struct FractalGeneratorView::Impl
 
         if (currentHandle_)
         {
-            auto pos = currentHandle_->pos() + currentHandle_->rect().center();
+            auto pos = currentHandle_->center();
             emit view_->pointSelected(pos.x(), pos.y());
         }
         else
@@ -315,80 +504,59 @@ struct FractalGeneratorView::Impl
         if (lineIndex == ~0)
             return;
 
-        auto fg = fractalGeneratorObject_->fractalGenerator();
-
-        auto* lineItemBefore = lines_[lineIndex];
-        auto lineBefore = lineItemBefore->line();
-
         if (inTheMiddle)
-            v = toVec2d((lineBefore.p1() + lineBefore.p2()) / 2);
-
-        lineBefore.setP2(toQPointF(v));
-        lineItemBefore->setLine(lineBefore);
-
-        auto* lineItemAfter = makeLineItem(v, fg[lineIndex+1]);
-        scene_.addItem(lineItemAfter);
-        lines_.insert(lines_.begin() + lineIndex+1, lineItemAfter);
-
-        handles_[lineIndex+1]->setLineBefore(lineItemAfter);
-
-        auto* newHandle = makeHandleItem(v, { lineItemBefore, lineItemAfter });
-        scene_.addItem(newHandle);
-        handles_.insert(handles_.begin() + lineIndex+1, newHandle);
+            v = 0.5 * (points_[lineIndex] + points_[lineIndex+1]);
 
-        fg.insert(fg.begin() + lineIndex+1, v);
-
-        auto scoped_true = ScopedTrue{ changingFractalGenerator_ };
-        fractalGeneratorObject_->setFractalGenerator(fg);
+        auto* newHandle = insertVertex(lineIndex+1, v);
+        maybeReindex();
+        updateGeneratorObject();
 
+        scene_.clearSelection();
         currentHandle_ = newHandle;
-        for (auto* h: handles_)
-            h->setSelected(h == currentHandle_);
+        currentHandle_->setSelected(true);
         emit view_->pointSelected(v[0], v[1]);
     }
 
     auto removeVertex(HandleItem* handleItem)
         -> void
     {
-        auto index = std::find(handles_.begin(), handles_.end(), handleItem) -
-                     handles_.begin();
+        auto it = handleIndex_.find(handleItem);
+        if (it == handleIndex_.end())
+            return;
+        auto index = it->second;
         if (index == 0 || index+1 == handles_.size())
             return;
-        Q_ASSERT(index > 0 && index+1 < handles_.size());
-
-        auto fg = fractalGeneratorObject_->fractalGenerator();
-        fg.erase(fg.begin() + index);
-
-        scene_.removeItem(handleItem);
-        handles_.erase(handles_.begin() + index);
-
-        scene_.removeItem(lines_[index]);
-        lines_.erase(lines_.begin() + index);
-
-        auto* lineItem = lines_[index-1];
-        auto line = lineItem->line();
-        line.setP2(toQPointF(fg[index]));
-        lineItem->setLine(line);
-
-        handles_[index]->setLineBefore(lineItem);
 
-        auto scoped_true = ScopedTrue{ changingFractalGenerator_ };
-        fractalGeneratorObject_->setFractalGenerator(fg);
+        eraseVertex(index);
+        maybeReindex();
+        updateGeneratorObject();
     }
 
-    auto updateGeneratorObject()
+    // Called as the user drags the handle. Other selected handles
+    // are dragged along with it.
+    auto onHandleMoved(HandleItem* h)
         -> void
     {
-        auto fg = fractalGeneratorObject_->fractalGenerator();
-        Q_ASSERT(fg.size() == handles_.size());
-        for (size_t index=0, n=fg.size(); index<n; ++index)
+        auto sync = [&](HandleItem* h)
         {
-            auto* h = handles_[index];
-            fg[index] = toVec2d(h->rect().center() + h->pos());
-        }
+            if (auto it = handleIndex_.find(h); it != handleIndex_.end())
+                moveVertex(it->second, toVec2d(h->center()));
+        };
+        sync(h);
+        for (auto* item: scene_.selectedItems())
+            if (auto* selected = dynamic_cast<HandleItem*>(item);
+                selected && selected != h)
+                sync(selected);
+
+        updateGeneratorObject();
+    }
 
+    auto updateGeneratorObject()
+        -> void
+    {
+        Q_ASSERT(points_.size() == handles_.size());
         auto scoped_true = ScopedTrue{ changingFractalGenerator_ };
-        fractalGeneratorObject_->setFractalGenerator(fg);
+        fractalGeneratorObject_->setFractalGenerator(points_);
     }
 
     auto setSelectedPointCoords(double x, double y) -> void
@@ -396,11 +564,56 @@ struct FractalGeneratorView::Impl
         if (!currentHandle_)
             return;
 
-        auto newPos = QPointF{x, y} - currentHandle_->rect().center();
-        currentHandle_->setPos(newPos);
+        currentHandle_->setCenter({x, y});
         currentHandle_->update();
     }
 
+    // Updates items of vertices that differ between points_ and the
+    // generator. Vertices are moved, or inserted or removed one by one
+    // in the middle of the generator; the scene is rebuilt if the
+    // first or the last vertex is inserted or removed, or if too many are.
+    auto syncScene()
+        -> void
+    {
+        constexpr size_t maxIncrementalInsertions = 64;
+
+        const auto& fg = fractalGeneratorObject_->fractalGenerator();
+        auto n0 = points_.size();
+        auto n = fg.size();
+        auto common = std::min(n0, n);
+
+        size_t head = 0;
+        while (head < common && points_[head] == fg[head])
+            ++head;
+        size_t tail = 0;
+        while (tail < common - head && points_[n0-1-tail] == fg[n-1-tail])
+            ++tail;
+
+        auto k0 = n0 - head - tail;
+        auto k = n - head - tail;
+        auto moved = std::min(k0, k);
+        auto inserted = std::max(k0, k) - moved;
+        auto at = head + moved;
+        if (inserted > 0 &&
+            (at == 0 || tail == 0 || inserted > maxIncrementalInsertions))
+        {
+            makeScene();
+            return;
+        }
+
+        for (auto index=head; index<at; ++index)
+            moveVertex(index, fg[index]);
+        if (k > k0)
+            for (auto index=at, end=at+inserted; index<end; ++index)
+                insertVertex(index, fg[index]);
+        else
+            for (size_t i=0; i<inserted; ++i)
+                eraseVertex(at);
+        maybeReindex();
+
+        Q_ASSERT(points_ == fg);
+    }
+
     auto onFractalGeneratorChanged()
         -> void
     {
@@ -408,16 +621,30 @@ struct FractalGeneratorView::Impl
             return;
         auto scoped_true = ScopedTrue{ changingFractalGenerator_ };
 
-        makeScene();
+        syncScene();
     }
 
     FractalGeneratorView* view_;
     FractalGeneratorObject* fractalGeneratorObject_;
     QGraphicsScene scene_;
 
+    // Generator vertices shown by the items
+    FractalGenerator points_;
     std::vector<QGraphicsLineItem*> lines_;
     std::vector<HandleItem*> handles_;
+
+    // Positions of the items in lines_ and handles_, so that hit testing
+    // and dragging need no search
+    std::unordered_map<QGraphicsLineItem*, size_t> lineIndex_;
+    std::unordered_map<HandleItem*, size_t> handleIndex_;
+
     HandleItem* currentHandle_{};
+    HandleItem* hoveredHandle_{};
+    QGraphicsLineItem* hoveredLine_{};
+
+    UniformGrid<QGraphicsLineItem*> lineGrid_;
+    UniformGrid<HandleItem*> handleGrid_;
+    size_t indexedCount_{};
 
     bool changingFractalGenerator_{false};
 };
@@ -1,28 +1,29 @@
 #include "fractalview.h"
 
 #include "anim_param.hpp"
+#include "fractal_iter.hpp"
 #include "render_fractal.hpp"
+#include "throw.hpp"
+#include "vec2_qt.hpp"
+#include "vertex_file.hpp"
+#include "vertex_pack.hpp"
 
+#include <QFileDialog>
 #include <QMessageBox>
+#include <QMouseEvent>
 #include <QPainter>
+#include <QWheelEvent>
 
+#include <algorithm>
+#include <cmath>
 #include <filesystem>
 #include <sstream>
+#include <thread>
 
 using namespace std::string_literals;
 
 namespace {
 
-auto reportTime(std::ostream& s,
-                std::chrono::nanoseconds dt,
-                std::string_view message)
-    -> void
-{
-    auto msec =
-        std::chrono::duration_cast<std::chrono::milliseconds>(dt).count();
-    s << message << ": " << static_cast<double>(msec) / 1000 << " s\n";
-}
-
 template <typename T>
 auto setWidgetParam(QWidget* widget, T& dst, const T& src)
     -> void
@@ -34,6 +35,15 @@ auto setWidgetParam(QWidget* widget, T& dst, const T& src)
     widget->update();
 }
 
+constexpr auto minZoom = -4.;
+constexpr auto maxZoom = 40.;
+
+// Zoom levels per mouse wheel step
+constexpr auto wheelZoomStep = 0.5;
+
+// Coarser levels searched for a tile to show until one is rendered
+constexpr auto placeholderLevels = 6;
+
 } // anonymous namespace
 
 
@@ -48,6 +58,37 @@ FractalView::FractalView(FractalGeneratorObject* fractalGenerator,
         &FractalGeneratorObject::fractalGeneratorChanged,
         this,
         qOverload<>(&FractalView::update));
+
+    frameRenderer_ = std::make_unique<FrameRenderer>(
+        &geometryCache_,
+        [this](RenderedFrame frame)
+        {
+            QMetaObject::invokeMethod(
+                this,
+                [this, frame = std::move(frame)]() mutable
+                {
+                    if (frame.hash != requestedFrame_)
+                        return;
+                    vertexRate_ = frame.vertexRate;
+                    frame_ = std::move(frame);
+                    frameProgress_.reset();
+                    update();
+                },
+                Qt::QueuedConnection);
+        },
+        [this](uint64_t hash, const RenderProgress& progress)
+        {
+            QMetaObject::invokeMethod(
+                this,
+                [this, hash, progress]
+                {
+                    if (hash != requestedFrame_)
+                        return;
+                    frameProgress_ = progress;
+                    update();
+                },
+                Qt::QueuedConnection);
+        });
 }
 
 auto FractalView::paintEvent(QPaintEvent *event)
@@ -55,16 +96,280 @@ auto FractalView::paintEvent(QPaintEvent *event)
 {
     auto p = QPainter{this};
 
+    if (navigating_)
+    {
+        paintTiles(p);
+        return;
+    }
+
     const auto& fg = fractalGenerator_->fractalGenerator();
     auto base = std::vector<Vec2d>{ {0., 0.}, {1., 0.} };
-    auto renderResult = renderFractal(p, rect(), base, fg, param_);
+    auto hash = frameRequestHash(size(), base, fg, param_);
+    if (hash != requestedFrame_)
+    {
+        requestedFrame_ = hash;
+        frameProgress_.reset();
+        frameRenderer_->request({
+            .size = size(),
+            .base = base,
+            .gen = std::vector<Vec2d>(fg.begin(), fg.end()),
+            .param = param_,
+            .hash = hash });
+    }
+
+    // The previous image, possibly of another size, until the new one
+    // is rendered
+    p.fillRect(rect(), Qt::white);
+    if (!frame_.image.isNull())
+        p.drawImage(0, 0, frame_.image);
+
+    const auto& renderResult = frame_.renderResult;
+    auto rendering = frame_.hash != requestedFrame_;
+    if (!rendering && renderResult.refused)
+    {
+        p.setPen(Qt::darkRed);
+        p.drawText(
+            rect().adjusted(20, 20, -20, -20),
+            Qt::AlignCenter | Qt::TextWordWrap,
+            QString::fromStdString(renderResult.engineWarning));
+    }
 
     std::ostringstream status;
-    reportTime(status, renderResult.computeBbTime, "Computing bounding box");
-    reportTime(status, renderResult.renderTime, "Rendering fractal");
-    status << "Vertices: " << renderResult.vertexCount << std::endl;
-    status << "Max. generation: " << renderResult.maxGen << std::endl;
-    status << "Scale: " << renderResult.scale << std::endl;
+    if (rendering)
+    {
+        status << "Rendering";
+        if (frameProgress_)
+            status << ": " << static_cast<int>(100 * frameProgress_->fraction)
+                   << "%, " << frameProgress_->vertexCount << " vertices";
+        p.setPen(Qt::darkGray);
+        p.drawText(
+            rect().adjusted(8, 8, -8, -8),
+            Qt::AlignRight | Qt::AlignTop,
+            QString::fromStdString(status.str()));
+        status << "\nLast frame rendered:\n";
+    }
+    reportRenderStats(status, renderResult);
+
+    emit renderingStatus(QString::fromStdString(status.str()));
+}
+
+auto FractalView::wheelEvent(QWheelEvent* event)
+    -> void
+{
+    auto steps = event->angleDelta().y() / 120.;
+    startNavigation();
+    if (!navigating_ || steps == 0)
+        return;
+
+    // Keep the curve point under the cursor in place
+    auto pos = toVec2d(event->position()) - toVec2d(QRectF(rect()).center());
+    auto v = center_ + pos / (pyramidScale_ * std::exp2(zoom_));
+    zoom_ = std::clamp(zoom_ + wheelZoomStep * steps, minZoom, maxZoom);
+    center_ = v - pos / (pyramidScale_ * std::exp2(zoom_));
+    update();
+}
+
+auto FractalView::mousePressEvent(QMouseEvent* event)
+    -> void
+{
+    if (event->button() == Qt::LeftButton)
+        dragPos_ = event->pos();
+    else
+        QWidget::mousePressEvent(event);
+}
+
+auto FractalView::mouseMoveEvent(QMouseEvent* event)
+    -> void
+{
+    if (!dragPos_)
+        return QWidget::mouseMoveEvent(event);
+
+    startNavigation();
+    if (!navigating_)
+        return;
+
+    auto d = event->pos() - *dragPos_;
+    dragPos_ = event->pos();
+    center_ -= Vec2d{ double(d.x()), double(d.y()) } / (pyramidScale_ * std::exp2(zoom_));
+    update();
+}
+
+auto FractalView::mouseReleaseEvent(QMouseEvent* event)
+    -> void
+{
+    dragPos_.reset();
+    QWidget::mouseReleaseEvent(event);
+}
+
+auto FractalView::mouseDoubleClickEvent(QMouseEvent* event)
+    -> void
+{
+    resetNavigation();
+    QWidget::mouseDoubleClickEvent(event);
+}
+
+auto FractalView::resetNavigation()
+    -> void
+{
+    if (!navigating_)
+        return;
+    navigating_ = false;
+    dragPos_.reset();
+    if (tileRenderer_)
+        tileRenderer_->request(tileSource_, {});
+    update();
+}
+
+auto FractalView::startNavigation()
+    -> void
+{
+    const auto& fg = fractalGenerator_->fractalGenerator();
+    if (navigating_ || fg.size() < 2)
+        return;
+
+    // Zoom level 0 shows the curve as fitted to the view
+    auto base = std::vector<Vec2d>{ {0., 0.}, {1., 0.} };
+    auto view = fractalViewTransform(
+        rect(), base, fg, param_, nullptr, &geometryCache_);
+    pyramidScale_ = view.scale;
+    pyramidOrigin_ = toVec2d(
+        view.transform.inverted().map(QRectF(rect()).center()));
+    center_ = pyramidOrigin_;
+    zoom_ = 0;
+    navigating_ = true;
+
+    if (!tileRenderer_)
+        tileRenderer_ = std::make_unique<TileRenderer>(
+            std::max(2u, std::thread::hardware_concurrency()) - 1,
+            [this](RenderedTile tile)
+            {
+                QMetaObject::invokeMethod(
+                    this,
+                    [this, tile = std::move(tile)]() mutable
+                    {
+                        tileCache_.insert(tile.key, std::move(tile.image));
+                        lastTileResult_ = std::move(tile.renderResult);
+                        update();
+                    },
+                    Qt::QueuedConnection);
+            });
+}
+
+auto FractalView::tileSource()
+    -> std::shared_ptr<const TileSource>
+{
+    const auto& fg = fractalGenerator_->fractalGenerator();
+    auto base = std::vector<Vec2d>{ {0., 0.}, {1., 0.} };
+    auto hash = tileSourceHash(
+        base, fg, param_, pyramidOrigin_, pyramidScale_);
+    if (!tileSource_ || tileSource_->hash != hash)
+    {
+        // Tiles of the previous source are shown until new ones are ready
+        if (tileSource_)
+            previousTileSource_ = tileSource_->hash;
+        tileSource_ = makeTileSource(
+            base, fg, param_, pyramidOrigin_, pyramidScale_);
+    }
+    return tileSource_;
+}
+
+auto FractalView::paintTiles(QPainter& p)
+    -> void
+{
+    auto source = tileSource();
+
+    // Tiles of the next finer level are drawn scaled down
+    auto zoom = static_cast<int>(std::ceil(zoom_));
+    auto f = std::exp2(zoom_ - zoom);
+    auto viewCenter = toVec2d(QRectF(rect()).center());
+    auto worldCenter = (center_ - source->origin) * tileScale(*source, zoom);
+
+    auto tileRange = [&](size_t axis, int extent)
+    {
+        auto w0 = worldCenter[axis] - viewCenter[axis] / f;
+        auto w1 = worldCenter[axis] + (extent - viewCenter[axis]) / f;
+        return std::pair{
+            static_cast<int64_t>(std::floor(w0 / tileSize)),
+            static_cast<int64_t>(std::floor(w1 / tileSize)) };
+    };
+    auto [x0, x1] = tileRange(0, width());
+    auto [y0, y1] = tileRange(1, height());
+
+    auto tileRect = [&](int64_t x, int64_t y)
+        -> QRectF
+    {
+        auto corner =
+            viewCenter +
+            (Vec2d{ double(x * tileSize), double(y * tileSize) } -
+             worldCenter) * f;
+        return { toQPointF(corner), QSizeF{ tileSize * f, tileSize * f } };
+    };
+
+    // Shows a coarser or outdated tile in place of a missing one
+    auto drawPlaceholder = [&](const TileKey& key, const QRectF& target)
+    {
+        auto previous = key;
+        previous.source = previousTileSource_;
+        if (auto* image = tileCache_.find(previous))
+        {
+            p.drawImage(target, *image);
+            return;
+        }
+
+        for (auto k=1; k<=placeholderLevels; ++k)
+        {
+            auto parent = TileKey{
+                key.source, key.zoom - k, key.x >> k, key.y >> k };
+            if (auto* image = tileCache_.find(parent))
+            {
+                auto size = std::ldexp(tileSize, -k);
+                auto sourceRect = QRectF{
+                    (key.x - (parent.x << k)) * size,
+                    (key.y - (parent.y << k)) * size,
+                    size, size };
+                p.drawImage(target, *image, sourceRect);
+                return;
+            }
+        }
+    };
+
+    p.fillRect(rect(), Qt::white);
+    p.setRenderHint(QPainter::SmoothPixmapTransform);
+
+    auto missing = std::vector<TileKey>{};
+    for (auto y=y0; y<=y1; ++y)
+        for (auto x=x0; x<=x1; ++x)
+        {
+            auto key = TileKey{ source->hash, zoom, x, y };
+            auto target = tileRect(x, y);
+            if (auto* image = tileCache_.find(key))
+                p.drawImage(target, *image);
+            else
+            {
+                missing.push_back(key);
+                drawPlaceholder(key, target);
+            }
+        }
+
+    // Render tiles close to the view center first
+    auto distance = [&](const TileKey& key)
+    {
+        auto c = Vec2d{ key.x + 0.5, key.y + 0.5 } * double{ tileSize } -
+                 worldCenter;
+        return c * c;
+    };
+    std::sort(missing.begin(), missing.end(),
+              [&](const TileKey& a, const TileKey& b)
+              { return distance(a) < distance(b); });
+    tileRenderer_->request(source, std::move(missing));
+
+    std::ostringstream status;
+    status << "Zoom: " << std::exp2(zoom_) << "x (level " << zoom << ")\n"
+           << "Tiles: " << tileCache_.size() << " cached, "
+           << tileCache_.bytes() / (1 << 20) << " MiB; "
+           << tileRenderer_->pendingCount() << " pending\n"
+           << "Last tile rendered:\n";
+    reportRenderStats(status, lastTileResult_);
 
     emit renderingStatus(QString::fromStdString(status.str()));
 }
@@ -104,6 +409,30 @@ auto FractalView::approxAlgorithmMaxVertexCount() const noexcept
 auto FractalView::adjustScale() const noexcept -> double
 { return param_.adjustScale; }
 
+auto FractalView::vertexBudget() const noexcept
+    -> size_t
+{ return param_.vertexBudget; }
+
+auto FractalView::timeBudgetMs() const noexcept
+    -> size_t
+{ return param_.timeBudgetMs; }
+
+auto FractalView::autoEngine() const noexcept
+    -> bool
+{ return param_.autoEngine; }
+
+auto FractalView::coverageCulling() const noexcept
+    -> bool
+{ return param_.coverageCulling; }
+
+auto FractalView::mirrorSymmetry() const noexcept
+    -> bool
+{ return param_.mirrorSymmetry; }
+
+auto FractalView::balancedRefinement() const noexcept
+    -> bool
+{ return param_.balancedRefinement; }
+
 auto FractalView::param() const noexcept
     -> const FractalViewParam&
 { return param_; }
@@ -146,6 +475,30 @@ auto FractalView::setAdjustScale(double adjustScale)
     -> void
 { setWidgetParam(this, param_.adjustScale, adjustScale); }
 
+auto FractalView::setVertexBudget(size_t vertexBudget)
+    -> void
+{ setWidgetParam(this, param_.vertexBudget, vertexBudget); }
+
+auto FractalView::setTimeBudgetMs(size_t timeBudgetMs)
+    -> void
+{ setWidgetParam(this, param_.timeBudgetMs, timeBudgetMs); }
+
+auto FractalView::setAutoEngine(bool enabled)
+    -> void
+{ setWidgetParam(this, param_.autoEngine, enabled); }
+
+auto FractalView::setCoverageCulling(bool enabled)
+    -> void
+{ setWidgetParam(this, param_.coverageCulling, enabled); }
+
+auto FractalView::setMirrorSymmetry(bool enabled)
+    -> void
+{ setWidgetParam(this, param_.mirrorSymmetry, enabled); }
+
+auto FractalView::setBalancedRefinement(bool enabled)
+    -> void
+{ setWidgetParam(this, param_.balancedRefinement, enabled); }
+
 auto FractalView::setParam(const FractalViewParam& param)
     -> void
 {
@@ -235,3 +588,64 @@ auto FractalView::logState() -> void
 
     log_ << std::endl;
 }
+
+auto FractalView::exportVertices()
+    -> void
+{
+    auto selectedFilter = QString{};
+    auto fileName =
+        QFileDialog::getSaveFileName(
+            this,
+            tr("Export vertices"),
+            QString(),
+            tr("float64 vertex files (*.bin);;"
+               "float32 vertex files (*.bin);;"
+               "packed 20-bit vertex files (*.gfvp)"),
+            &selectedFilter);
+    if (fileName.isEmpty())
+        return;
+
+    auto format = VertexFormat{};
+    if (selectedFilter.startsWith("float32"))
+        format.precision = VertexPrecision::Float32;
+    else if (selectedFilter.startsWith("packed"))
+        format.quantizationBits = 20;
+
+    try
+    {
+        const auto& fg = fractalGenerator_->fractalGenerator();
+        auto base = std::vector<Vec2d>{ {0., 0.}, {1., 0.} };
+        auto view = fractalViewTransform(rect(), base, fg, param_);
+        auto plan = planFractalRender(
+            base, fg, param_, view.scale, vertexRate_);
+        if (plan.refused)
+            throw_("Vertices not exported: ", plan.engineWarning);
+
+        auto vertexCount = uint64_t{};
+        auto exportTo = [&](auto&& writer)
+        {
+            exportFractalVertices(writer, base, fg, param_, plan);
+            writer.close();
+            vertexCount = writer.vertexCount();
+        };
+        if (format.quantizationBits)
+            exportTo(PackedVertexWriter{
+                fileName.toStdString(),
+                curveBounds(base, fg),
+                format.quantizationBits });
+        else
+            exportTo(VertexFileWriter{
+                fileName.toStdString(), format.precision });
+
+        std::ostringstream s;
+        s << "Exported " << vertexCount << " vertices to "
+          << fileName.toStdString();
+        QMessageBox::information(
+            this, QString(), QString::fromStdString(s.str()));
+    }
+    catch (const std::exception& e)
+    {
+        QMessageBox::critical(
+            this, QString(), QString::fromStdString(e.what()));
+    }
+}
@@ -2,10 +2,16 @@
 
 #include "fractalgenerator.h"
 #include "fractalview_param.h"
+#include "frame_renderer.hpp"
+#include "geometry_cache.hpp"
+#include "render_fractal.hpp"
+#include "tile_pyramid.hpp"
 
 #include <QWidget>
 
 #include <fstream>
+#include <memory>
+#include <optional>
 
 class FractalView : public QWidget
 {
@@ -24,6 +30,12 @@ public:
     auto approxAlgorithmMaxGen() const noexcept -> size_t;
     auto approxAlgorithmMaxVertexCount() const noexcept -> size_t;
     auto adjustScale() const noexcept -> double;
+    auto vertexBudget() const noexcept -> size_t;
+    auto timeBudgetMs() const noexcept -> size_t;
+    auto autoEngine() const noexcept -> bool;
+    auto coverageCulling() const noexcept -> bool;
+    auto mirrorSymmetry() const noexcept -> bool;
+    auto balancedRefinement() const noexcept -> bool;
 
     auto param() const noexcept -> const FractalViewParam&;
 
@@ -37,22 +49,78 @@ public slots:
     auto setApproxAlgorithmMaxGen(size_t maxGen) -> void;
     auto setApproxAlgorithmMaxVertexCount(size_t maxVertexCount) -> void;
     auto setAdjustScale(double adjustScale) -> void;
+    auto setVertexBudget(size_t vertexBudget) -> void;
+    auto setTimeBudgetMs(size_t timeBudgetMs) -> void;
+    auto setAutoEngine(bool enabled) -> void;
+    auto setCoverageCulling(bool enabled) -> void;
+    auto setMirrorSymmetry(bool enabled) -> void;
+    auto setBalancedRefinement(bool enabled) -> void;
 
     auto setParam(const FractalViewParam&) -> void;
 
     auto logState() -> void;
 
+    auto exportVertices() -> void;
+
+    // Leaves pan and zoom navigation, fitting the curve to the view
+    auto resetNavigation() -> void;
+
 protected:
     auto paintEvent(QPaintEvent *event)
         -> void override;
 
+    auto wheelEvent(QWheelEvent* event)
+        -> void override;
+
+    auto mousePressEvent(QMouseEvent* event)
+        -> void override;
+
+    auto mouseMoveEvent(QMouseEvent* event)
+        -> void override;
+
+    auto mouseReleaseEvent(QMouseEvent* event)
+        -> void override;
+
+    auto mouseDoubleClickEvent(QMouseEvent* event)
+        -> void override;
+
 signals:
     auto renderingStatus(const QString&)
         -> void;
 
 private:
+    auto startNavigation() -> void;
+    auto tileSource() -> std::shared_ptr<const TileSource>;
+    auto paintTiles(QPainter& p) -> void;
 
     FractalGeneratorObject* fractalGenerator_;
     FractalViewParam param_;
+
+    // Makes changes of only the view size or drawing style re-rasterize
+    // the vertices of the previous frames
+    GeometryCache geometryCache_;
     std::ofstream log_;
+
+    // The curve fitted to the view is rendered in the background; the last
+    // image rendered is shown, with progress, until the requested one is
+    RenderedFrame frame_;
+    uint64_t requestedFrame_{};
+    std::optional<RenderProgress> frameProgress_;
+    double vertexRate_{};
+
+    // Pan and zoom. The view fits the curve until the user navigates;
+    // then it shows tiles rendered in the background.
+    bool navigating_{false};
+    double zoom_{};             // Log2 of magnification relative to fitting
+    Vec2d center_{};            // Curve point at the view center
+    Vec2d pyramidOrigin_{};
+    double pyramidScale_{};     // Pixels per curve unit at zoom level 0
+    std::optional<QPoint> dragPos_;
+
+    std::shared_ptr<const TileSource> tileSource_;
+    uint64_t previousTileSource_{};
+    TileCache tileCache_{ size_t{256} << 20 };
+    RenderFractlalResult lastTileResult_;
+    std::unique_ptr<TileRenderer> tileRenderer_;
+    std::unique_ptr<FrameRenderer> frameRenderer_;
 };
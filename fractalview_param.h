@@ -6,6 +6,7 @@
 #include <cstddef>
 #include <string_view>
 #include <tuple>
+#include <utility>
 
 struct FractalViewParam
 {
@@ -21,10 +22,30 @@ struct FractalViewParam
     size_t approxAlgorithmMaxVertexCount{10'000'000};
 
     double adjustScale{1};
+
+    // Budget mode, enabled by a nonzero budget: the level of detail is
+    // lowered to fit the budget; 0 means no budget
+    size_t vertexBudget{0};
+    size_t timeBudgetMs{0};
+
+    // Switch to the approximate algorithm if the exact one is predicted
+    // to exceed approxAlgorithmMaxVertexCount or the budget
+    bool autoEngine{false};
+
+    // Skip refining FractalApprox subtrees whose bounds are painted already
+    bool coverageCulling{false};
+
+    // Stroke half of a mirror-symmetric curve and mirror the pixels
+    bool mirrorSymmetry{false};
+
+    // Spread the approximate algorithm's vertex count, or the vertex
+    // budget, evenly over the curve (FractalBalanced); neither mirroring
+    // nor coverage culling apply then
+    bool balancedRefinement{false};
 };
 
 inline auto field_names_of(TypeTag<FractalViewParam>)
-    -> std::array<std::string_view, 9>
+    -> std::array<std::string_view, 15>
 {
     return {
         "gen",
@@ -35,7 +56,13 @@ inline auto field_names_of(TypeTag<FractalViewParam>)
         "approx_bbox_gen",
         "approx_max_gen",
         "approx_max_vert",
-        "adjust_scale"
+        "adjust_scale",
+        "vertex_budget",
+        "time_budget_ms",
+        "auto_engine",
+        "coverage_cull",
+        "mirror",
+        "balanced"
     };
 }
 
@@ -49,7 +76,13 @@ inline auto fields_of(FractalViewParam& p)
         size_t&,
         size_t&,
         size_t&,
-        double&>
+        double&,
+        size_t&,
+        size_t&,
+        bool&,
+        bool&,
+        bool&,
+        bool&>
 {
     return std::tie(
         p.generations,
@@ -60,7 +93,13 @@ inline auto fields_of(FractalViewParam& p)
         p.approxAlgorithmBboxGen,
         p.approxAlgorithmMaxGen,
         p.approxAlgorithmMaxVertexCount,
-        p.adjustScale );
+        p.adjustScale,
+        p.vertexBudget,
+        p.timeBudgetMs,
+        p.autoEngine,
+        p.coverageCulling,
+        p.mirrorSymmetry,
+        p.balancedRefinement );
 }
 
 inline auto fields_of(const FractalViewParam& p)
@@ -73,7 +112,13 @@ inline auto fields_of(const FractalViewParam& p)
         const size_t&,
         const size_t&,
         const size_t&,
-        const double&>
+        const double&,
+        const size_t&,
+        const size_t&,
+        const bool&,
+        const bool&,
+        const bool&,
+        const bool&>
 {
     return std::tie(
         p.generations,
@@ -84,5 +129,25 @@ inline auto fields_of(const FractalViewParam& p)
         p.approxAlgorithmBboxGen,
         p.approxAlgorithmMaxGen,
         p.approxAlgorithmMaxVertexCount,
-        p.adjustScale );
+        p.adjustScale,
+        p.vertexBudget,
+        p.timeBudgetMs,
+        p.autoEngine,
+        p.coverageCulling,
+        p.mirrorSymmetry,
+        p.balancedRefinement );
+}
+
+// Calls set(field) with the field of p named name, as in field_names_of();
+// returns false if there is no such field
+template <typename Set>
+auto setViewParamField(FractalViewParam& p, std::string_view name, Set&& set)
+    -> bool
+{
+    auto names = field_names_of(Type<FractalViewParam>);
+    auto fields = fields_of(p);
+    return [&]<size_t... I>(std::index_sequence<I...>)
+    {
+        return ((names[I] == name && (set(std::get<I>(fields)), true)) || ...);
+    }(std::make_index_sequence<std::tuple_size_v<decltype(fields)>>());
 }
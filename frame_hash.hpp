@@ -0,0 +1,43 @@
+#pragma once
+
+#include "vec2.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+
+// 64-bit FNV-1a hash
+class FrameHash final
+{
+public:
+    template <typename T>
+    requires std::is_arithmetic_v<T>
+    auto operator<<(T value) noexcept
+        -> FrameHash&
+    {
+        auto bytes = reinterpret_cast<const unsigned char*>(&value);
+        for (size_t i=0; i<sizeof(T); ++i)
+        {
+            hash_ ^= bytes[i];
+            hash_ *= 0x100000001b3ull;
+        }
+        return *this;
+    }
+
+    auto operator<<(std::span<const Vec2d> line) noexcept
+        -> FrameHash&
+    {
+        *this << line.size();
+        for (const auto& v: line)
+            *this << v[0] << v[1];
+        return *this;
+    }
+
+    auto value() const noexcept
+        -> uint64_t
+    { return hash_; }
+
+private:
+    uint64_t hash_{ 0xcbf29ce484222325ull };
+};
@@ -0,0 +1,98 @@
+#include "frame_renderer.hpp"
+
+#include "frame_hash.hpp"
+#include "trace.hpp"
+
+#include <QPainter>
+
+#include <tuple>
+
+auto frameRequestHash(const QSize& size,
+                      std::span<const Vec2d> base,
+                      std::span<const Vec2d> gen,
+                      const FractalViewParam& param)
+    -> uint64_t
+{
+    auto h = FrameHash{};
+    h << rendererVersion << size.width() << size.height() << base << gen;
+    std::apply([&](const auto&... field) { ((h << field), ...); },
+               fields_of(param));
+    return h.value();
+}
+
+FrameRenderer::FrameRenderer(GeometryCache* geometryCache,
+                             OnRendered onRendered,
+                             OnProgress onProgress) :
+    geometryCache_{ geometryCache },
+    onRendered_{ std::move(onRendered) },
+    onProgress_{ std::move(onProgress) },
+    thread_{ [this](std::stop_token stop)
+    {
+        if (traceEnabled())
+            setTraceThreadName("frame");
+        work(stop);
+    } }
+{}
+
+FrameRenderer::~FrameRenderer()
+{
+    {
+        auto lock = std::scoped_lock{ mutex_ };
+        current_.request_stop();
+    }
+    thread_.request_stop();
+    thread_.join();
+}
+
+auto FrameRenderer::request(FrameRequest frame)
+    -> void
+{
+    {
+        auto lock = std::scoped_lock{ mutex_ };
+        pending_ = std::move(frame);
+        current_.request_stop();
+    }
+    pendingChanged_.notify_all();
+}
+
+auto FrameRenderer::work(std::stop_token stop)
+    -> void
+{
+    // Reused for all frames, so that the vertex rate carries over
+    auto scratch = RenderScratch{ .geometryCache = geometryCache_ };
+
+    while (true)
+    {
+        auto frame = FrameRequest{};
+        auto control = RenderControl{};
+        {
+            auto lock = std::unique_lock{ mutex_ };
+            if (!pendingChanged_.wait(
+                    lock, stop, [&]{ return pending_.has_value(); }))
+                return;
+            frame = std::move(*pending_);
+            pending_.reset();
+            current_ = std::stop_source{};
+            control.stop = current_.get_token();
+        }
+
+        auto hash = frame.hash;
+        control.progress = [&](const RenderProgress& progress)
+        { onProgress_(hash, progress); };
+
+        auto span = TraceSpan{ "render frame" };
+        auto result = RenderedFrame{
+            .hash = hash,
+            .image = QImage{ frame.size, QImage::Format_ARGB32_Premultiplied } };
+        {
+            auto p = QPainter{ &result.image };
+            result.renderResult = renderFractal(
+                p, result.image.rect(), frame.base, frame.gen, frame.param,
+                &scratch, &control);
+        }
+        if (result.renderResult.cancelled)
+            continue;
+        result.vertexRate = scratch.vertexRate;
+        onRendered_(std::move(result));
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "fractalview_param.h"
+#include "render_fractal.hpp"
+#include "vec2.hpp"
+
+#include <QImage>
+#include <QSize>
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+class GeometryCache;
+
+// Everything an image of the whole curve depends on
+struct FrameRequest
+{
+    QSize size;
+    std::vector<Vec2d> base;
+    std::vector<Vec2d> gen;
+    FractalViewParam param;
+    uint64_t hash{};        // Of all the above
+};
+
+auto frameRequestHash(const QSize& size,
+                      std::span<const Vec2d> base,
+                      std::span<const Vec2d> gen,
+                      const FractalViewParam& param)
+    -> uint64_t;
+
+struct RenderedFrame
+{
+    uint64_t hash{};        // FrameRequest::hash
+    QImage image;
+    RenderFractlalResult renderResult;
+
+    // RenderScratch::vertexRate after rendering
+    double vertexRate{};
+};
+
+// Renders images of the whole curve on a background thread, one at a time.
+// A request stops the image being rendered, if any, and replaces the one
+// still pending. Destruction stops rendering.
+class FrameRenderer final
+{
+public:
+    // Both called on the worker thread; progress is reported with
+    // the hash of the request being rendered
+    using OnRendered = std::function<void(RenderedFrame)>;
+    using OnProgress = std::function<void(uint64_t, const RenderProgress&)>;
+
+    FrameRenderer(GeometryCache* geometryCache,
+                  OnRendered onRendered,
+                  OnProgress onProgress);
+    ~FrameRenderer();
+
+    auto request(FrameRequest frame)
+        -> void;
+
+private:
+    auto work(std::stop_token stop)
+        -> void;
+
+    GeometryCache* geometryCache_;
+    OnRendered onRendered_;
+    OnProgress onProgress_;
+    std::mutex mutex_;
+    std::condition_variable_any pendingChanged_;
+    std::optional<FrameRequest> pending_;
+    std::stop_source current_;
+
+    // Last, so that the thread is stopped before the state it uses is gone
+    std::jthread thread_;
+};
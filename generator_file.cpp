@@ -0,0 +1,50 @@
+#include "generator_file.hpp"
+
+#include "throw.hpp"
+
+#include <QRegularExpression>
+#include <QString>
+
+#include <fstream>
+
+auto readGeneratorFile(const std::string& fileName)
+    -> FractalGenerator
+{
+    auto s = std::ifstream{ fileName };
+    if (!s.is_open())
+        throw_("Failed to open input file ", fileName);
+
+    FractalGenerator fg;
+    static const auto cellSep = QRegularExpression{"[ \t,]+"};
+    for (size_t lineNumber=1; ; ++lineNumber)
+    {
+        auto line = std::string{};
+        std::getline(s, line);
+        if (line.empty() || s.fail())
+            break;
+
+        auto parseFailure = [&]
+        {
+            throw_("Failed to parse input file\n",
+                   fileName, ":", lineNumber, ": ", line);
+        };
+
+        auto cells = QString::fromStdString(line).split(cellSep);
+        if (cells.size() != 2)
+            parseFailure();
+        auto ok_x = false;
+        auto x = cells[0].toDouble(&ok_x);
+        auto ok_y = false;
+        auto y = cells[1].toDouble(&ok_y);
+        if (!(ok_x && ok_y))
+        {
+            if (lineNumber == 1)
+                continue;
+            parseFailure();
+        }
+        fg.emplace_back(x, y);
+    }
+    if (fg.size() < 2)
+        throw_("Too few points in generator read from file ", fileName);
+    return fg;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "fractalgenerator.h"
+
+#include <string>
+
+// Generator files are text files with one point per line, coordinates
+// separated by spaces, tabs or commas; a non-numeric first line is a
+// header, and the first empty line ends the points. Throws if the file
+// can't be read or has fewer than 2 points.
+auto readGeneratorFile(const std::string& fileName)
+    -> FractalGenerator;
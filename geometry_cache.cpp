@@ -0,0 +1,99 @@
+#include "geometry_cache.hpp"
+
+#include "frame_hash.hpp"
+
+namespace {
+
+auto cachedBytes(const CachedPolyLine& polyline)
+    -> size_t
+{
+    return
+        sizeof(CachedPolyLine) +
+        polyline.vertices.capacity() * sizeof(Vec2d) +
+        polyline.stats.genVertexCount.capacity() * sizeof(size_t);
+}
+
+} // anonymous namespace
+
+
+
+auto geometryCurveHash(std::span<const Vec2d> base, std::span<const Vec2d> gen)
+    -> uint64_t
+{
+    auto h = FrameHash{};
+    h << base << gen;
+    return h.value();
+}
+
+auto GeometryKeyHash::operator()(const GeometryKey& key) const noexcept
+    -> size_t
+{
+    auto h = FrameHash{};
+    h << key.curve << static_cast<int>(key.kind)
+      << key.maxGen << key.maxOrdinal << key.minLength;
+    return h.value();
+}
+
+
+
+auto GeometryCache::find(const GeometryKey& key)
+    -> std::shared_ptr<const CachedPolyLine>
+{
+    auto lock = std::lock_guard{ mutex_ };
+    auto it = index_.find(key);
+    if (it == index_.end())
+        return nullptr;
+    items_.splice(items_.begin(), items_, it->second);
+    return it->second->second;
+}
+
+auto GeometryCache::insert(const GeometryKey& key,
+                           std::shared_ptr<const CachedPolyLine> polyline)
+    -> void
+{
+    auto polylineBytes = cachedBytes(*polyline);
+    if (!accepts(static_cast<double>(polylineBytes)))
+        return;
+
+    auto lock = std::lock_guard{ mutex_ };
+    if (auto it = index_.find(key); it != index_.end())
+    {
+        bytes_ -= cachedBytes(*it->second->second);
+        items_.erase(it->second);
+        index_.erase(it);
+    }
+
+    bytes_ += polylineBytes;
+    items_.emplace_front(key, std::move(polyline));
+    index_.emplace(key, items_.begin());
+
+    while (bytes_ > maxBytes_ && items_.size() > 1)
+    {
+        bytes_ -= cachedBytes(*items_.back().second);
+        index_.erase(items_.back().first);
+        items_.pop_back();
+    }
+}
+
+auto GeometryCache::clear()
+    -> void
+{
+    auto lock = std::lock_guard{ mutex_ };
+    index_.clear();
+    items_.clear();
+    bytes_ = 0;
+}
+
+auto GeometryCache::size() const
+    -> size_t
+{
+    auto lock = std::lock_guard{ mutex_ };
+    return items_.size();
+}
+
+auto GeometryCache::bytes() const
+    -> size_t
+{
+    auto lock = std::lock_guard{ mutex_ };
+    return bytes_;
+}
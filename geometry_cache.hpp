@@ -0,0 +1,99 @@
+#pragma once
+
+#include "fractal_iter.hpp"
+#include "vec2.hpp"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// Identifies a polyline generated for a curve: everything its vertices
+// depend on, but nothing about how they are drawn
+struct GeometryKey
+{
+    enum class Kind
+    {
+        Bbox,       // Vertices are the min. and max. corners of generation maxGen
+        Exact,      // FractalNGen
+        ExactHalf,  // FractalHalf<FractalNGen>
+        Approx,     // FractalApprox
+        ApproxHalf, // FractalHalf<FractalApprox>
+        Balanced    // FractalBalanced
+    };
+
+    uint64_t curve{};       // geometryCurveHash() of base and generator
+    Kind kind{};
+    size_t maxGen{};
+    size_t maxOrdinal{};
+    double minLength{};
+
+    auto operator==(const GeometryKey&) const -> bool = default;
+};
+
+auto geometryCurveHash(std::span<const Vec2d> base, std::span<const Vec2d> gen)
+    -> uint64_t;
+
+struct GeometryKeyHash
+{
+    auto operator()(const GeometryKey& key) const noexcept
+        -> size_t;
+};
+
+// Vertices of a polyline, and stats of the iterator that generated them
+struct CachedPolyLine
+{
+    std::vector<Vec2d> vertices;
+    size_t maxGen{};
+    FractalIterStats stats;
+};
+
+
+// Least recently used polylines, up to a memory limit. Thread-safe;
+// polylines found stay valid while evicted.
+class GeometryCache final
+{
+public:
+    static constexpr size_t defaultMaxBytes = size_t{ 256 } << 20;
+
+    explicit GeometryCache(size_t maxBytes = defaultMaxBytes) :
+        maxBytes_{ maxBytes }
+    {}
+
+    // Returns null if the polyline is not cached
+    auto find(const GeometryKey& key)
+        -> std::shared_ptr<const CachedPolyLine>;
+
+    // Polylines taking more than a quarter of the limit are not cached,
+    // so that a single huge curve does not evict everything else
+    auto insert(const GeometryKey& key,
+                std::shared_ptr<const CachedPolyLine> polyline)
+        -> void;
+
+    // Whether insert() keeps a polyline taking that many bytes
+    auto accepts(double bytes) const noexcept
+        -> bool
+    { return bytes <= static_cast<double>(maxBytes_ / 4); }
+
+    auto clear()
+        -> void;
+
+    auto size() const
+        -> size_t;
+
+    auto bytes() const
+        -> size_t;
+
+private:
+    using Items = std::list<
+        std::pair<GeometryKey, std::shared_ptr<const CachedPolyLine>>>;
+
+    size_t maxBytes_;
+    mutable std::mutex mutex_;
+    size_t bytes_{};
+    Items items_;   // Most recently used first
+    std::unordered_map<GeometryKey, Items::iterator, GeometryKeyHash> index_;
+};
@@ -48,6 +48,131 @@ using PointOf =
         decltype(std::declval<KeyframeCurves>()(std::declval<Keyframe>())[0]) >;
 
 
+// Cubic interpolation of curves given at keyframes. Curve counts may differ
+// between keyframes; curves are matched using localIndex. Interpolated curves
+// are evaluated on demand, so the memory is only needed for keyframe data.
+template <typename Point>
+class CurveInterpolator final
+{
+public:
+    CurveInterpolator() = default;
+
+    template <typename Keyframe, typename KeyframeCurves>
+    CurveInterpolator(std::span<const Keyframe> keyframes,
+                      KeyframeCurves keyframeCurves)
+    {
+        auto kfsCurves =
+            std::ranges::transform_view(keyframes, keyframeCurves);
+
+        auto kfsCurveCount =
+            std::ranges::transform_view(
+                kfsCurves,
+                [](const auto& kfCurves){ return kfCurves.size(); });
+
+        // Compute the total (maximal over keyframes) number of curves
+        keyframeCount_ = keyframes.size();
+        curveCount_ =
+            *std::max_element(
+                kfsCurveCount.begin(), kfsCurveCount.end() );
+        auto nglobal = curveCount_;
+
+        // Compute curve nodes
+        nodes_.reserve(keyframeCount_ * nglobal);
+        for (const auto& kf: keyframes)
+        {
+            const auto& kfCurves = keyframeCurves(kf);
+            auto nlocal = kfCurves.size();
+            for (size_t iglobal=0; iglobal<nglobal; ++iglobal)
+            {
+                auto ilocal = localIndex(iglobal, nglobal, nlocal);
+                nodes_.push_back( kfCurves[ilocal] );
+            }
+        }
+
+        // Compute original slopes of all curves at once
+        slopes_.resize(nodes_.size());
+        CubicSlopeSolver(keyframeCount_).solve<Point>(
+            nodes_, nglobal, slopes_);
+
+        // Average slopes over collapsing curves
+        for (size_t ikf=0; ikf<keyframeCount_; ++ikf)
+        {
+            auto nlocal = keyframeCurves(keyframes[ikf]).size();
+            if (nlocal == nglobal)
+                continue;
+
+            auto kfSlopes = slopes(ikf);
+            auto msum = Point{};
+            size_t iglobalBegin = 0;
+            auto flush = [&](size_t iglobalEnd)
+            {
+                auto m = msum / (iglobalEnd - iglobalBegin);
+                for (auto iglobal=iglobalBegin; iglobal!=iglobalEnd; ++iglobal)
+                    kfSlopes[iglobal] = m;
+                msum = Point{};
+                iglobalBegin = iglobalEnd;
+            };
+
+            size_t ilocalPrev = 0;
+            for (size_t iglobal=0; iglobal<nglobal; ++iglobal)
+            {
+                auto ilocal = localIndex(iglobal, nglobal, nlocal);
+                if (ilocal != ilocalPrev)
+                    flush(iglobal);
+                ilocalPrev = ilocal;
+                msum += kfSlopes[iglobal];
+            }
+            flush(nglobal);
+        }
+    }
+
+    auto keyframeCount() const noexcept
+        -> size_t
+    { return keyframeCount_; }
+
+    auto curveCount() const noexcept
+        -> size_t
+    { return curveCount_; }
+
+    // Curve nodes at keyframe ikf
+    auto nodes(size_t ikf) const
+        -> std::span<const Point>
+    { return { nodes_.data() + ikf*curveCount_, curveCount_ }; }
+
+    // Evaluates all curves at parameter p in [0, 1] of the piece
+    // between keyframes `piece` and `piece+1`; p is not eased.
+    auto eval(std::span<Point> result, size_t piece, double p) const
+        -> void
+    {
+        assert(piece+1 < keyframeCount_);
+        assert(result.size() == curveCount_);
+        auto fp = hermiteBasis(p);
+        auto y0 = nodes(piece);
+        auto y1 = nodes(piece+1);
+        auto m0 = slopes(piece);
+        auto m1 = slopes(piece+1);
+        for (size_t icurve=0; icurve<curveCount_; ++icurve)
+            result[icurve] =
+                hermite(fp, y0[icurve], y1[icurve], m0[icurve], m1[icurve]);
+    }
+
+private:
+    size_t keyframeCount_{};
+    size_t curveCount_{};
+
+    // Node points and slopes, [keyframe][curve]
+    std::vector<Point> nodes_;
+    std::vector<Point> slopes_;
+
+    auto slopes(size_t ikf) const
+        -> std::span<const Point>
+    { return { slopes_.data() + ikf*curveCount_, curveCount_ }; }
+
+    auto slopes(size_t ikf)
+        -> std::span<Point>
+    { return { slopes_.data() + ikf*curveCount_, curveCount_ }; }
+};
+
 template <typename Keyframe,
           typename KeyframeCurves,
           typename KeyframeSlopeF,
@@ -61,89 +186,31 @@ auto interpCurves(std::span<const Keyframe> keyframes,
     using Point =
         PointOf<Keyframe, KeyframeCurves>;
 
-    using Result =
-        std::vector<std::vector<Point>>;
-
-    auto kfsCurves =
-        std::ranges::transform_view(keyframes, keyframeCurves);
-
-    auto kfsCurveCount =
-        std::ranges::transform_view(
-            kfsCurves,
-            [](const auto& kfCurves){ return kfCurves.size(); });
+    auto interp = CurveInterpolator<Point>(keyframes, keyframeCurves);
+    auto nglobal = interp.curveCount();
 
-    // Compute the total (maximal over keyframes) number of curves
-    auto nglobal =
-        *std::max_element(
-            kfsCurveCount.begin(), kfsCurveCount.end() );
-
-    // Compute curve nodes
-    auto curves = Result( nglobal );
-    for (const auto& kf: keyframes)
+    auto result = std::vector<std::vector<Point>>( nglobal );
+    auto append = [&](std::span<const Point> row)
     {
-        const auto& kfCurves = keyframeCurves(kf);
-        auto nlocal = kfCurves.size();
         for (size_t iglobal=0; iglobal<nglobal; ++iglobal)
-        {
-            auto ilocal = localIndex(iglobal, nglobal, nlocal);
-            curves[iglobal].push_back( kfCurves[ilocal] );
-        }
-    }
-
-    auto nframes = keyframes.size();
+            result[iglobal].push_back(row[iglobal]);
+    };
 
-    // Compute original slopes
-    auto slopes = Result{};
-    slopes.reserve(nglobal);
-    for (size_t iglobal=0; iglobal<nglobal; ++iglobal)
-    {
-        slopes.push_back( cubicSlopes<Point>(curves[iglobal]) );
-        // auto m = cubicSlopes<Point>(curves[iglobal]);
-        // for (size_t iframe=0; iframe<nframes; ++iframe)
-        //     m[iframe] *= keyframeSlopeF(keyframes[iframe]);
-        // slopes.push_back( m );
-    }
-
-    // Average slopes over collapsing curves
-    for (size_t iframe=0; iframe<nframes; ++iframe)
+    // Interpolate result
+    append(interp.nodes(0));
+    auto row = std::vector<Point>( nglobal );
+    auto sf0 = keyframeSlopeF(keyframes[0]);
+    for (size_t piece=0; piece+1<keyframes.size(); ++piece)
     {
-        auto nlocal = keyframeCurves(keyframes[iframe]).size();
-        if (nlocal == nglobal)
-            continue;
-
-        auto msum = Point{};
-        size_t iglobalBegin = 0;
-        auto flush = [&](size_t iglobalEnd)
-        {
-            auto m = msum / (iglobalEnd - iglobalBegin);
-            for (auto iglobal=iglobalBegin; iglobal!=iglobalEnd; ++iglobal)
-                slopes[iglobal][iframe] = m;
-            msum = Point{};
-            iglobalBegin = iglobalEnd;
-        };
-
-        size_t ilocalPrev = 0;
-        for (size_t iglobal=0; iglobal<nglobal; ++iglobal)
+        auto sf1 = keyframeSlopeF(keyframes[piece+1]);
+        size_t subdiv = subdivAfter(keyframes[piece]);
+        for (size_t i=1; i<=subdiv; ++i)
         {
-            auto ilocal = localIndex(iglobal, nglobal, nlocal);
-            if (ilocal != ilocalPrev)
-                flush(iglobal);
-            ilocalPrev = ilocal;
-            msum += slopes[iglobal][iframe];
+            auto p = easedParam(static_cast<double>(i) / subdiv, sf0, sf1);
+            interp.eval(row, piece, p);
+            append(row);
         }
-        flush(nglobal);
-    }
-
-    // Interpolate result
-    auto result = Result{};
-    result.reserve(nglobal);
-    auto slopeF = [&](size_t ikf){ return keyframeSlopeF(keyframes[ikf]); };
-    auto subdiv = [&](size_t ikf){ return subdivAfter(keyframes[ikf]); };
-    for (size_t iglobal=0; iglobal<nglobal; ++iglobal)
-    {
-        const auto& y = curves[iglobal];
-        const auto& m = slopes[iglobal];
-        result.push_back(cubicInterp<Point>(y, m, subdiv, slopeF));
+        sf0 = sf1;
     }
 
     return result;
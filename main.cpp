@@ -1,6 +1,9 @@
 #include "mainwindow.h"
 
 #include "batch.hpp"
+#include "bench.hpp"
+#include "poster.hpp"
+#include "render_server.hpp"
 
 #include <QApplication>
 
@@ -10,8 +13,17 @@ int main(int argc, char *argv[])
 
     auto args = a.arguments();
 
-    if (args.size() == 3 && args[1] == "--batch")
-        return batch(args[2]);;
+    if (args.size() >= 3 && args[1] == "--batch")
+        return batch(args[2], args.mid(3));
+
+    if (args.size() >= 4 && args[1] == "--poster")
+        return poster(args[2], args[3], args.mid(4));
+
+    if (args.size() >= 2 && args[1] == "--serve")
+        return serve(args.mid(2));
+
+    if (args.size() >= 2 && args[1] == "--bench")
+        return bench(args.mid(2));
 
     MainWindow w;
     w.show();
@@ -100,6 +100,48 @@ MainWindow::MainWindow(QWidget *parent)
         fractalView,
         &FractalView::setAdjustScale);
 
+    controlsDialog->setVertexBudget(fractalView->vertexBudget());
+    connect(
+        controlsDialog,
+        &ControlsDialog::vertexBudgetEdited,
+        fractalView,
+        &FractalView::setVertexBudget);
+
+    controlsDialog->setTimeBudget(fractalView->timeBudgetMs());
+    connect(
+        controlsDialog,
+        &ControlsDialog::timeBudgetEdited,
+        fractalView,
+        &FractalView::setTimeBudgetMs);
+
+    controlsDialog->setAutoEngine(fractalView->autoEngine());
+    connect(
+        controlsDialog,
+        &ControlsDialog::autoEngineChanged,
+        fractalView,
+        &FractalView::setAutoEngine);
+
+    controlsDialog->setCoverageCulling(fractalView->coverageCulling());
+    connect(
+        controlsDialog,
+        &ControlsDialog::coverageCullingChanged,
+        fractalView,
+        &FractalView::setCoverageCulling);
+
+    controlsDialog->setMirrorSymmetry(fractalView->mirrorSymmetry());
+    connect(
+        controlsDialog,
+        &ControlsDialog::mirrorSymmetryChanged,
+        fractalView,
+        &FractalView::setMirrorSymmetry);
+
+    controlsDialog->setBalancedRefinement(fractalView->balancedRefinement());
+    connect(
+        controlsDialog,
+        &ControlsDialog::balancedRefinementChanged,
+        fractalView,
+        &FractalView::setBalancedRefinement);
+
     controlsDialog->disablePoint();
     connect(
         controlsDialog,
@@ -153,10 +195,22 @@ MainWindow::MainWindow(QWidget *parent)
     connect(logStateAction, &QAction::triggered,
             fractalView, &FractalView::logState);
 
+    auto* exportVerticesAction =
+        fileMenu->addAction("&Export vertices...");
+    connect(exportVerticesAction, &QAction::triggered,
+            fractalView, &FractalView::exportVertices);
+
     fileMenu->addSeparator();
 
     auto* quitAction = fileMenu->addAction("&Quit", QKeySequence::Quit);
     connect(quitAction, &QAction::triggered, this, &QWidget::close);
+
+    auto* viewMenu = menu->addMenu("&View");
+
+    auto* fitAction = viewMenu->addAction(
+        "&Fit to window", QKeyCombination(Qt::CTRL, Qt::Key_0));
+    connect(fitAction, &QAction::triggered,
+            fractalView, &FractalView::resetNavigation);
     setMenuBar(menu);
 }
 
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Keeps the first exception thrown by any of several worker threads
+class WorkerErrors final
+{
+public:
+    // Runs work(); if it throws, stores the exception and calls onError()
+    template <typename Work, typename OnError>
+    auto run(Work&& work, OnError&& onError) noexcept
+        -> void
+    {
+        try
+        { work(); }
+        catch (...)
+        {
+            {
+                auto lock = std::lock_guard{ mutex_ };
+                if (!error_)
+                    error_ = std::current_exception();
+                failed_ = true;
+            }
+            onError();
+        }
+    }
+
+    auto failed() const noexcept
+        -> bool
+    { return failed_; }
+
+    auto rethrow()
+        -> void
+    {
+        auto lock = std::lock_guard{ mutex_ };
+        if (error_)
+            std::rethrow_exception(error_);
+    }
+
+private:
+    std::mutex mutex_;
+    std::exception_ptr error_;
+    std::atomic<bool> failed_{ false };
+};
+
+
+// Starts `count` threads running work(workerIndex). onFinished() is called
+// once, by the last worker to return. Destroying the result joins the threads.
+template <typename Work, typename OnFinished>
+auto startWorkers(size_t count, Work work, OnFinished onFinished)
+    -> std::vector<std::jthread>
+{
+    auto remaining = std::make_shared<std::atomic<size_t>>(count);
+    auto result = std::vector<std::jthread>{};
+    result.reserve(count);
+    for (size_t workerIndex=0; workerIndex<count; ++workerIndex)
+        result.emplace_back([=]{
+            work(workerIndex);
+            if (--*remaining == 0)
+                onFinished();
+        });
+    return result;
+}
+
+
+// Collects items completed in arbitrary order and passes them to a consumer
+// in increasing index order
+template <typename T, typename Consume>
+class OrderedCompletion final
+{
+public:
+    explicit OrderedCompletion(Consume consume, size_t firstIndex = 0):
+        consume_{ std::move(consume) },
+        nextIndex_{ firstIndex }
+    {}
+
+    auto complete(size_t index, T item)
+        -> void
+    {
+        auto lock = std::lock_guard{ mutex_ };
+        pending_.emplace(index, std::move(item));
+        for (auto it=pending_.begin();
+             it!=pending_.end() && it->first==nextIndex_;
+             it=pending_.erase(it), ++nextIndex_)
+            consume_(it->first, it->second);
+    }
+
+private:
+    Consume consume_;
+    std::mutex mutex_;
+    std::map<size_t, T> pending_;
+    size_t nextIndex_;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "throw.hpp"
+
+#include <QSize>
+
+#include <sstream>
+#include <string>
+
+// Parses the value of a command line option, all of the text
+template <typename T>
+auto parseOptionValue(const std::string& option, const std::string& text)
+    -> T
+{
+    auto s = std::istringstream{ text };
+    auto result = T{};
+    s >> result;
+    if (s.fail() || !s.eof())
+        throw_("Invalid value '", text, "' for option ", option);
+    return result;
+}
+
+// Parses WxH
+inline auto parseSizeOption(const std::string& option, const std::string& text)
+    -> QSize
+{
+    auto x = text.find('x');
+    if (x == std::string::npos)
+        throw_("Invalid value '", text, "' for option ", option,
+               ", expected WxH");
+    return { parseOptionValue<int>(option, text.substr(0, x)),
+             parseOptionValue<int>(option, text.substr(x + 1)) };
+}
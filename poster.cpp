@@ -0,0 +1,236 @@
+#include "poster.hpp"
+
+#include "batch_csv.hpp"
+#include "bounded_queue.hpp"
+#include "parallel_frames.hpp"
+#include "parse_option.hpp"
+#include "poster_output.hpp"
+#include "render_context.hpp"
+#include "render_fractal.hpp"
+#include "throw.hpp"
+#include "trace.hpp"
+
+#include <QPainter>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <thread>
+
+namespace {
+
+struct PosterOptions
+{
+    std::string traceFileName;
+
+    // Batch file line to render, 1-based
+    size_t line{ 1 };
+
+    // Overrides the size given by the batch line
+    std::optional<QSize> size;
+
+    std::optional<PosterFormat> format;
+
+    int bandHeight{ 256 };
+
+    size_t renderJobs{ std::max(std::thread::hardware_concurrency(), 1u) };
+
+    // Bands rendered but not yet written, including those being rendered;
+    // zero means twice the number of render jobs. Bounds memory use.
+    size_t maxInFlight{};
+};
+
+auto parsePosterOptions(const QStringList& args)
+    -> PosterOptions
+{
+    auto result = PosterOptions{};
+    for (auto it=args.begin(), end=args.end(); it!=end; ++it)
+    {
+        auto option = it->toStdString();
+        auto value = [&]() -> std::string
+        {
+            if (std::next(it) == end)
+                throw_("Missing value for option ", option);
+            return (++it)->toStdString();
+        };
+
+        if (option == "--trace")
+            result.traceFileName = value();
+        else if (option == "--line")
+            result.line = parseOptionValue<size_t>(option, value());
+        else if (option == "--size")
+            result.size = parseSizeOption(option, value());
+        else if (option == "--format")
+            result.format = parsePosterFormat(value());
+        else if (option == "--band-height")
+            result.bandHeight = parseOptionValue<int>(option, value());
+        else if (option == "--jobs")
+            result.renderJobs = parseOptionValue<size_t>(option, value());
+        else if (option == "--max-in-flight")
+            result.maxInFlight = parseOptionValue<size_t>(option, value());
+        else
+            throw_("Unknown poster option '", option, "'");
+    }
+
+    if (result.line == 0)
+        throw_("Batch file lines are numbered from 1");
+    if (result.bandHeight <= 0 || result.renderJobs == 0)
+        throw_("Band height and render jobs must be positive");
+    if (result.maxInFlight == 0)
+        result.maxInFlight = 2 * result.renderJobs;
+    return result;
+}
+
+struct RenderedBand
+{
+    QImage image;
+    RenderFractlalResult renderResult;
+};
+
+auto seconds(std::chrono::steady_clock::duration dt)
+    -> double
+{ return std::chrono::duration<double>(dt).count(); }
+
+} // anonymous namespace
+
+auto poster(const QString& batchFileName,
+            const QString& outputFileName,
+            const QStringList& options)
+    -> int
+{
+    auto& log = std::cout;
+    try
+    {
+        auto opts = parsePosterOptions(options);
+        auto traceSession = TraceSession{ opts.traceFileName };
+        if (traceEnabled())
+            setTraceThreadName("main");
+        auto time_0 = std::chrono::steady_clock::now();
+
+        auto lines = readBatchFile(batchFileName, log);
+        if (opts.line > lines.size())
+            throw_("Batch file has ", lines.size(), " lines, line ",
+                   opts.line, " requested");
+        const auto& frame = lines[opts.line - 1];
+        auto size = opts.size.value_or(frame.size);
+        if (size.width() <= 0 || size.height() <= 0)
+            throw_("Invalid poster size ", size.width(), 'x', size.height());
+
+        auto outputPath = outputFileName.toStdString();
+        auto writer = PosterWriter{
+            outputPath,
+            size.width(),
+            size.height(),
+            opts.format.value_or(posterFormatOf(outputPath)) };
+
+        // The transform renderFractal() would use for the whole image;
+        // each band shows a part of it
+        auto view = fractalViewTransform(
+            {QPoint{}, size}, frame.base, frame.gen, frame.viewParam);
+        auto bandCount =
+            (size.height() + opts.bandHeight - 1) / opts.bandHeight;
+        auto bandRect = [&](int band)
+        {
+            auto top = band * opts.bandHeight;
+            return QRect{
+                0, top,
+                size.width(), std::min(opts.bandHeight, size.height() - top) };
+        };
+
+        log << "Rendering " << size.width() << 'x' << size.height()
+            << " poster in " << bandCount << " bands of "
+            << opts.bandHeight << " rows" << std::endl;
+
+        auto imagePool = ImagePool{ QImage::Format_ARGB32, opts.maxInFlight };
+
+        // Bands are written in order; bands waiting for their predecessors
+        // keep their in-flight tokens, which bounds memory use
+        auto inFlightTokens = BoundedQueue<int>{ opts.maxInFlight };
+        for (size_t i=0; i<opts.maxInFlight; ++i)
+            inFlightTokens.push(0);
+
+        auto vertexCount = size_t{};
+        auto peakBytes = size_t{};
+        auto truncated = false;
+        auto writeBand = [&](size_t, RenderedBand& band)
+        {
+            {
+                auto span = TraceSpan{ "write band" };
+                writer.writeRows(band.image);
+            }
+            imagePool.recycle(std::move(band.image));
+            vertexCount += totalVertexCount(band.renderResult);
+            peakBytes = std::max(
+                peakBytes, band.renderResult.peakAllocatedBytes);
+            truncated = truncated || band.renderResult.truncated;
+            inFlightTokens.push(0);
+        };
+        auto orderedBands =
+            OrderedCompletion<RenderedBand, decltype(writeBand)>{ writeBand };
+
+        auto errors = WorkerErrors{};
+        auto nextBand = std::atomic<int>{ 0 };
+        auto renderWorkers = startWorkers(
+            opts.renderJobs,
+            [&](size_t workerIndex)
+            {
+                if (traceEnabled())
+                    setTraceThreadName(
+                        "render " + std::to_string(workerIndex));
+                errors.run([&]
+                {
+                    auto context = RenderContext{};
+                    while (inFlightTokens.pop())
+                    {
+                        auto band = nextBand++;
+                        if (band >= bandCount)
+                        {
+                            // Pass the token on to workers still waiting
+                            inFlightTokens.push(0);
+                            return;
+                        }
+
+                        auto span = TraceSpan{ "render band", "band", band };
+                        auto rect = bandRect(band);
+                        auto bandView = FractalViewTransform{
+                            view.scale,
+                            view.transform * QTransform::fromTranslate(
+                                0, -rect.top()) };
+                        auto image = imagePool.acquire(rect.size());
+                        auto renderResult = RenderFractlalResult{};
+                        {
+                            auto p = QPainter{ &image };
+                            renderResult = renderFractalRegion(
+                                p, image.rect(), bandView,
+                                frame.base, frame.gen, frame.viewParam,
+                                &context.scratch);
+                        }
+                        orderedBands.complete(
+                            band, { std::move(image), std::move(renderResult) });
+                    }
+                }, [&]{ inFlightTokens.cancel(); });
+            },
+            []{});
+
+        renderWorkers.clear();
+        errors.rethrow();
+        writer.close();
+
+        log << "Wrote '" << outputPath << "' in "
+            << seconds(std::chrono::steady_clock::now() - time_0) << " s: "
+            << vertexCount << " vertices, peak band geometry memory "
+            << peakBytes / 1024 << " KiB" << std::endl;
+        if (truncated)
+            log << "WARNING: some bands were truncated at max. vertex count"
+                << std::endl;
+
+        return EXIT_SUCCESS;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+
+// Renders one line of a batch file as a poster: an image too large to
+// hold in memory, rendered in horizontal bands that are streamed to a PNG
+// or TIFF file. Each band generates only the geometry visible in it, and
+// bands are rendered in parallel. Options are the remaining command line
+// arguments.
+auto poster(const QString& batchFileName,
+            const QString& outputFileName,
+            const QStringList& options)
+    -> int;
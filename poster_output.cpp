@@ -0,0 +1,275 @@
+#include "poster_output.hpp"
+
+#include "throw.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cstring>
+
+static_assert(std::endian::native == std::endian::little,
+              "TIFF posters are written in native byte order");
+
+namespace {
+
+// Deflated data is written in chunks of about this size
+constexpr size_t idatChunkSize = 1 << 20;
+
+constexpr uint8_t pngSignature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+
+auto appendBigEndian(std::vector<uint8_t>& bytes, uint32_t value)
+    -> void
+{
+    for (auto shift: { 24, 16, 8, 0 })
+        bytes.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+constexpr uint16_t tiffShort = 3;
+constexpr uint16_t tiffLong = 4;
+constexpr uint16_t tiffRational = 5;
+
+struct TiffEntry
+{
+    uint16_t tag;
+    uint16_t type;
+    uint32_t count;
+    uint32_t value;     // Or offset, if the values take more than 4 bytes
+};
+
+} // anonymous namespace
+
+
+
+auto parsePosterFormat(const std::string& name)
+    -> PosterFormat
+{
+    if (name == "png")
+        return PosterFormat::Png;
+    if (name == "tiff")
+        return PosterFormat::Tiff;
+    throw_("Unknown poster format '", name, "', expected png or tiff");
+}
+
+auto posterFormatOf(const std::string& path)
+    -> PosterFormat
+{
+    auto dot = path.rfind('.');
+    auto extension =
+        dot == std::string::npos? std::string{}: path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return extension == "tif" || extension == "tiff"
+        ? PosterFormat::Tiff
+        : PosterFormat::Png;
+}
+
+
+
+PosterWriter::PosterWriter(const std::string& path,
+                           int width,
+                           int height,
+                           PosterFormat format):
+    path_{ path },
+    width_{ width },
+    height_{ height },
+    format_{ format }
+{
+    if (width_ <= 0 || height_ <= 0)
+        throw_("Invalid poster size ", width_, 'x', height_);
+
+    auto dataSize = uint64_t{ 3 } * width_ * height_;
+    if (format_ == PosterFormat::Tiff && dataSize > 0xffff'0000u)
+        throw_("Poster of ", width_, 'x', height_,
+               " exceeds the 4 GiB limit of TIFF files, use PNG instead");
+
+    file_ = std::fopen(path_.c_str(), "wb");
+    if (!file_)
+        throw_("Failed to open output file '", path_, "'");
+
+    if (format_ == PosterFormat::Png)
+    {
+        if (deflateInit(&zstream_, Z_DEFAULT_COMPRESSION) != Z_OK)
+            throw_("Failed to initialize PNG compression");
+        zstreamInitialized_ = true;
+
+        writeBytes(pngSignature, sizeof(pngSignature));
+        auto header = std::vector<uint8_t>{};
+        appendBigEndian(header, width_);
+        appendBigEndian(header, height_);
+        header.insert(header.end(), {
+            8,      // Bit depth
+            2,      // Color type: RGB
+            0,      // Compression: deflate
+            0,      // Filter method
+            0 });   // No interlacing
+        writePngChunk("IHDR", header.data(), header.size());
+
+        // Each row starts with its filter type; 0 is none
+        row_.resize(1 + 3 * size_t(width_));
+    }
+    else
+    {
+        // Rows follow the header, and the IFD follows the rows
+        auto ifdOffset = static_cast<uint32_t>(8 + dataSize + dataSize % 2);
+        writeBytes("II", 2);
+        auto magic = uint16_t{ 42 };
+        writeBytes(&magic, sizeof(magic));
+        writeBytes(&ifdOffset, sizeof(ifdOffset));
+        row_.resize(3 * size_t(width_));
+    }
+}
+
+PosterWriter::~PosterWriter()
+{
+    if (zstreamInitialized_)
+        deflateEnd(&zstream_);
+    if (file_)
+        std::fclose(file_);
+}
+
+auto PosterWriter::writeRow(const uint32_t* row)
+    -> void
+{
+    if (rowCount_ == height_)
+        throw_("Too many rows written to poster '", path_, "'");
+
+    auto* rgb = row_.data() + (format_ == PosterFormat::Png? 1: 0);
+    for (int x=0; x<width_; ++x, rgb+=3)
+    {
+        auto argb = row[x];
+        rgb[0] = static_cast<uint8_t>(argb >> 16);
+        rgb[1] = static_cast<uint8_t>(argb >> 8);
+        rgb[2] = static_cast<uint8_t>(argb);
+    }
+
+    if (format_ == PosterFormat::Png)
+    {
+        zstream_.next_in = row_.data();
+        zstream_.avail_in = static_cast<uInt>(row_.size());
+        deflateRows(Z_NO_FLUSH);
+    }
+    else
+        writeBytes(row_.data(), row_.size());
+    ++rowCount_;
+}
+
+auto PosterWriter::close()
+    -> void
+{
+    if (!file_)
+        return;
+    if (rowCount_ != height_)
+        throw_("Poster '", path_, "' has ", rowCount_,
+               " rows written of ", height_);
+
+    if (format_ == PosterFormat::Png)
+    {
+        zstream_.next_in = nullptr;
+        zstream_.avail_in = 0;
+        deflateRows(Z_FINISH);
+        writePngChunk("IEND", nullptr, 0);
+    }
+    else
+    {
+        auto dataSize = uint32_t{ 3 } * width_ * height_;
+        if (dataSize % 2)
+            writeBytes("", 1);  // IFD must start on a word boundary
+
+        // Values that do not fit entries follow the IFD
+        constexpr auto entryCount = uint16_t{ 13 };
+        auto ifdOffset = 8 + dataSize + dataSize % 2;
+        auto extraOffset = ifdOffset + 2 + 12 * entryCount + 4;
+        auto bitsOffset = extraOffset;
+        auto resolutionOffset = extraOffset + 8;
+
+        const TiffEntry entries[entryCount] = {
+            { 256, tiffLong, 1, uint32_t(width_) },     // ImageWidth
+            { 257, tiffLong, 1, uint32_t(height_) },    // ImageLength
+            { 258, tiffShort, 3, bitsOffset },          // BitsPerSample
+            { 259, tiffShort, 1, 1 },                   // Compression: none
+            { 262, tiffShort, 1, 2 },                   // Photometric: RGB
+            { 273, tiffLong, 1, 8 },                    // StripOffsets
+            { 277, tiffShort, 1, 3 },                   // SamplesPerPixel
+            { 278, tiffLong, 1, uint32_t(height_) },    // RowsPerStrip
+            { 279, tiffLong, 1, dataSize },             // StripByteCounts
+            { 282, tiffRational, 1, resolutionOffset }, // XResolution
+            { 283, tiffRational, 1, resolutionOffset }, // YResolution
+            { 284, tiffShort, 1, 1 },                   // PlanarConfig: chunky
+            { 296, tiffShort, 1, 2 }                    // ResolutionUnit: inch
+        };
+        writeBytes(&entryCount, sizeof(entryCount));
+        for (const auto& e: entries)
+        {
+            writeBytes(&e.tag, sizeof(e.tag));
+            writeBytes(&e.type, sizeof(e.type));
+            writeBytes(&e.count, sizeof(e.count));
+            writeBytes(&e.value, sizeof(e.value));
+        }
+        auto nextIfd = uint32_t{ 0 };
+        writeBytes(&nextIfd, sizeof(nextIfd));
+
+        const uint16_t bits[4] = { 8, 8, 8, 0 };
+        writeBytes(bits, sizeof(bits));
+        const uint32_t dpi[2] = { 72, 1 };
+        writeBytes(dpi, sizeof(dpi));
+    }
+
+    auto file = file_;
+    file_ = nullptr;
+    if (std::fclose(file) != 0)
+        throw_("Failed to write output file '", path_, "'");
+}
+
+auto PosterWriter::writePngChunk(const char* type,
+                                 const uint8_t* data,
+                                 size_t size)
+    -> void
+{
+    auto header = std::vector<uint8_t>{};
+    appendBigEndian(header, static_cast<uint32_t>(size));
+    header.insert(header.end(), type, type + 4);
+    writeBytes(header.data(), header.size());
+    if (size > 0)
+        writeBytes(data, size);
+
+    auto crc = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+    if (size > 0)
+        crc = crc32(crc, data, static_cast<uInt>(size));
+    auto trailer = std::vector<uint8_t>{};
+    appendBigEndian(trailer, static_cast<uint32_t>(crc));
+    writeBytes(trailer.data(), trailer.size());
+}
+
+// Deflates zstream_ input into idat_, and writes IDAT chunks once enough
+// data is collected, or at the end of the stream
+auto PosterWriter::deflateRows(int flush)
+    -> void
+{
+    uint8_t buffer[1 << 16];
+    do
+    {
+        zstream_.next_out = buffer;
+        zstream_.avail_out = sizeof(buffer);
+        if (deflate(&zstream_, flush) == Z_STREAM_ERROR)
+            throw_("Failed to compress poster '", path_, "'");
+        idat_.insert(idat_.end(),
+                     buffer, buffer + sizeof(buffer) - zstream_.avail_out);
+    }
+    while (zstream_.avail_out == 0);
+
+    if (idat_.size() >= idatChunkSize ||
+        (flush == Z_FINISH && !idat_.empty()))
+    {
+        auto span = TraceSpan{ "write poster data" };
+        writePngChunk("IDAT", idat_.data(), idat_.size());
+        idat_.clear();
+    }
+}
+
+auto PosterWriter::writeBytes(const void* data, size_t size)
+    -> void
+{
+    if (std::fwrite(data, 1, size, file_) != size)
+        throw_("Failed to write output file '", path_, "'");
+}
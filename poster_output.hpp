@@ -0,0 +1,88 @@
+#pragma once
+
+#include <QImage>
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Poster image file formats; both store 8-bit RGB
+enum class PosterFormat
+{
+    Png,
+    Tiff    // Baseline, uncompressed; limited to 4 GiB
+};
+
+auto parsePosterFormat(const std::string& name)
+    -> PosterFormat;
+
+// Format from the file name extension: .tif and .tiff are TIFF,
+// anything else is PNG
+auto posterFormatOf(const std::string& path)
+    -> PosterFormat;
+
+
+// Writes an image of known size top to bottom, a few rows at a time,
+// so that the whole image is never held in memory. PNG rows are
+// deflated as they come; TIFF rows are stored as they are.
+class PosterWriter final
+{
+public:
+    PosterWriter(const std::string& path,
+                 int width,
+                 int height,
+                 PosterFormat format);
+
+    ~PosterWriter();
+
+    PosterWriter(const PosterWriter&) = delete;
+    PosterWriter& operator=(const PosterWriter&) = delete;
+
+    // row holds width pixels of QImage::Format_ARGB32; alpha is ignored
+    auto writeRow(const uint32_t* row)
+        -> void;
+
+    // Writes all rows of a Format_ARGB32 image as wide as the poster
+    auto writeRows(const QImage& image)
+        -> void
+    {
+        for (int y=0, h=image.height(); y<h; ++y)
+            writeRow(reinterpret_cast<const uint32_t*>(image.constScanLine(y)));
+    }
+
+    auto rowCount() const noexcept
+        -> int
+    { return rowCount_; }
+
+    // Requires all rows to be written
+    auto close()
+        -> void;
+
+private:
+    auto writePngChunk(const char* type, const uint8_t* data, size_t size)
+        -> void;
+
+    auto deflateRows(int flush)
+        -> void;
+
+    auto writeBytes(const void* data, size_t size)
+        -> void;
+
+    std::string path_;
+    int width_;
+    int height_;
+    PosterFormat format_;
+    FILE* file_{};
+    int rowCount_{};
+
+    // Filter byte and RGB samples of the row being written
+    std::vector<uint8_t> row_;
+
+    // PNG only
+    z_stream zstream_{};
+    bool zstreamInitialized_{};
+    std::vector<uint8_t> idat_;
+};
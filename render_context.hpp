@@ -0,0 +1,90 @@
+#pragma once
+
+#include "batch_frames.hpp"
+#include "render_fractal.hpp"
+
+#include <QImage>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+// Frame images returned by the stages consuming them, for reuse.
+// Keeps at most capacity images, normally the number of images in flight,
+// so that frames of changing size do not accumulate. Thread-safe.
+class ImagePool final
+{
+public:
+    ImagePool(QImage::Format format, size_t capacity) :
+        format_{ format },
+        capacity_{ capacity }
+    {}
+
+    // Returns a recycled image of the given size if there is one,
+    // otherwise a new image. Contents are undefined.
+    auto acquire(const QSize& size)
+        -> QImage
+    {
+        {
+            auto lock = std::scoped_lock{ mutex_ };
+            auto it = findSize(size, true);
+            if (it != images_.end())
+            {
+                auto result = std::move(*it);
+                images_.erase(it);
+                return result;
+            }
+
+            // The size has changed; free the oldest image before
+            // allocating, it is the least likely to be reused
+            if (!images_.empty())
+                images_.erase(images_.begin());
+        }
+        return QImage{ size, format_ };
+    }
+
+    // The image must not be shared, otherwise painting on it
+    // after acquire() would copy it. When the pool is full, an image
+    // of another size is evicted, or else the image is dropped.
+    auto recycle(QImage image)
+        -> void
+    {
+        if (image.isNull() || image.format() != format_)
+            return;
+        auto lock = std::scoped_lock{ mutex_ };
+        if (images_.size() >= capacity_)
+        {
+            auto it = findSize(image.size(), false);
+            if (it == images_.end())
+                return;
+            images_.erase(it);
+        }
+        images_.push_back(std::move(image));
+    }
+
+private:
+    // The oldest image of (or not of) the given size
+    auto findSize(const QSize& size, bool equal)
+        -> std::vector<QImage>::iterator
+    {
+        return std::find_if(
+            images_.begin(), images_.end(),
+            [&](const QImage& image)
+            { return (image.size() == size) == equal; });
+    }
+
+    QImage::Format format_;
+    size_t capacity_;
+    std::mutex mutex_;
+    std::vector<QImage> images_;
+};
+
+
+// Per-worker state reused across batch frames, so that a worker
+// rendering frames of similar complexity does no heap allocation
+// in the steady state
+struct RenderContext
+{
+    BatchLine frame;
+    RenderScratch scratch;
+};
@@ -0,0 +1,122 @@
+#include "render_cost.hpp"
+
+#include "fractal_cost.hpp"
+
+#include <QPainterPath>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+constexpr auto pathElementBytes = double{ sizeof(QPainterPath::Element) };
+
+auto describe(const EngineCost& cost)
+    -> std::string
+{
+    auto s = std::ostringstream{};
+    s.precision(3);
+    s << cost.vertexCount << " vertices, ~" << cost.seconds << " s, "
+      << cost.memoryBytes / (1 << 20) << " MiB";
+    return s.str();
+}
+
+} // anonymous namespace
+
+
+
+auto vertexBudget(const FractalViewParam& param, double vertexRate)
+    -> double
+{
+    auto result = std::numeric_limits<double>::infinity();
+    if (param.vertexBudget > 0)
+        result = param.vertexBudget;
+    if (param.timeBudgetMs > 0)
+    {
+        if (!(vertexRate > 0))
+            vertexRate = defaultVertexRate;
+        result = std::min(result, 1e-3 * param.timeBudgetMs * vertexRate);
+    }
+    return result;
+}
+
+auto exactDrawnVertexCount(std::span<const Vec2d> base,
+                           std::span<const Vec2d> gen,
+                           size_t generations,
+                           bool allGenerations)
+    -> double
+{
+    auto result = 0.;
+    for (size_t g = allGenerations? 0: generations; g<=generations; ++g)
+        result += exactVertexCount(base, gen, g);
+    return result;
+}
+
+auto estimateRenderCost(std::span<const Vec2d> base,
+                        std::span<const Vec2d> gen,
+                        const FractalViewParam& param,
+                        double scale,
+                        double vertexRate)
+    -> RenderCostEstimate
+{
+    if (!(vertexRate > 0))
+        vertexRate = defaultVertexRate;
+
+    auto result = RenderCostEstimate{};
+
+    // The painter path is reused by consecutive polylines,
+    // so the largest one determines the memory
+    auto& exact = result.exact;
+    exact.vertexCount = exactDrawnVertexCount(
+        base, gen, param.generations, param.allGenerations);
+    exact.memoryBytes =
+        exactVertexCount(base, gen, param.generations) * pathElementBytes;
+    exact.seconds = exact.vertexCount / vertexRate;
+
+    auto& approx = result.approx;
+    approx.vertexCount = std::min(
+        estimateApproxVertexCount(
+            base, gen, 1. / scale, param.approxAlgorithmMaxGen),
+        static_cast<double>(param.approxAlgorithmMaxVertexCount));
+    approx.memoryBytes = approx.vertexCount * pathElementBytes;
+    approx.seconds = approx.vertexCount / vertexRate;
+
+    return result;
+}
+
+auto chooseEngine(const FractalViewParam& param,
+                  const RenderCostEstimate& cost,
+                  double vertexBudget)
+    -> EngineChoice
+{
+    if (param.approxAlgorithm)
+        return { .approx = true };
+
+    auto limit = std::min(
+        vertexBudget,
+        static_cast<double>(param.approxAlgorithmMaxVertexCount));
+    if (cost.exact.vertexCount <= limit)
+        return {};
+
+    if (param.autoEngine)
+        return {
+            .approx = true,
+            .switched = true,
+            .warning = "Exact engine would draw " + describe(cost.exact) +
+                       "; switched to the approximate engine" };
+
+    // Budget mode renders fewer generations
+    if (std::isfinite(vertexBudget))
+        return {};
+
+    if (cost.exact.seconds > maxExactRenderSeconds)
+        return {
+            .refused = true,
+            .warning = "Exact engine would draw " + describe(cost.exact) +
+                       "; refused. Reduce generations, set a budget, "
+                       "or enable the approximate or automatic engine" };
+
+    return { .warning = "Exact engine draws " + describe(cost.exact) };
+}
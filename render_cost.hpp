@@ -0,0 +1,69 @@
+#pragma once
+
+#include "fractalview_param.h"
+#include "vec2.hpp"
+
+#include <span>
+#include <string>
+
+// Cost of renderFractal() predicted before it starts, so that a generation
+// number too large for the exact engine does not lock the application up
+
+// Vertices per second assumed for time budgets until measured
+constexpr inline auto defaultVertexRate = 5e6;
+
+// Exact rendering predicted to take longer than this is refused,
+// unless the engine is switched automatically or a budget limits it
+constexpr inline auto maxExactRenderSeconds = 30.;
+
+// Vertex budget following from param.vertexBudget and param.timeBudgetMs;
+// infinity if there is no budget
+auto vertexBudget(const FractalViewParam& param, double vertexRate)
+    -> double;
+
+// Vertices drawn by the exact engine, summed over the polylines drawn
+auto exactDrawnVertexCount(std::span<const Vec2d> base,
+                           std::span<const Vec2d> gen,
+                           size_t generations,
+                           bool allGenerations)
+    -> double;
+
+struct EngineCost
+{
+    double vertexCount{};   // Vertices drawn
+    double memoryBytes{};   // Peak painter path size
+    double seconds{};       // Path building and stroking
+};
+
+struct RenderCostEstimate
+{
+    EngineCost exact;
+    EngineCost approx;
+};
+
+// scale is pixels per curve unit, as returned by fractalViewTransform();
+// vertexRate is measured vertices per second, 0 if unknown
+auto estimateRenderCost(std::span<const Vec2d> base,
+                        std::span<const Vec2d> gen,
+                        const FractalViewParam& param,
+                        double scale,
+                        double vertexRate)
+    -> RenderCostEstimate;
+
+// Engine renderFractal() uses: the one requested, unless the exact engine
+// exceeds approxAlgorithmMaxVertexCount or the budget. Then, the approximate
+// engine is used if param.autoEngine is set; otherwise, the exact engine
+// renders fewer generations if there is a budget, and is refused if it
+// takes longer than maxExactRenderSeconds.
+struct EngineChoice
+{
+    bool approx{};
+    bool switched{};        // To the approximate engine, by autoEngine
+    bool refused{};         // Nothing is to be rendered
+    std::string warning;    // Empty if there is nothing to warn about
+};
+
+auto chooseEngine(const FractalViewParam& param,
+                  const RenderCostEstimate& cost,
+                  double vertexBudget)
+    -> EngineChoice;
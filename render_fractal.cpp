@@ -1,30 +1,188 @@
 #include "render_fractal.hpp"
 
 #include "bbox2.hpp"
+#include "fractal_cost.hpp"
 #include "fractal_iter.hpp"
+#include "geometry_cache.hpp"
+#include "throw.hpp"
+#include "trace.hpp"
 #include "vec2_qt.hpp"
+#include "vertex_file.hpp"
+#include "vertex_pack.hpp"
 
 #include <QPainter>
 #include <QPainterPath>
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <optional>
+#include <ostream>
 
 namespace {
 
+using clock = std::chrono::steady_clock;
+
 struct FractalPolyLineInfo final
 {
     size_t vertexCount{};
     size_t maxGen{};
+    std::chrono::nanoseconds pathTime{};
+    std::chrono::nanoseconds strokeTime{};
+    size_t allocatedBytes{};
+    FractalIterStats stats;
 };
 
+// Coverage culling of a polyline: FractalApprox subtrees whose bounds are
+// painted already are not refined, as that would only repaint their pixels
+class CoverageCulling final
+{
+public:
+    CoverageCulling(CoverageMask& mask,
+                    const QRect& rect,
+                    const FractalViewTransform& view,
+                    std::span<const Vec2d> gen,
+                    double minLength,
+                    double penWidth) :
+        mask_{ mask },
+        transform_{ view.transform * QTransform::fromTranslate(
+            -rect.left(), -rect.top()) },
+        scale_{ view.scale },
+        boundRadius_{ attractorBoundRadius(gen) },
+        dimension_{ std::max(similarityDimension(gen), 1.) },
+        minLength_{ minLength },
+        penWidth_{ std::max(penWidth, 1.) }
+    {
+        mask_.reset(rect.width(), rect.height());
+    }
+
+    // For FractalApproxParam::isCovered
+    auto predicate()
+        -> std::function<bool(const Vec2d&, double)>
+    { return [this](const Vec2d& c, double r) { return isCovered(c, r); }; }
+
+    // Called for each vertex drawn
+    auto mark(const Vec2d& v)
+        -> void
+    {
+        auto p = toVec2d(transform_.map(toQPointF(v)));
+        if (hasLast_)
+            mask_.markSegment(last_, p, penWidth_);
+        last_ = p;
+        hasLast_ = true;
+    }
+
+    auto skipCount() const noexcept
+        -> size_t
+    { return skipCount_; }
+
+    auto savedVertices() const noexcept
+        -> double
+    { return savedVertices_; }
+
+private:
+    auto isCovered(const Vec2d& center, double radius)
+        -> bool
+    {
+        auto c = toVec2d(transform_.map(toQPointF(center)));
+        auto r = radius * scale_;
+        if (!mask_.isCovered(c[0] - r, c[1] - r, c[0] + r, c[1] + r))
+            return false;
+
+        // The subtree would have about (length / minLength)^D vertices,
+        // its chord is drawn instead
+        auto length = radius / boundRadius_;
+        ++skipCount_;
+        savedVertices_ +=
+            std::pow(std::max(length / minLength_, 1.), dimension_) - 1;
+        return true;
+    }
+
+    CoverageMask& mask_;
+    QTransform transform_;
+    double scale_;
+    double boundRadius_;
+    double dimension_;
+    double minLength_;
+    double penWidth_;
+    Vec2d last_;
+    bool hasLast_{};
+    size_t skipCount_{};
+    double savedVertices_{};
+};
+
+// Progress of a renderFractal() call, reported through RenderControl.
+// Polled every stopCheckInterval vertices, so reading the clock costs
+// next to nothing.
+class ProgressReporter final
+{
+public:
+    ProgressReporter(const RenderControl& control,
+                     double expectedVertexCount) :
+        control_{ control },
+        expectedVertexCount_{ expectedVertexCount },
+        lastReport_{ clock::now() }
+    {}
+
+    // Called while drawing a polyline, with its vertex count so far
+    auto poll(size_t vertexCount)
+        -> void
+    {
+        auto now = clock::now();
+        if (now - lastReport_ < control_.progressInterval)
+            return;
+        lastReport_ = now;
+        report(doneVertexCount_ + vertexCount);
+    }
+
+    auto polyLineDone(size_t vertexCount) noexcept
+        -> void
+    { doneVertexCount_ += vertexCount; }
+
+    auto finish(bool complete)
+        -> void
+    { report(doneVertexCount_, complete); }
+
+private:
+    auto report(size_t vertexCount, bool complete = false)
+        -> void
+    {
+        auto fraction = complete? 1.: std::min(
+            vertexCount / std::max(expectedVertexCount_, 1.), 0.99);
+        control_.progress({ vertexCount, fraction });
+    }
+
+    const RenderControl& control_;
+    double expectedVertexCount_;
+    size_t doneVertexCount_{};
+    clock::time_point lastReport_;
+};
+
+auto strokePolyLine(QPainter& painter, const QPainterPath& path, QPen pen)
+    -> void
+{
+    pen.setCosmetic(true);
+    auto span = TraceSpan{ "stroke path" };
+    painter.strokePath(path, pen);
+}
+
 template <typename Range>
 auto drawPolyLine(QPainter& painter,
+                  QPainterPath& path,
                   const Range& polyline,
-                  QPen pen)
+                  QPen pen,
+                  CoverageCulling* coverage = nullptr,
+                  ProgressReporter* progress = nullptr)
     -> FractalPolyLineInfo
 {
-    auto path =
-        QPainterPath{};
+    auto time_0 = clock::now();
+    auto pathSpan = std::optional<TraceSpan>{ std::in_place, "build path" };
+
+    // Keeps the memory allocated for the previous polyline
+    path.clear();
 
     auto it = polyline.begin();
     auto end = polyline.end();
@@ -34,24 +192,556 @@ auto drawPolyLine(QPainter& painter,
     path.moveTo(toQPointF(*it));
 
     size_t vertexCount = 1;
-    for (++it; it!=end; ++it, ++vertexCount)
-        path.lineTo(toQPointF(*it));
+    auto poll = [&]
+    {
+        if (progress && (vertexCount & (stopCheckInterval - 1)) == 0)
+            progress->poll(vertexCount);
+    };
+    if (coverage)
+    {
+        // Marked before the iterator decides on refining the next segment
+        coverage->mark(*it);
+        for (++it; it!=end; ++it, ++vertexCount)
+        {
+            path.lineTo(toQPointF(*it));
+            coverage->mark(*it);
+            poll();
+        }
+    }
+    else
+        for (++it; it!=end; ++it, ++vertexCount)
+        {
+            path.lineTo(toQPointF(*it));
+            poll();
+        }
 
-    pen.setCosmetic(true);
-    painter.strokePath(path, pen);
+    auto time_1 = clock::now();
+    pathSpan.reset();
+
+    strokePolyLine(painter, path, pen);
+
+    auto time_2 = clock::now();
+
+    auto stats = it.impl().stats();
+    auto allocatedBytes =
+        path.elementCount() * sizeof(QPainterPath::Element) +
+        stats.stateBytes;
+
+    return {
+        .vertexCount = vertexCount,
+        .maxGen = it.impl().actualMaxGen(),
+        .pathTime = time_1 - time_0,
+        .strokeTime = time_2 - time_1,
+        .allocatedBytes = allocatedBytes,
+        .stats = std::move(stats)
+    };
+}
+
+// Reserving the expected vertex count halves the cost of recording
+template <typename Range>
+auto recordPolyLine(const Range& polyline,
+                    double expectedVertexCount,
+                    ProgressReporter* progress = nullptr)
+    -> std::shared_ptr<const CachedPolyLine>
+{
+    auto span = TraceSpan{ "record polyline" };
+    auto result = std::make_shared<CachedPolyLine>();
+    auto& vertices = result->vertices;
+    vertices.reserve(static_cast<size_t>(
+        std::clamp(expectedVertexCount, 1., 1e9)));
+    auto it = polyline.begin();
+    for (auto end=polyline.end(); it!=end; ++it)
+    {
+        vertices.push_back(*it);
+        if (progress && (vertices.size() & (stopCheckInterval - 1)) == 0)
+            progress->poll(vertices.size());
+    }
+    if (vertices.capacity() > vertices.size() + vertices.size() / 4)
+        vertices.shrink_to_fit();
+    result->maxGen = it.impl().actualMaxGen();
+    result->stats = it.impl().stats();
+    return result;
+}
+
+auto drawCachedPolyLine(QPainter& painter,
+                        QPainterPath& path,
+                        const CachedPolyLine& polyline,
+                        QPen pen)
+    -> FractalPolyLineInfo
+{
+    auto time_0 = clock::now();
+    {
+        auto span = TraceSpan{ "build path" };
+        path.clear();
+        const auto& vertices = polyline.vertices;
+        path.moveTo(toQPointF(vertices.front()));
+        for (size_t i=1, n=vertices.size(); i<n; ++i)
+            path.lineTo(toQPointF(vertices[i]));
+    }
+
+    auto time_1 = clock::now();
+
+    strokePolyLine(painter, path, pen);
+
+    auto time_2 = clock::now();
+
+    auto allocatedBytes =
+        path.elementCount() * sizeof(QPainterPath::Element) +
+        polyline.vertices.size() * sizeof(Vec2d);
+
+    return {
+        .vertexCount = polyline.vertices.size(),
+        .maxGen = polyline.maxGen,
+        .pathTime = time_1 - time_0,
+        .strokeTime = time_2 - time_1,
+        .allocatedBytes = allocatedBytes,
+        .stats = polyline.stats
+    };
+}
 
-    return { vertexCount, it.impl().actualMaxGen() };
+// Rounds a FractalApprox tolerance to a quarter power of two, so that
+// cached polylines are reused across nearby scales; down at full quality,
+// to stay within a pixel, and up when a budget limits it. Quarter steps
+// cost at most 2^(D/4) times the vertices (19% for D = 1.26, 41% for D = 2).
+// Done with or without a geometry cache, so that images do not depend on it.
+auto quantizedMinLength(double minLength, bool budgetLimited)
+    -> double
+{
+    auto e = 4 * std::log2(minLength);
+    return std::exp2((budgetLimited? std::ceil(e): std::floor(e)) / 4);
 }
 
+auto accumulate(RenderFractlalResult& result, const FractalPolyLineInfo& info)
+    -> void
+{
+    result.pathTime += info.pathTime;
+    result.strokeTime += info.strokeTime;
+    result.vertexCount = info.vertexCount;
+    result.maxGen = info.maxGen;
+
+    const auto& h = info.stats.genVertexCount;
+    if (result.genVertexCount.size() < h.size())
+        result.genVertexCount.resize(h.size(), 0);
+    for (size_t gen=0, n=h.size(); gen<n; ++gen)
+        result.genVertexCount[gen] += h[gen];
+
+    result.pushCount += info.stats.pushCount;
+    result.popCount += info.stats.popCount;
+    result.peakAllocatedBytes =
+        std::max(result.peakAllocatedBytes, info.allocatedBytes);
+    result.truncated = result.truncated || info.stats.truncated;
+    result.cancelled = result.cancelled || info.stats.cancelled;
+}
+
+auto generationPen(const FractalViewParam& param,
+                   size_t gen,
+                   size_t generations)
+    -> QPen
+{
+    if (!param.fancyPen)
+        return {};
+
+    auto width = double(1 << (generations-gen));
+    auto hue = static_cast<double>(gen) / (generations+1);
+    auto alpha = static_cast<double>(gen+1) / (generations+1);
+    auto color = QColor::fromHsvF(hue, 0.8, 0.8, alpha);
+    return { color, width };
+}
+
+// Pixel mirroring of a symmetric curve: the half curve is stroked on
+// a transparent layer, which is merged with its mirror image. Applies if
+// the symmetry axis is a pixel row or column boundary or center; pixel
+// i is mirrored to pixel twiceAxis - 1 - i.
+struct PixelMirror final
+{
+    bool mirrorColumns;     // Vertical axis
+    int twiceAxis;          // In layer coordinates
+    QRect layerRect;        // Symmetric about the axis, contains the rect
+};
+
+auto pixelMirror(const QRect& rect,
+                 const QTransform& transform,
+                 const Vec2d& chordStart,
+                 const Vec2d& chordEnd)
+    -> std::optional<PixelMirror>
+{
+    auto a = toVec2d(transform.map(toQPointF(chordStart)));
+    auto b = toVec2d(transform.map(toQPointF(chordEnd)));
+    auto d = b - a;
+    auto length = d.norm();
+    if (!(length >= 1))
+        return std::nullopt;
+
+    auto mirrorColumns = std::abs(d[1]) <= 1e-6 * length;
+    if (!mirrorColumns && std::abs(d[0]) > 1e-6 * length)
+        return std::nullopt;
+
+    auto twiceAxis = (a + b)[mirrorColumns? 0: 1];
+    auto i2 = std::lround(twiceAxis);
+    if (std::abs(twiceAxis - i2) > 1e-3)
+        return std::nullopt;
+
+    // Pixels [lo, hi] are mirrored to [i2-1-hi, i2-1-lo]
+    auto lo = mirrorColumns? rect.left(): rect.top();
+    auto hi = mirrorColumns? rect.right(): rect.bottom();
+    auto layerLo = std::min<long>(lo, i2 - 1 - hi);
+    auto layerHi = std::max<long>(hi, i2 - 1 - lo);
+
+    // Not worth it if the axis is far from the rect center
+    if (layerHi - layerLo + 1 > 2 * (hi - lo + 1))
+        return std::nullopt;
+
+    auto layerRect = mirrorColumns
+        ? QRect{ static_cast<int>(layerLo), rect.top(),
+                 static_cast<int>(layerHi - layerLo + 1), rect.height() }
+        : QRect{ rect.left(), static_cast<int>(layerLo),
+                 rect.width(), static_cast<int>(layerHi - layerLo + 1) };
+    return PixelMirror{
+        .mirrorColumns = mirrorColumns,
+        .twiceAxis = static_cast<int>(i2 - 2 * layerLo),
+        .layerRect = layerRect };
+}
+
+// Merging the layer takes a few passes over its pixels; stroking costs
+// about as much per vertex as tens of pixels
+auto isWorthMirroring(const PixelMirror& mirror, double vertexCount)
+    -> bool
+{
+    const auto& r = mirror.layerRect;
+    return vertexCount >= 0.25 * r.width() * r.height();
+}
+
+// Union of premultiplied pixels of the same color
+auto maxArgb(uint32_t a, uint32_t b) noexcept
+    -> uint32_t
+{
+    auto result = uint32_t{};
+    for (auto shift=0; shift<32; shift+=8)
+        result |= std::max((a >> shift) & 0xff, (b >> shift) & 0xff) << shift;
+    return result;
+}
+
+auto mergeMirrorImage(QImage& layer, const PixelMirror& mirror)
+    -> void
+{
+    auto w = layer.width();
+    auto h = layer.height();
+    auto line = [&](int y)
+    { return reinterpret_cast<uint32_t*>(layer.scanLine(y)); };
+
+    if (mirror.mirrorColumns)
+        for (auto y=0; y<h; ++y)
+        {
+            auto* px = line(y);
+            for (auto x=0, x2=mirror.twiceAxis-1; x<x2; ++x, --x2)
+                px[x] = px[x2] = maxArgb(px[x], px[x2]);
+        }
+    else
+        for (auto y=0, y2=mirror.twiceAxis-1; y<y2; ++y, --y2)
+        {
+            auto* px = line(y);
+            auto* px2 = line(y2);
+            for (auto x=0; x<w; ++x)
+                px[x] = px2[x] = maxArgb(px[x], px2[x]);
+        }
+}
+
+// Strokes half of a symmetric curve with draw(layerPainter) on the layer,
+// then merges the layer with its mirror image and draws it on the painter
+template <typename Draw>
+auto drawMirrored(QPainter& painter,
+                  const QRect& rect,
+                  const FractalViewTransform& view,
+                  const PixelMirror& mirror,
+                  bool antialiasing,
+                  QImage& layer,
+                  Draw&& draw)
+    -> FractalPolyLineInfo
+{
+    const auto& layerRect = mirror.layerRect;
+    if (layer.size() != layerRect.size())
+        layer = QImage{ layerRect.size(), QImage::Format_ARGB32_Premultiplied };
+    layer.fill(Qt::transparent);
+
+    auto info = FractalPolyLineInfo{};
+    {
+        auto p = QPainter{ &layer };
+        if (antialiasing)
+            p.setRenderHint(QPainter::Antialiasing);
+        p.setTransform(
+            view.transform *
+            QTransform::fromTranslate(-layerRect.left(), -layerRect.top()));
+        info = draw(p);
+    }
+
+    // A truncated or cancelled half has not reached the midpoint
+    if (!info.stats.truncated && !info.stats.cancelled)
+    {
+        auto span = TraceSpan{ "mirror pixels" };
+        mergeMirrorImage(layer, mirror);
+    }
+
+    painter.save();
+    painter.resetTransform();
+    painter.drawImage(
+        QRectF{ rect }, layer,
+        QRectF{ rect.translated(-layerRect.topLeft()) });
+    painter.restore();
+    return info;
+}
+
+auto accumulate(RenderFractlalResult& result, const CoverageCulling* coverage)
+    -> void
+{
+    if (!coverage)
+        return;
+    result.coverageSkipCount += coverage->skipCount();
+    result.coverageSavedVertices += coverage->savedVertices();
+}
+
+template <typename Writer>
+auto writeFractalVertices(Writer& writer,
+                          std::span<const Vec2d> base,
+                          std::span<const Vec2d> gen,
+                          const FractalViewParam& param,
+                          const RenderFractlalResult& render)
+    -> void
+{
+    if (render.refused)
+        throw_("Vertices not exported: ", render.engineWarning);
+
+    auto span = TraceSpan{ "export vertices" };
+    auto write = [&](const auto& polyline)
+    {
+        for (const auto& v: polyline)
+            writer.write(v);
+    };
+
+    if (gen.size() < 2)
+        return;
+
+    auto approxParam = FractalApproxParam{
+        .maxGen = render.approxLod.maxGen,
+        .maxOrdinal = render.approxMaxOrdinal,
+        .minLength = render.approxLod.minLength
+    };
+    if (render.approxEngine && param.balancedRefinement)
+        write(fractalSeq<FractalBalanced>(base, gen, approxParam));
+    else if (render.approxEngine)
+        write(fractalSeq<FractalApprox>(base, gen, approxParam));
+    else
+        write(fractalSeq<FractalNGen>(base, gen, render.generations));
+}
+
+auto seconds(std::chrono::nanoseconds dt)
+    -> double
+{ return std::chrono::duration<double>(dt).count(); }
+
 } // anonymous namespace
 
 
 
+auto totalVertexCount(const RenderFractlalResult& result)
+    -> size_t
+{
+    return std::accumulate(
+        result.genVertexCount.begin(), result.genVertexCount.end(), size_t{});
+}
+
+auto vertexRate(const RenderFractlalResult& result)
+    -> double
+{
+    auto dt = seconds(result.renderTime);
+    return dt > 0? totalVertexCount(result) / dt: 0;
+}
+
+auto reportRenderStats(std::ostream& s, const RenderFractlalResult& result)
+    -> void
+{
+    s << "Computing bounding box: " << seconds(result.computeBbTime) << " s\n"
+      << "Rendering fractal: " << seconds(result.renderTime) << " s\n"
+      << "  path building: " << seconds(result.pathTime) << " s\n"
+      << "  stroking: " << seconds(result.strokeTime) << " s\n"
+      << "Vertices: " << result.vertexCount << '\n'
+      << "Vertices/s: " << static_cast<size_t>(vertexRate(result)) << '\n'
+      << "Vertices per generation:";
+    for (auto count: result.genVertexCount)
+        s << ' ' << count;
+    s << '\n'
+      << "Max. generation: " << result.maxGen << '\n'
+      << "Scale: " << result.scale << '\n'
+      << "Approx. work push/pop: "
+      << result.pushCount << '/' << result.popCount << '\n'
+      << "Peak geometry memory: "
+      << result.peakAllocatedBytes / 1024 << " KiB\n";
+    if (result.vertexBudget > 0)
+    {
+        s << "Vertex budget: " << static_cast<size_t>(result.vertexBudget);
+        if (!result.budgetLimited)
+            s << ", full quality";
+        else if (result.lodTolerance > 0)
+            s << ", tolerance " << result.lodTolerance << " px";
+        else
+            s << ", generations reduced";
+        s << '\n';
+    }
+    s << "Predicted vertices: exact " << result.cost.exact.vertexCount
+      << ", approx. " << result.cost.approx.vertexCount << '\n'
+      << "Engine: " << (result.approxEngine? "approximate": "exact") << '\n';
+    if (result.mirrored)
+        s << "Symmetry: half of the curve stroked, pixels mirrored\n";
+    if (result.geometryCacheHits > 0)
+        s << "Geometry cache: " << result.geometryCacheHits
+          << " polylines reused\n";
+    if (result.coverageSkipCount > 0)
+    {
+        auto saved = result.coverageSavedVertices;
+        s << "Coverage culling: " << result.coverageSkipCount
+          << " subtrees skipped, ~" << static_cast<size_t>(saved)
+          << " vertices ("
+          << std::lround(100 * saved / (saved + totalVertexCount(result)))
+          << "%) saved\n";
+    }
+    if (!result.engineWarning.empty())
+        s << (result.refused? "ERROR: ": "WARNING: ")
+          << result.engineWarning << '\n';
+    if (result.truncated)
+        s << "WARNING: truncated at max. vertex count\n";
+    if (result.cancelled)
+        s << "WARNING: cancelled, the image is incomplete\n";
+}
+
+
+
+auto fractalViewTransform(const QRect& rect,
+                          std::span<const Vec2d> base,
+                          std::span<const Vec2d> gen,
+                          const FractalViewParam& param,
+                          MonotonicArena* arena,
+                          GeometryCache* geometryCache)
+    -> FractalViewTransform
+{
+    auto span = TraceSpan{ "bounding box" };
+    auto bb = Bbox2d {};
+    auto bboxGen =
+        param.approxAlgorithmMaxGen
+            ? param.approxAlgorithmBboxGen
+            : param.generations;
+    auto key = GeometryKey{
+        .curve = geometryCache? geometryCurveHash(base, gen): 0,
+        .kind = GeometryKey::Kind::Bbox,
+        .maxGen = bboxGen };
+    if (auto cached = geometryCache? geometryCache->find(key): nullptr)
+        bb << cached->vertices[0] << cached->vertices[1];
+    else
+    {
+        for (const auto& v: fractalSeq<FractalNGen>(base, gen, bboxGen, arena))
+            bb << v;
+        if (geometryCache && !bb.empty)
+            geometryCache->insert(key, std::make_shared<CachedPolyLine>(
+                CachedPolyLine{ .vertices = { bb.min, bb.max } }));
+    }
+
+    auto c_bb = bb.center();
+    auto bb_margin = 0.55 * bb.size();
+    bb << c_bb - bb_margin << c_bb + bb_margin;
+
+    auto r_rc = static_cast<double>(rect.width()) / rect.height();
+    auto r_bb = bb.size(0) / bb.size(1);
+    auto scale = r_bb > r_rc
+        ?  rect.width() / bb.size(0)
+        : rect.height() / bb.size(1);
+    scale /= param.adjustScale;
+    auto c_rc = toVec2d(rect.center());
+
+    auto t = QTransform{};
+    t
+        .translate(c_rc[0], c_rc[1])
+        .scale(scale, scale)
+        .translate(-c_bb[0], -c_bb[1]);
+    return { scale, t };
+}
+
+auto planFractalRender(std::span<const Vec2d> base,
+                       std::span<const Vec2d> gen,
+                       const FractalViewParam& param,
+                       double scale,
+                       double vertexRate)
+    -> RenderFractlalResult
+{
+    auto result = RenderFractlalResult{};
+    result.scale = scale;
+
+    auto budget = vertexBudget(param, vertexRate);
+    if (std::isfinite(budget))
+        result.vertexBudget = budget;
+
+    {
+        auto span = TraceSpan{ "choose engine" };
+        result.cost = estimateRenderCost(base, gen, param, scale, vertexRate);
+        auto engine = chooseEngine(param, result.cost, budget);
+        result.approxEngine = engine.approx;
+        result.engineSwitched = engine.switched;
+        result.refused = engine.refused;
+        result.engineWarning = std::move(engine.warning);
+    }
+
+    if (result.refused)
+        return result;
+
+    // Tolerance of one pixel at full quality
+    auto finest = ApproxLod{ 1. / scale, param.approxAlgorithmMaxGen };
+    if (result.approxEngine && param.balancedRefinement)
+    {
+        // The budget limits the vertex count rather than the tolerance,
+        // spending it on the longest segments wherever they are
+        result.approxLod = {
+            quantizedMinLength(finest.minLength, false), finest.maxGen };
+        result.approxMaxOrdinal = param.approxAlgorithmMaxVertexCount;
+        if (budget < static_cast<double>(result.approxMaxOrdinal))
+            result.approxMaxOrdinal =
+                std::max<size_t>(static_cast<size_t>(budget), 2);
+    }
+    else if (result.approxEngine)
+    {
+        auto lod = finest;
+        if (std::isfinite(budget))
+        {
+            auto span = TraceSpan{ "fit budget" };
+            lod = approxLodForBudget(base, gen, finest, budget);
+            result.budgetLimited =
+                lod.minLength > finest.minLength || lod.maxGen < finest.maxGen;
+        }
+        if (!param.coverageCulling)
+            lod.minLength =
+                quantizedMinLength(lod.minLength, result.budgetLimited);
+        if (std::isfinite(budget))
+            result.lodTolerance = lod.minLength * scale;
+        result.approxLod = lod;
+        result.approxMaxOrdinal = param.approxAlgorithmMaxVertexCount;
+    }
+    else
+    {
+        auto generations = param.generations;
+        while (generations > 0 &&
+               exactDrawnVertexCount(
+                   base, gen, generations, param.allGenerations) > budget)
+        {
+            --generations;
+            result.budgetLimited = true;
+        }
+        result.generations = generations;
+    }
+    return result;
+}
+
 auto renderFractal(QPainter& p,
                    const QRect& rect,
                    std::span<const Vec2d> base,
                    std::span<const Vec2d> gen,
-                   const FractalViewParam& param)
+                   const FractalViewParam& param,
+                   RenderScratch* scratch,
+                   const RenderControl* control)
     -> RenderFractlalResult
 {
     p.fillRect(rect, Qt::white);
@@ -59,85 +749,392 @@ auto renderFractal(QPainter& p,
     if (gen.size() < 2)
         return {};
 
-    using clock = std::chrono::steady_clock;
     auto time_0 = clock::now();
 
+    auto localScratch = std::optional<RenderScratch>{};
+    if (!scratch)
+        scratch = &localScratch.emplace();
+
+    // Nothing allocated by the previous call is alive any more
+    auto arena = &scratch->arena;
+    arena->reset();
+
+    auto stop = control? control->stop: std::stop_token{};
+
     auto fseq = [&](size_t maxGen)
-    { return fractalSeq<FractalNGen>(base, gen, maxGen); };
+    { return fractalSeq<FractalNGen>(base, gen, maxGen, arena, stop); };
+
+    auto fseqHalf = [&](size_t maxGen)
+    {
+        return fractalSeq<FractalHalf<FractalNGen>>(
+            base, gen, maxGen, arena, stop);
+    };
+
+    auto approxParam = [&](const ApproxLod& lod, CoverageCulling* coverage)
+    {
+        return FractalApproxParam{
+            .maxGen = lod.maxGen,
+            .maxOrdinal = param.approxAlgorithmMaxVertexCount,
+            .minLength = lod.minLength,
+            .arena = arena,
+            .isCovered = coverage? coverage->predicate(): nullptr,
+            .stop = stop
+        };
+    };
 
-    auto fseqApprox = [&](double scale)
+    auto fseqApprox = [&](const ApproxLod& lod, CoverageCulling* coverage)
     {
         return fractalSeq<FractalApprox>(
-            base,
-            gen,
-            FractalApproxParam{
-                .maxGen = param.approxAlgorithmMaxGen,
-                .maxOrdinal = param.approxAlgorithmMaxVertexCount,
-                .minLength = 1. / scale
-            } );
+            base, gen, approxParam(lod, coverage));
     };
 
-    double scale;
+    auto fseqApproxHalf = [&](const ApproxLod& lod, CoverageCulling* coverage)
     {
-        auto bb = Bbox2d {};
-        auto bboxGen =
-            param.approxAlgorithmMaxGen
-                ? param.approxAlgorithmBboxGen
-                : param.generations;
-        for (const auto& v: fseq(bboxGen))
-            bb << v;
+        auto halfParam = approxParam(lod, coverage);
+        halfParam.maxOrdinal = (halfParam.maxOrdinal + 1) / 2;
+        return fractalSeq<FractalHalf<FractalApprox>>(base, gen, halfParam);
+    };
 
-        auto c_bb = bb.center();
-        auto bb_margin = 0.55 * bb.size();
-        bb << c_bb - bb_margin << c_bb + bb_margin;
-
-        auto r_rc = static_cast<double>(rect.width()) / rect.height();
-        auto r_bb = bb.size(0) / bb.size(1);
-        scale = r_bb > r_rc
-            ?  rect.width() / bb.size(0)
-            : rect.height() / bb.size(1);
-        scale /= param.adjustScale;
-        auto c_rc = toVec2d(rect.center());
-
-        auto t = QTransform{};
-        t
-            .translate(c_rc[0], c_rc[1])
-            .scale(scale, scale)
-            .translate(-c_bb[0], -c_bb[1]);
-        p.setTransform(t);
-    }
+    auto fseqBalanced = [&](const ApproxLod& lod, size_t maxOrdinal)
+    {
+        auto balancedParam = approxParam(lod, nullptr);
+        balancedParam.maxOrdinal = maxOrdinal;
+        return fractalSeq<FractalBalanced>(base, gen, balancedParam);
+    };
+
+    auto* geometryCache = scratch->geometryCache;
+    auto view = fractalViewTransform(
+        rect, base, gen, param, arena, geometryCache);
+    auto scale = view.scale;
+    p.setTransform(view.transform);
     auto time_1 = clock::now();
 
     if (param.antialiasing)
         p.setRenderHint(QPainter::Antialiasing);
 
-    auto polylineInfo = FractalPolyLineInfo{};
-    if (param.approxAlgorithm)
-        polylineInfo = drawPolyLine(p, fseqApprox(scale), QPen{});
+    auto result = planFractalRender(
+        base, gen, param, scale, scratch->vertexRate);
+    auto budget = vertexBudget(param, scratch->vertexRate);
+
+    // Created once the expected vertex count is known
+    auto progress = std::optional<ProgressReporter>{};
+    auto startProgress = [&](double expectedVertexCount)
+    {
+        if (control && control->progress)
+            progress.emplace(*control, expectedVertexCount);
+    };
+    auto pr = [&]() -> ProgressReporter*
+    { return progress? &*progress: nullptr; };
+
+    // Draws the polyline makeSeq() generates, or its cached vertices;
+    // polylines cut short by a stop request are not cached, and those
+    // expected too large to cache are drawn without recording them
+    auto curveHash = geometryCache? geometryCurveHash(base, gen): 0;
+    auto drawGeometry = [&](QPainter& painter,
+                            GeometryKey key,
+                            const auto& makeSeq,
+                            double expectedVertexCount,
+                            const QPen& pen,
+                            CoverageCulling* coverage = nullptr)
+        -> FractalPolyLineInfo
+    {
+        auto info = FractalPolyLineInfo{};
+        if (!geometryCache || coverage ||
+            !geometryCache->accepts(expectedVertexCount * sizeof(Vec2d)))
+            info = drawPolyLine(
+                painter, scratch->path, makeSeq(), pen, coverage, pr());
+        else
+        {
+            key.curve = curveHash;
+            auto polyline = geometryCache->find(key);
+            if (polyline)
+                ++result.geometryCacheHits;
+            else
+            {
+                polyline = recordPolyLine(
+                    makeSeq(), expectedVertexCount, pr());
+                if (!polyline->stats.cancelled)
+                    geometryCache->insert(key, polyline);
+            }
+            info = drawCachedPolyLine(painter, scratch->path, *polyline, pen);
+        }
+        if (progress)
+            progress->polyLineDone(info.vertexCount);
+        return info;
+    };
+
+    if (result.refused)
+    {
+        result.computeBbTime = time_1 - time_0;
+        return result;
+    }
+
+    // FractalApprox traverses the first base segment only
+    auto mirror = std::optional<PixelMirror>{};
+    if (param.mirrorSymmetry && isMirrorSymmetric(gen))
+    {
+        auto curveBase = result.approxEngine? base.first(2): base;
+        if (isMirrorSymmetric(curveBase))
+            mirror = pixelMirror(
+                rect, view.transform, curveBase.front(), curveBase.back());
+    }
+
+    if (result.approxEngine && param.balancedRefinement)
+    {
+        auto lod = result.approxLod;
+        auto maxOrdinal = result.approxMaxOrdinal;
+        auto byBudget = maxOrdinal < param.approxAlgorithmMaxVertexCount;
+        startProgress(std::min(
+            result.cost.approx.vertexCount, static_cast<double>(maxOrdinal)));
+
+        auto key = GeometryKey{
+            .kind = GeometryKey::Kind::Balanced,
+            .maxGen = lod.maxGen,
+            .maxOrdinal = maxOrdinal,
+            .minLength = lod.minLength };
+        auto expectedVertexCount = geometryCache
+            ? std::min(
+                estimateApproxVertexCount(base, gen, lod.minLength, lod.maxGen),
+                static_cast<double>(maxOrdinal))
+            : 0.;
+        accumulate(result, drawGeometry(
+            p, key, [&]{ return fseqBalanced(lod, maxOrdinal); },
+            expectedVertexCount, QPen{}));
+
+        // Detail is lowered evenly, so nothing of the curve is missing
+        if (byBudget && result.truncated)
+        {
+            result.truncated = false;
+            result.budgetLimited = true;
+        }
+    }
+    else if (result.approxEngine)
+    {
+        auto lod = result.approxLod;
+        auto vertexCount = std::min(result.cost.approx.vertexCount, budget);
+        auto isMirrored = mirror && isWorthMirroring(*mirror, vertexCount);
+        startProgress(isMirrored? vertexCount / 2: vertexCount);
+
+        auto coverage = std::optional<CoverageCulling>{};
+        if (param.coverageCulling)
+            coverage.emplace(
+                scratch->coverage,
+                isMirrored? mirror->layerRect: rect,
+                view, gen, lod.minLength, 1.);
+        auto* c = coverage? &*coverage: nullptr;
+        auto key = GeometryKey{
+            .kind = GeometryKey::Kind::Approx,
+            .maxGen = lod.maxGen,
+            .maxOrdinal = param.approxAlgorithmMaxVertexCount,
+            .minLength = lod.minLength };
+        auto expectedVertexCount = geometryCache
+            ? std::min(
+                estimateApproxVertexCount(base, gen, lod.minLength, lod.maxGen),
+                static_cast<double>(param.approxAlgorithmMaxVertexCount))
+            : 0.;
+        if (isMirrored)
+        {
+            key.kind = GeometryKey::Kind::ApproxHalf;
+            accumulate(result, drawMirrored(
+                p, rect, view, *mirror, param.antialiasing,
+                scratch->mirrorLayer,
+                [&](QPainter& layerPainter)
+                {
+                    return drawGeometry(
+                        layerPainter, key,
+                        [&]{ return fseqApproxHalf(lod, c); },
+                        expectedVertexCount / 2, QPen{}, c);
+                }));
+            result.mirrored = true;
+        }
+        else
+            accumulate(result, drawGeometry(
+                p, key, [&]{ return fseqApprox(lod, c); },
+                expectedVertexCount, QPen{}, c));
+        accumulate(result, c);
+    }
     else
     {
-        size_t gen = param.allGenerations? 0: param.generations;
-        for (; gen<=param.generations; ++gen)
+        auto generations = result.generations;
+        auto vertexCount = [&](size_t generation)
+        { return exactVertexCount(base, gen, generation); };
+
+        auto isMirrored = [&](size_t generation)
         {
-            auto pen = QPen{};
-            if (param.fancyPen)
+            return mirror && isWorthMirroring(*mirror, vertexCount(generation));
+        };
+
+        size_t firstGen = param.allGenerations? 0: generations;
+        if (control && control->progress)
+        {
+            auto drawnVertexCount = 0.;
+            for (auto g=firstGen; g<=generations; ++g)
+                drawnVertexCount +=
+                    isMirrored(g)? vertexCount(g) / 2 + 1: vertexCount(g);
+            startProgress(drawnVertexCount);
+        }
+
+        for (auto gen=firstGen; gen<=generations && !result.cancelled; ++gen)
+        {
+            auto pen = generationPen(param, gen, generations);
+            if (isMirrored(gen))
             {
-                auto width = double(1 << (param.generations-gen));
-                auto hue = static_cast<double>(gen) / (param.generations+1);
-                auto alpha = static_cast<double>(gen+1) / (param.generations+1);
-                auto color = QColor::fromHsvF(hue, 0.8, 0.8, alpha);
-                pen = QPen{ color, width };
+                accumulate(result, drawMirrored(
+                    p, rect, view, *mirror, param.antialiasing,
+                    scratch->mirrorLayer,
+                    [&](QPainter& layerPainter)
+                    {
+                        return drawGeometry(
+                            layerPainter,
+                            { .kind = GeometryKey::Kind::ExactHalf,
+                              .maxGen = gen },
+                            [&]{ return fseqHalf(gen); },
+                            vertexCount(gen) / 2 + 1, pen);
+                    }));
+                result.mirrored = true;
             }
-            polylineInfo = drawPolyLine(p, fseq(gen), pen);
+            else
+                accumulate(result, drawGeometry(
+                    p,
+                    { .kind = GeometryKey::Kind::Exact, .maxGen = gen },
+                    [&]{ return fseq(gen); },
+                    vertexCount(gen), pen));
         }
     }
     auto time_2 = clock::now();
 
-    return {
-        .computeBbTime = time_1 - time_0,
-        .renderTime = time_2 - time_1,
-        .vertexCount = polylineInfo.vertexCount,
-        .maxGen = polylineInfo.maxGen,
-        .scale = scale
+    result.computeBbTime = time_1 - time_0;
+    result.renderTime = time_2 - time_1;
+    result.scale = scale;
+
+    // Too few vertices make the rate dominated by overheads, and cached
+    // ones are not generated
+    if (totalVertexCount(result) >= 10'000 &&
+        result.geometryCacheHits == 0 &&
+        !result.cancelled &&
+        !scratch->fixedVertexRate)
+        scratch->vertexRate = vertexRate(result);
+
+    if (progress)
+        progress->finish(!result.cancelled);
+
+    return result;
+}
+
+auto renderFractalRegion(QPainter& p,
+                         const QRect& rect,
+                         const FractalViewTransform& view,
+                         std::span<const Vec2d> base,
+                         std::span<const Vec2d> gen,
+                         const FractalViewParam& param,
+                         RenderScratch* scratch,
+                         std::stop_token stop)
+    -> RenderFractlalResult
+{
+    p.fillRect(rect, Qt::white);
+
+    if (gen.size() < 2)
+        return {};
+
+    auto time_0 = clock::now();
+
+    auto localScratch = std::optional<RenderScratch>{};
+    if (!scratch)
+        scratch = &localScratch.emplace();
+    auto arena = &scratch->arena;
+    arena->reset();
+
+    p.setTransform(view.transform);
+    if (param.antialiasing)
+        p.setRenderHint(QPainter::Antialiasing);
+
+    auto generations = param.approxAlgorithm? 0: param.generations;
+
+    // Exact generations are drawn to within a pixel by FractalApprox
+    // limited in depth, but reported as drawn by the exact engine
+    auto result = RenderFractlalResult{};
+    result.approxEngine = param.approxAlgorithm;
+    result.generations = generations;
+    if (param.approxAlgorithm)
+    {
+        result.approxLod = { 1. / view.scale, param.approxAlgorithmMaxGen };
+        result.approxMaxOrdinal = param.approxAlgorithmMaxVertexCount;
+    }
+
+    // The rect in curve coordinates, with margins for the pen
+    auto visible = view.transform.inverted().mapRect(QRectF(rect));
+    auto fseq = [&](size_t maxGen, const QPen& pen, CoverageCulling* coverage)
+    {
+        auto margin = (0.5 * std::max(pen.widthF(), 1.) + 1) / view.scale;
+        auto cullBox = Bbox2d{};
+        cullBox
+            << toVec2d(visible.topLeft()) - Vec2d{ margin, margin }
+            << toVec2d(visible.bottomRight()) + Vec2d{ margin, margin };
+        return fractalSeq<FractalApprox>(
+            base,
+            gen,
+            FractalApproxParam{
+                .maxGen = maxGen,
+                .maxOrdinal = param.approxAlgorithmMaxVertexCount,
+                .minLength = 1. / view.scale,
+                .arena = arena,
+                .cullBox = cullBox,
+                .isCovered = coverage? coverage->predicate(): nullptr,
+                .stop = stop
+            } );
     };
+
+    // Polylines are culled against their own coverage only,
+    // as they are drawn with different pens
+    auto draw = [&](size_t maxGen, const QPen& pen)
+    {
+        auto coverage = std::optional<CoverageCulling>{};
+        if (param.coverageCulling)
+            coverage.emplace(
+                scratch->coverage, rect, view, gen, 1. / view.scale,
+                pen.widthF());
+        auto* c = coverage? &*coverage: nullptr;
+        auto info = drawPolyLine(p, scratch->path, fseq(maxGen, pen, c), pen, c);
+        accumulate(result, c);
+        return info;
+    };
+
+    if (param.approxAlgorithm)
+        accumulate(result, draw(param.approxAlgorithmMaxGen, QPen{}));
+    else
+    {
+        // FractalApprox limited to gen+1 levels draws generation gen
+        // to within a pixel
+        size_t gen = param.allGenerations? 0: generations;
+        for (; gen<=generations && !result.cancelled; ++gen)
+        {
+            accumulate(
+                result, draw(gen+1, generationPen(param, gen, generations)));
+        }
+    }
+
+    result.renderTime = clock::now() - time_0;
+    result.scale = view.scale;
+    return result;
+}
+
+
+auto exportFractalVertices(VertexFileWriter& writer,
+                           std::span<const Vec2d> base,
+                           std::span<const Vec2d> gen,
+                           const FractalViewParam& param,
+                           const RenderFractlalResult& render)
+    -> void
+{
+    writeFractalVertices(writer, base, gen, param, render);
+}
+
+auto exportFractalVertices(PackedVertexWriter& writer,
+                           std::span<const Vec2d> base,
+                           std::span<const Vec2d> gen,
+                           const FractalViewParam& param,
+                           const RenderFractlalResult& render)
+    -> void
+{
+    writeFractalVertices(writer, base, gen, param, render);
 }
@@ -1,27 +1,211 @@
 #pragma once
 
+#include "arena.hpp"
+#include "coverage_mask.hpp"
+#include "fractal_cost.hpp"
+#include "render_cost.hpp"
 #include "vec2.hpp"
 #include "fractalview_param.h"
 
+#include <QImage>
+#include <QPainterPath>
 #include <QRect>
+#include <QTransform>
 
 #include <chrono>
+#include <functional>
+#include <iosfwd>
 #include <span>
+#include <stop_token>
+#include <string>
+#include <vector>
 
+class GeometryCache;
 class QPainter;
+class PackedVertexWriter;
+class VertexFileWriter;
+
+// Bump whenever renderFractal() output changes for the same input,
+// to invalidate cached frame images
+constexpr inline auto rendererVersion = 3;
 
 struct RenderFractlalResult
 {
     std::chrono::nanoseconds computeBbTime{};
     std::chrono::nanoseconds renderTime{};
+
+    // Parts of renderTime: generating vertices into the painter path,
+    // and stroking the path (summed over all generations drawn)
+    std::chrono::nanoseconds pathTime{};
+    std::chrono::nanoseconds strokeTime{};
+
     size_t vertexCount{};
     size_t maxGen{};
     double scale{};
+
+    // Vertices per generation, summed over all polylines drawn
+    std::vector<size_t> genVertexCount;
+
+    // Approximate engine work pushed and popped (see FractalIterStats)
+    size_t pushCount{};
+    size_t popCount{};
+
+    // Peak size of the painter path plus iterator state, in bytes
+    size_t peakAllocatedBytes{};
+
+    // True if FractalApprox hit maxOrdinal before finishing the curve
+    bool truncated{};
+
+    // True if rendering stopped early at a stop request; the image is
+    // incomplete
+    bool cancelled{};
+
+    // Budget mode: the vertex budget (0 if there is none), whether
+    // the level of detail had to be lowered to fit it, and FractalApprox
+    // tolerance in pixels (1 at full quality)
+    double vertexBudget{};
+    bool budgetLimited{};
+    double lodTolerance{};
+
+    // Predicted cost and the engine chosen from it (see chooseEngine());
+    // nothing is drawn if refused
+    RenderCostEstimate cost;
+    bool approxEngine{};
+    bool engineSwitched{};
+    bool refused{};
+    std::string engineWarning;
+
+    // Level of detail drawn: the last generation of the exact engine, or
+    // the parameters of the approximate one (see planFractalRender())
+    size_t generations{};
+    ApproxLod approxLod{};
+    size_t approxMaxOrdinal{};
+
+    // Coverage culling: FractalApprox subtrees skipped as their bounds were
+    // painted already, and the estimated number of vertices not generated
+    size_t coverageSkipCount{};
+    double coverageSavedVertices{};
+
+    // True if half of a symmetric curve was stroked and its pixels mirrored
+    bool mirrored{};
+
+    // Polylines drawn from RenderScratch::geometryCache without generating
+    size_t geometryCacheHits{};
+};
+
+auto totalVertexCount(const RenderFractlalResult& result)
+    -> size_t;
+
+// Vertices per second of renderTime
+auto vertexRate(const RenderFractlalResult& result)
+    -> double;
+
+auto reportRenderStats(std::ostream& s, const RenderFractlalResult& result)
+    -> void;
+
+// Memory reused by consecutive renderFractal() calls, so that
+// rendering similar images repeatedly does not allocate
+struct RenderScratch
+{
+    QPainterPath path;
+    MonotonicArena arena;
+    CoverageMask coverage;
+    QImage mirrorLayer;
+
+    // Measured by the previous call, to turn time budgets into vertex budgets
+    double vertexRate{};
+
+    // Keeps vertexRate as set, so that images depend on the parameters only
+    // rather than on machine speed and load
+    bool fixedVertexRate{};
+
+    // Optional, and may be shared by threads. With a cache, FractalApprox
+    // tolerances are rounded to quarter powers of two, so that polylines
+    // are reused across nearby scales; coverage culling bypasses the cache.
+    GeometryCache* geometryCache{};
+};
+
+// Maps curve coordinates to a rect: the curve bounding box with margins
+// is scaled uniformly to fit the rect, and centered
+struct FractalViewTransform
+{
+    double scale;   // Pixels per curve unit
+    QTransform transform;
+};
+
+auto fractalViewTransform(const QRect& rect,
+                          std::span<const Vec2d> base,
+                          std::span<const Vec2d> gen,
+                          const FractalViewParam& param,
+                          MonotonicArena* arena = nullptr,
+                          GeometryCache* geometryCache = nullptr)
+    -> FractalViewTransform;
+
+struct RenderProgress
+{
+    size_t vertexCount{};   // Vertices drawn so far
+    double fraction{};      // Estimated part of the work done, 0 to 1
+};
+
+// Optional control of a renderFractal() call from another thread
+struct RenderControl
+{
+    // Polled by the fractal iterators; rendering stops soon after
+    // a stop request, with RenderFractlalResult::cancelled set
+    std::stop_token stop;
+
+    // Called on the rendering thread at most once per progressInterval,
+    // and once when rendering ends
+    std::function<void(const RenderProgress&)> progress;
+    std::chrono::milliseconds progressInterval{ 100 };
 };
 
 auto renderFractal(QPainter& painter,
                    const QRect& rect,
                    std::span<const Vec2d> base,
                    std::span<const Vec2d> gen,
-                   const FractalViewParam& param)
+                   const FractalViewParam& param,
+                   RenderScratch* scratch = nullptr,
+                   const RenderControl* control = nullptr)
+    -> RenderFractlalResult;
+
+// Renders the part of the curve visible in rect, for the given transform
+// from curve coordinates to the painter's. Segments off the rect are not
+// subdivided, so the cost depends on the visible detail rather than on the
+// scale. Generations of the exact algorithm are drawn to within a pixel.
+auto renderFractalRegion(QPainter& painter,
+                         const QRect& rect,
+                         const FractalViewTransform& view,
+                         std::span<const Vec2d> base,
+                         std::span<const Vec2d> gen,
+                         const FractalViewParam& param,
+                         RenderScratch* scratch = nullptr,
+                         std::stop_token stop = {})
+    -> RenderFractlalResult;
+
+// The engine and level of detail renderFractal() chooses at the given
+// scale, in the budget, engine and level of detail fields; nothing is drawn
+auto planFractalRender(std::span<const Vec2d> base,
+                       std::span<const Vec2d> gen,
+                       const FractalViewParam& param,
+                       double scale,
+                       double vertexRate)
     -> RenderFractlalResult;
+
+// Writes vertices of the finest polyline drawn with the engine and level
+// of detail in render, as renderFractal() or planFractalRender() returned
+// it, in curve coordinates. Throws if render was refused.
+auto exportFractalVertices(VertexFileWriter& writer,
+                           std::span<const Vec2d> base,
+                           std::span<const Vec2d> gen,
+                           const FractalViewParam& param,
+                           const RenderFractlalResult& render)
+    -> void;
+
+// Same, quantized; curveBounds() of base and gen suit the writer's grid
+auto exportFractalVertices(PackedVertexWriter& writer,
+                           std::span<const Vec2d> base,
+                           std::span<const Vec2d> gen,
+                           const FractalViewParam& param,
+                           const RenderFractlalResult& render)
+    -> void;
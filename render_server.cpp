@@ -0,0 +1,503 @@
+#include "render_server.hpp"
+
+#include "batch_frames.hpp"
+#include "batch_output.hpp"
+#include "bounded_queue.hpp"
+#include "geometry_cache.hpp"
+#include "parallel_frames.hpp"
+#include "parse_option.hpp"
+#include "render_context.hpp"
+#include "render_fractal.hpp"
+#include "throw.hpp"
+#include "trace.hpp"
+
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QPainter>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct ServerOptions
+{
+    // Local socket name or path; empty means stdin
+    std::string socketName;
+
+    std::string traceFileName;
+
+    size_t renderJobs{ std::max(std::thread::hardware_concurrency(), 1u) };
+
+    // Parsed jobs waiting for a worker; while full, reading requests from
+    // stdin blocks, and socket requests are rejected as busy
+    size_t queueSize{ 64 };
+
+    // Memory limit of the vertex cache shared by workers; 0 disables it
+    size_t geometryCacheMiB{ GeometryCache::defaultMaxBytes >> 20 };
+};
+
+auto parseServerOptions(const QStringList& args)
+    -> ServerOptions
+{
+    auto result = ServerOptions{};
+    for (auto it=args.begin(), end=args.end(); it!=end; ++it)
+    {
+        auto option = it->toStdString();
+        auto value = [&]() -> std::string
+        {
+            if (std::next(it) == end)
+                throw_("Missing value for option ", option);
+            return (++it)->toStdString();
+        };
+        auto count = [&]
+        {
+            auto result = parseOptionValue<size_t>(option, value());
+            if (result == 0)
+                throw_("Option ", option, " must be positive");
+            return result;
+        };
+
+        if (option == "--socket")
+            result.socketName = value();
+        else if (option == "--trace")
+            result.traceFileName = value();
+        else if (option == "--jobs")
+            result.renderJobs = count();
+        else if (option == "--queue-size")
+            result.queueSize = count();
+        else if (option == "--geometry-cache")
+            result.geometryCacheMiB = parseOptionValue<size_t>(option, value());
+        else
+            throw_("Unknown server option '", option, "'");
+    }
+    return result;
+}
+
+
+// Sends a reply line to the client that submitted the job; thread-safe
+using ReplyFunc = std::function<void(const QByteArray&)>;
+
+struct ServerJob
+{
+    QJsonValue id;
+    BatchLine frame;
+    std::string output;
+    Clock::time_point received;
+    ReplyFunc reply;
+};
+
+auto replyLine(const QJsonObject& reply)
+    -> QByteArray
+{
+    auto result = QJsonDocument{ reply }.toJson(QJsonDocument::Compact);
+    result.append('\n');
+    return result;
+}
+
+auto errorReply(const QJsonValue& id, const std::string& message)
+    -> QByteArray
+{
+    auto reply = QJsonObject{};
+    reply.insert("id", id);
+    reply.insert("ok", false);
+    reply.insert("error", QString::fromStdString(message));
+    return replyLine(reply);
+}
+
+auto parsePoints(const QJsonValue& value, const char* name)
+    -> std::vector<Vec2d>
+{
+    if (!value.isArray())
+        throw_("Field '", name, "' must be an array of [x, y] points");
+    auto result = std::vector<Vec2d>{};
+    for (const auto& point: value.toArray())
+    {
+        auto xy = point.toArray();
+        if (!point.isArray() || xy.size() != 2 ||
+            !xy[0].isDouble() || !xy[1].isDouble())
+            throw_("Field '", name, "' must be an array of [x, y] points");
+        result.push_back({ xy[0].toDouble(), xy[1].toDouble() });
+    }
+    if (result.size() < 2)
+        throw_("Field '", name, "' must have at least 2 points");
+    return result;
+}
+
+template <typename T>
+auto parseField(const QJsonValue& value, std::string_view name, T& field)
+    -> void
+{
+    if constexpr (std::is_same_v<T, bool>)
+    {
+        if (!value.isBool())
+            throw_("Parameter '", name, "' must be a boolean");
+        field = value.toBool();
+    }
+    else
+    {
+        if (!value.isDouble())
+            throw_("Parameter '", name, "' must be a number");
+        auto x = value.toDouble();
+        if constexpr (std::is_integral_v<T>)
+        {
+            if (!(x >= 0) || x != std::floor(x) || x > 0x1p53)
+                throw_("Parameter '", name,
+                       "' must be a non-negative integer");
+            field = static_cast<T>(x);
+        }
+        else
+            field = x;
+    }
+}
+
+// Largest generation count accepted, as in the controls dialog
+constexpr auto maxGenerations = size_t{ 100 };
+
+// Largest image accepted, 256 MiB in ARGB32. Each render worker may
+// hold an image this large in flight and another one in the image pool.
+constexpr auto maxPixelCount = int64_t{ 1 } << 26;
+
+// Fields are named as in batch files; missing ones take default values
+auto parseViewParam(const QJsonValue& value)
+    -> FractalViewParam
+{
+    auto result = FractalViewParam{};
+    if (value.isUndefined())
+        return result;
+    if (!value.isObject())
+        throw_("Field 'param' must be an object");
+
+    auto object = value.toObject();
+    for (const auto& key: object.keys())
+    {
+        auto name = key.toStdString();
+        auto found = setViewParamField(result, name, [&](auto& field)
+        { parseField(object.value(key), name, field); });
+        if (!found)
+            throw_("Unknown parameter '", name, "'");
+    }
+
+    // Generation counts are looped over before the cost estimate
+    // can refuse the job
+    auto generationFields = {
+        std::pair{ "gen", result.generations },
+        std::pair{ "approx_bbox_gen", result.approxAlgorithmBboxGen },
+        std::pair{ "approx_max_gen", result.approxAlgorithmMaxGen } };
+    for (auto [name, generations]: generationFields)
+        if (generations > maxGenerations)
+            throw_("Parameter '", name, "' must be at most ", maxGenerations);
+    return result;
+}
+
+auto parseJob(const QJsonObject& request)
+    -> ServerJob
+{
+    auto result = ServerJob{};
+    result.frame.base = parsePoints(request.value("base"), "base");
+    result.frame.gen = parsePoints(request.value("gen"), "gen");
+    result.frame.viewParam = parseViewParam(request.value("param"));
+
+    auto dimension = [&](const char* name)
+    {
+        auto value = request.value(name);
+        auto x = value.toDouble();
+        if (!value.isDouble() || !(x >= 1 && x <= 1 << 16) ||
+            x != std::floor(x))
+            throw_("Field '", name, "' must be an integer in [1, 65536]");
+        return static_cast<int>(x);
+    };
+    result.frame.size = { dimension("width"), dimension("height") };
+    if (int64_t{ result.frame.size.width() } * result.frame.size.height() >
+        maxPixelCount)
+        throw_("Image of ", result.frame.size.width(), 'x',
+               result.frame.size.height(), " exceeds ", maxPixelCount,
+               " pixels");
+
+    auto output = request.value("output");
+    if (!output.isString() || output.toString().isEmpty())
+        throw_("Field 'output' must be a file name");
+    result.output = output.toString().toStdString();
+    return result;
+}
+
+// Parses a request line and queues its job, or replies with the error;
+// unless wait is set, a full queue is an error. Returns false if the
+// request asks the server to shut down.
+auto handleRequest(const QByteArray& line,
+                   const ReplyFunc& reply,
+                   BoundedQueue<ServerJob>& queue,
+                   bool wait)
+    -> bool
+{
+    if (line.trimmed().isEmpty())
+        return true;
+
+    auto id = QJsonValue{};
+    try
+    {
+        auto parseError = QJsonParseError{};
+        auto document = QJsonDocument::fromJson(line, &parseError);
+        if (parseError.error != QJsonParseError::NoError)
+            throw_("Invalid JSON: ", parseError.errorString().toStdString());
+        if (!document.isObject())
+            throw_("Request must be a JSON object");
+        auto request = document.object();
+        id = request.value("id");
+
+        if (auto command = request.value("command"); !command.isUndefined())
+        {
+            if (command.toString() != "shutdown")
+                throw_("Unknown command '",
+                       command.toString().toStdString(), "'");
+            auto ack = QJsonObject{};
+            ack.insert("id", id);
+            ack.insert("ok", true);
+            reply(replyLine(ack));
+            return false;
+        }
+
+        auto job = parseJob(request);
+        job.id = id;
+        job.received = Clock::now();
+        job.reply = reply;
+        if (wait && !queue.push(std::move(job)))
+            throw_("Server is shutting down");
+        if (!wait && !queue.tryPush(job))
+            throw_("Server is busy or shutting down, retry later");
+    }
+    catch (const std::exception& e)
+    {
+        reply(errorReply(id, e.what()));
+    }
+    return true;
+}
+
+auto seconds(Clock::duration dt)
+    -> double
+{ return std::chrono::duration<double>(dt).count(); }
+
+auto runJob(const ServerJob& job, RenderScratch& scratch, ImagePool& imagePool)
+    -> QJsonObject
+{
+    auto span = TraceSpan{ "job" };
+    auto started = Clock::now();
+
+    auto img = imagePool.acquire(job.frame.size);
+    auto renderResult = RenderFractlalResult{};
+    {
+        auto p = QPainter{ &img };
+        renderResult = renderFractal(
+            p, {QPoint{}, job.frame.size},
+            job.frame.base, job.frame.gen, job.frame.viewParam,
+            &scratch);
+    }
+    if (renderResult.refused)
+        throw_(renderResult.engineWarning);
+    auto rendered = Clock::now();
+
+    auto data = encodeFrame(img, FrameFormat::Png);
+    imagePool.recycle(std::move(img));
+    auto encoded = Clock::now();
+
+    writeFileAtomically(job.output, data);
+    auto written = Clock::now();
+
+    auto reply = QJsonObject{};
+    reply.insert("id", job.id);
+    reply.insert("ok", true);
+    reply.insert("output", QString::fromStdString(job.output));
+    reply.insert("vertices",
+                 static_cast<double>(totalVertexCount(renderResult)));
+    reply.insert("approx_engine", renderResult.approxEngine);
+    reply.insert("geometry_cache_hits",
+                 static_cast<double>(renderResult.geometryCacheHits));
+    if (!renderResult.engineWarning.empty())
+        reply.insert("warning",
+                     QString::fromStdString(renderResult.engineWarning));
+    reply.insert("queue_s", seconds(started - job.received));
+    reply.insert("render_s", seconds(rendered - started));
+    reply.insert("encode_s", seconds(encoded - rendered));
+    reply.insert("write_s", seconds(written - encoded));
+    reply.insert("total_s", seconds(written - job.received));
+    return reply;
+}
+
+auto serveStdin(BoundedQueue<ServerJob>& queue)
+    -> void
+{
+    auto replyMutex = std::make_shared<std::mutex>();
+    auto reply = [replyMutex](const QByteArray& line)
+    {
+        auto lock = std::lock_guard{ *replyMutex };
+        std::cout.write(line.constData(), line.size());
+        std::cout.flush();
+    };
+
+    for (auto line=std::string{}; std::getline(std::cin, line);)
+        if (!handleRequest(
+                QByteArray(line.data(), line.size()), reply, queue, true))
+            break;
+}
+
+// Runs the event loop until a shutdown request; finish() must complete
+// all queued jobs, whose replies are then delivered before returning
+auto serveSocket(const std::string& name,
+                 BoundedQueue<ServerJob>& queue,
+                 const std::function<void()>& finish,
+                 std::ostream& log)
+    -> void
+{
+    auto server = QLocalServer{};
+    auto serverName = QString::fromStdString(name);
+    QLocalServer::removeServer(serverName);
+    if (!server.listen(serverName))
+        throw_("Failed to listen on '", name, "': ",
+               server.errorString().toStdString());
+    log << "Listening on '" << server.fullServerName().toStdString() << "'"
+        << std::endl;
+
+    // Owned by the event loop thread; workers post replies to it
+    auto sockets = std::unordered_map<uint64_t, QLocalSocket*>{};
+    auto nextClient = uint64_t{};
+
+    QObject::connect(&server, &QLocalServer::newConnection, [&]
+    {
+        while (auto* socket = server.nextPendingConnection())
+        {
+            auto client = nextClient++;
+            sockets[client] = socket;
+
+            // Replies to clients gone meanwhile are dropped
+            auto reply = [&server, &sockets, client](const QByteArray& line)
+            {
+                QMetaObject::invokeMethod(
+                    &server,
+                    [&sockets, client, line]
+                    {
+                        if (auto it=sockets.find(client); it!=sockets.end())
+                            it->second->write(line);
+                    },
+                    Qt::QueuedConnection);
+            };
+
+            QObject::connect(socket, &QLocalSocket::readyRead, [&, socket, reply]
+            {
+                // Waiting for a worker would stall all other clients
+                while (socket->canReadLine())
+                    if (!handleRequest(socket->readLine(), reply, queue, false))
+                    {
+                        QCoreApplication::quit();
+                        return;
+                    }
+            });
+            QObject::connect(socket, &QLocalSocket::disconnected, [&, socket, client]
+            {
+                sockets.erase(client);
+                socket->deleteLater();
+            });
+        }
+    });
+
+    QCoreApplication::exec();
+
+    finish();
+    QCoreApplication::processEvents();
+    for (auto& [client, socket]: sockets)
+        socket->waitForBytesWritten(1000);
+}
+
+} // anonymous namespace
+
+auto serve(const QStringList& options)
+    -> int
+{
+    auto& log = std::cerr;
+    try
+    {
+        auto opts = parseServerOptions(options);
+        auto traceSession = TraceSession{ opts.traceFileName };
+        if (traceEnabled())
+            setTraceThreadName("main");
+
+        auto queue = BoundedQueue<ServerJob>{ opts.queueSize };
+        auto imagePool = ImagePool{ QImage::Format_ARGB32, opts.renderJobs };
+        auto geometryCache = GeometryCache{ opts.geometryCacheMiB << 20 };
+
+        // Workers keep their scratch memory for the lifetime of the server
+        auto workers = startWorkers(
+            opts.renderJobs,
+            [&](size_t workerIndex)
+            {
+                if (traceEnabled())
+                    setTraceThreadName(
+                        "render " + std::to_string(workerIndex));
+                auto context = RenderContext{};
+                if (opts.geometryCacheMiB > 0)
+                    context.scratch.geometryCache = &geometryCache;
+                while (auto job = queue.pop())
+                {
+                    try
+                    {
+                        job->reply(replyLine(
+                            runJob(*job, context.scratch, imagePool)));
+                    }
+                    catch (const std::exception& e)
+                    {
+                        job->reply(errorReply(job->id, e.what()));
+                    }
+                }
+            },
+            []{});
+
+        auto finish = [&]
+        {
+            queue.close();
+            workers.clear();
+        };
+
+        log << "Serving with " << opts.renderJobs << " render jobs"
+            << std::endl;
+        try
+        {
+            if (opts.socketName.empty())
+            {
+                serveStdin(queue);
+                finish();
+            }
+            else
+                serveSocket(opts.socketName, queue, finish, log);
+        }
+        catch (...)
+        {
+            // Let the workers quit before they are joined
+            queue.cancel();
+            throw;
+        }
+
+        return EXIT_SUCCESS;
+    }
+    catch (const std::exception& e)
+    {
+        log << "ERROR: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <QStringList>
+
+// Renders jobs received as newline-delimited JSON, one job per line,
+// from stdin (replies go to stdout), or from clients of a local socket
+// given by --socket (replies go to the client). Workers keep their render
+// scratch memory and image buffers between jobs, and render concurrently;
+// replies come in order of completion and echo the job id.
+//
+// Job:
+//      {"id": any, "base": [[x, y], ...], "gen": [[x, y], ...],
+//       "width": w, "height": h, "output": "image.png",
+//       "param": {"gen": 7, "approx": true, ...}}
+//
+// param fields are named as in batch files and default as there.
+// Reply:
+//      {"id": ..., "ok": true, "output": ..., "vertices": n,
+//       "queue_s": ..., "render_s": ..., "encode_s": ..., "write_s": ...,
+//       "total_s": ...}
+//      {"id": ..., "ok": false, "error": "..."}
+//
+// {"command": "shutdown"} stops accepting jobs, finishes the queued ones,
+// and exits. Options are the remaining command line arguments.
+auto serve(const QStringList& options)
+    -> int;
@@ -1,6 +1,8 @@
 #include "interp_curves.hpp"
 
+#include <cmath>
 #include <iostream>
+#include <stdexcept>
 
 struct KF
 {
@@ -111,11 +113,44 @@ auto testMapIndex()
     }
 }
 
+// Checks that slopes of several curves solved together satisfy
+// the spline equations of each curve
+auto testCubicSlopeSolver()
+    -> void
+{
+    constexpr size_t n = 7;
+    constexpr size_t ncurves = 3;
+    auto y = std::vector<double>(n * ncurves);
+    for (size_t i=0; i<n; ++i)
+        for (size_t c=0; c<ncurves; ++c)
+            y[i*ncurves + c] = std::sin(0.7*i + c) * (c + 1);
+
+    auto m = std::vector<double>(n * ncurves);
+    CubicSlopeSolver(n).solve<double>(y, ncurves, m);
+
+    for (size_t c=0; c<ncurves; ++c)
+    {
+        auto at = [&](const std::vector<double>& v, size_t i)
+        { return v[i*ncurves + c]; };
+        for (size_t i=0; i<n; ++i)
+        {
+            auto lhs =
+                i == 0?   2*at(m, 0) + at(m, 1):
+                i+1 == n? at(m, n-2) + 2*at(m, n-1):
+                          at(m, i-1) + 4*at(m, i) + at(m, i+1);
+            auto rhs = 3*(at(y, std::min(i+1, n-1)) - at(y, i == 0? 0: i-1));
+            if (std::fabs(lhs - rhs) > 1e-12)
+                throw std::runtime_error("CubicSlopeSolver: wrong slopes");
+        }
+    }
+}
+
 int main()
 {
     try
     {
         run();
+        testCubicSlopeSolver();
         // testMapIndex();
         return EXIT_SUCCESS;
     }
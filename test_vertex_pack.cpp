@@ -0,0 +1,205 @@
+#include "vertex_pack.hpp"
+#include "throw.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t blockSize = 256;
+constexpr unsigned bits = 16;
+
+// A spiral, so that deltas take both signs and vary in size
+auto testPolyline()
+    -> std::vector<Vec2d>
+{
+    auto result = std::vector<Vec2d>(10'000);
+    for (size_t i=0; i<result.size(); ++i)
+    {
+        auto t = 0.01 * i;
+        result[i] = { 3 + t * std::cos(t), -2 + 0.5 * t * std::sin(t) };
+    }
+    return result;
+}
+
+auto readBytes(const std::string& path)
+    -> std::vector<char>
+{
+    auto s = std::ifstream{ path, std::ios::binary };
+    return { std::istreambuf_iterator<char>{ s },
+             std::istreambuf_iterator<char>{} };
+}
+
+auto writeBytes(const std::string& path, const std::vector<char>& data)
+    -> void
+{
+    auto s = std::ofstream{ path, std::ios::binary | std::ios::trunc };
+    s.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!s)
+        throw_("test_vertex_pack: failed to write '", path, "'");
+}
+
+template <typename T>
+auto storeScalar(std::vector<char>& data, size_t offset, T value)
+    -> void
+{ std::memcpy(data.data() + offset, &value, sizeof(T)); }
+
+template <typename F>
+auto expectError(const char* what, F&& f)
+    -> void
+{
+    try
+    {
+        f();
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << what << ": " << e.what() << std::endl;
+        return;
+    }
+    throw_("test_vertex_pack: no error for ", what);
+}
+
+// Decodes a file of several blocks on one and on several threads,
+// and checks the quantization error
+auto testRoundTrip(const std::string& path, const std::vector<Vec2d>& polyline)
+    -> void
+{
+    auto bounds = Bbox2d{};
+    for (const auto& v : polyline)
+        bounds << v;
+
+    auto writer = PackedVertexWriter{ path, bounds, bits, blockSize };
+    for (const auto& v : polyline)
+        writer.write(v);
+    writer.close();
+
+    auto reader = PackedVertexReader{ path };
+    if (reader.vertexCount() != polyline.size())
+        throw_("test_vertex_pack: ", reader.vertexCount(),
+               " vertices read, ", polyline.size(), " written");
+    auto expectedBlockCount = (polyline.size() + blockSize - 1) / blockSize;
+    if (reader.blockCount() != expectedBlockCount)
+        throw_("test_vertex_pack: ", reader.blockCount(), " blocks, expected ",
+               expectedBlockCount);
+
+    auto serial = reader.decode(1);
+    auto parallel = reader.decode(4);
+    if (serial != parallel)
+        throw_("test_vertex_pack: decoding on 1 and 4 threads differs");
+
+    auto maxError = 0.;
+    for (size_t i=0; i<polyline.size(); ++i)
+        for (size_t axis=0; axis<2; ++axis)
+            maxError = std::max(
+                maxError, std::fabs(parallel[i][axis] - polyline[i][axis]));
+    if (maxError > 0.5 * reader.step() * (1 + 1e-9))
+        throw_("test_vertex_pack: max error ", maxError, " exceeds step/2, ",
+               0.5 * reader.step());
+
+    std::cout << polyline.size() << " vertices in " << reader.blockCount()
+              << " blocks, "
+              << static_cast<double>(writer.byteCount()) / polyline.size()
+              << " bytes/vertex, max error "
+              << maxError / reader.step() << " step" << std::endl;
+}
+
+// Expects errors on damaged copies of a valid file
+auto testCorruptFiles(const std::string& path)
+    -> void
+{
+    const auto data = readBytes(path);
+    const auto size = data.size();
+    auto damagedPath = path + ".damaged";
+
+    auto damaged = [&](auto damage)
+    {
+        auto copy = data;
+        damage(copy);
+        writeBytes(damagedPath, copy);
+        return damagedPath;
+    };
+
+    expectError("truncated header", [&]
+    {
+        PackedVertexReader{ damaged([](auto& d) { d.resize(20); }) };
+    });
+
+    expectError("truncated index", [&]
+    {
+        PackedVertexReader{ damaged([](auto& d) { d.resize(d.size() - 8); }) };
+    });
+
+    // The index offset is the last field of the trailer
+    expectError("index offset past the index", [&]
+    {
+        PackedVertexReader{ damaged([&](auto& d)
+        { storeScalar<uint64_t>(d, size - 8, size); }) };
+    });
+
+    expectError("block count not matching the index", [&]
+    {
+        PackedVertexReader{ damaged([&](auto& d)
+        { storeScalar<uint64_t>(d, size - 24, 1); }) };
+    });
+
+    // The index starts with the file offset of the first block
+    auto indexOffset = uint64_t{};
+    std::memcpy(&indexOffset, data.data() + size - 8, sizeof(indexOffset));
+    expectError("block offset past the blocks", [&]
+    {
+        PackedVertexReader{ damaged([&](auto& d)
+        { storeScalar<uint64_t>(d, indexOffset, indexOffset); }) };
+    });
+
+    // The second block's payload size, so that the error is raised
+    // by a decoding thread other than the first one
+    auto secondBlockOffset = uint64_t{};
+    std::memcpy(&secondBlockOffset, data.data() + indexOffset + 16,
+                sizeof(secondBlockOffset));
+    expectError("block payload past the file end", [&]
+    {
+        auto reader = PackedVertexReader{ damaged([&](auto& d)
+        { storeScalar<uint32_t>(d, secondBlockOffset, 0xffff'ffff); }) };
+        reader.decode(4);
+    });
+
+    expectError("block payload ending within a varint", [&]
+    {
+        auto reader = PackedVertexReader{ damaged([&](auto& d)
+        { storeScalar<uint32_t>(d, secondBlockOffset, 1); }) };
+        reader.decode(4);
+    });
+
+    std::filesystem::remove(damagedPath);
+}
+
+} // anonymous namespace
+
+int main()
+{
+    auto path = (std::filesystem::temp_directory_path() /
+                 "test_vertex_pack.gfvpack").string();
+    try
+    {
+        testRoundTrip(path, testPolyline());
+        testCorruptFiles(path);
+        std::filesystem::remove(path);
+        return EXIT_SUCCESS;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,193 @@
+#include "tile_pyramid.hpp"
+
+#include "frame_hash.hpp"
+#include "trace.hpp"
+
+#include <QPainter>
+
+#include <cmath>
+#include <tuple>
+
+auto tileSourceHash(std::span<const Vec2d> base,
+                    std::span<const Vec2d> gen,
+                    const FractalViewParam& param,
+                    const Vec2d& origin,
+                    double baseScale)
+    -> uint64_t
+{
+    auto h = FrameHash{};
+    h << rendererVersion << base << gen;
+    std::apply([&](const auto&... field) { ((h << field), ...); },
+               fields_of(param));
+    h << origin[0] << origin[1] << baseScale;
+    return h.value();
+}
+
+auto makeTileSource(std::span<const Vec2d> base,
+                    std::span<const Vec2d> gen,
+                    const FractalViewParam& param,
+                    const Vec2d& origin,
+                    double baseScale)
+    -> std::shared_ptr<const TileSource>
+{
+    return std::make_shared<const TileSource>(TileSource{
+        .base = std::vector<Vec2d>(base.begin(), base.end()),
+        .gen = std::vector<Vec2d>(gen.begin(), gen.end()),
+        .param = param,
+        .origin = origin,
+        .baseScale = baseScale,
+        .hash = tileSourceHash(base, gen, param, origin, baseScale) });
+}
+
+auto TileKeyHash::operator()(const TileKey& key) const noexcept
+    -> size_t
+{
+    auto h = FrameHash{};
+    h << key.source << key.zoom << key.x << key.y;
+    return h.value();
+}
+
+auto tileScale(const TileSource& source, int zoom)
+    -> double
+{ return source.baseScale * std::exp2(zoom); }
+
+auto tileTransform(const TileSource& source, const TileKey& key)
+    -> FractalViewTransform
+{
+    auto scale = tileScale(source, key.zoom);
+    auto t = QTransform{};
+    t
+        .translate(-static_cast<double>(key.x * tileSize),
+                   -static_cast<double>(key.y * tileSize))
+        .scale(scale, scale)
+        .translate(-source.origin[0], -source.origin[1]);
+    return { scale, t };
+}
+
+auto renderTile(const TileSource& source,
+                const TileKey& key,
+                RenderScratch& scratch,
+                std::stop_token stop)
+    -> RenderedTile
+{
+    auto span = TraceSpan{ "render tile" };
+    auto result = RenderedTile{
+        .key = key,
+        .image = QImage{ tileSize, tileSize,
+                         QImage::Format_ARGB32_Premultiplied } };
+    auto p = QPainter{ &result.image };
+    result.renderResult = renderFractalRegion(
+        p, result.image.rect(), tileTransform(source, key),
+        source.base, source.gen, source.param, &scratch, std::move(stop));
+    return result;
+}
+
+
+
+auto TileCache::find(const TileKey& key)
+    -> const QImage*
+{
+    auto it = index_.find(key);
+    if (it == index_.end())
+        return nullptr;
+    items_.splice(items_.begin(), items_, it->second);
+    return &it->second->second;
+}
+
+auto TileCache::insert(const TileKey& key, QImage image)
+    -> void
+{
+    if (auto it = index_.find(key); it != index_.end())
+    {
+        bytes_ -= it->second->second.sizeInBytes();
+        items_.erase(it->second);
+        index_.erase(it);
+    }
+
+    bytes_ += image.sizeInBytes();
+    items_.emplace_front(key, std::move(image));
+    index_.emplace(key, items_.begin());
+
+    while (bytes_ > maxBytes_ && items_.size() > 1)
+    {
+        bytes_ -= items_.back().second.sizeInBytes();
+        index_.erase(items_.back().first);
+        items_.pop_back();
+    }
+}
+
+
+
+TileRenderer::TileRenderer(size_t threadCount, OnRendered onRendered) :
+    onRendered_{ std::move(onRendered) }
+{
+    threads_.reserve(threadCount);
+    for (size_t i=0; i<threadCount; ++i)
+        threads_.emplace_back([this, i](std::stop_token stop)
+        {
+            setTraceThreadName("tile " + std::to_string(i));
+            work(stop);
+        });
+}
+
+TileRenderer::~TileRenderer()
+{
+    for (auto& thread: threads_)
+        thread.request_stop();
+    threads_.clear();
+}
+
+auto TileRenderer::request(std::shared_ptr<const TileSource> source,
+                           std::vector<TileKey> keys)
+    -> void
+{
+    {
+        auto lock = std::scoped_lock{ mutex_ };
+        source_ = std::move(source);
+        pending_.clear();
+        for (const auto& key: keys)
+            if (!inFlight_.contains(key))
+                pending_.push_back(key);
+    }
+    pendingChanged_.notify_all();
+}
+
+auto TileRenderer::pendingCount() const
+    -> size_t
+{
+    auto lock = std::scoped_lock{ mutex_ };
+    return pending_.size() + inFlight_.size();
+}
+
+auto TileRenderer::work(std::stop_token stop)
+    -> void
+{
+    // Reused for all tiles rendered by this thread
+    auto scratch = RenderScratch{};
+
+    while (true)
+    {
+        auto key = TileKey{};
+        auto source = std::shared_ptr<const TileSource>{};
+        {
+            auto lock = std::unique_lock{ mutex_ };
+            if (!pendingChanged_.wait(
+                    lock, stop, [&]{ return !pending_.empty(); }))
+                return;
+            key = pending_.front();
+            pending_.pop_front();
+            source = source_;
+            inFlight_.insert(key);
+        }
+
+        auto tile = renderTile(*source, key, scratch, stop);
+
+        {
+            auto lock = std::scoped_lock{ mutex_ };
+            inFlight_.erase(key);
+        }
+        if (tile.renderResult.cancelled)
+            return;
+        onRendered_(std::move(tile));
+    }
+}
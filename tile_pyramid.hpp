@@ -0,0 +1,158 @@
+#pragma once
+
+#include "fractalview_param.h"
+#include "render_fractal.hpp"
+#include "vec2.hpp"
+
+#include <QImage>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Map-style tile pyramid for panning and zooming. At zoom level z, the curve
+// is scaled by baseScale * 2^z pixels per curve unit, and split into square
+// tiles of tileSize pixels; tile (x, y) covers world pixels
+// [x*tileSize, (x+1)*tileSize) x [y*tileSize, (y+1)*tileSize).
+
+constexpr inline auto tileSize = 256;
+
+// Everything a tile image depends on except its position
+struct TileSource
+{
+    std::vector<Vec2d> base;
+    std::vector<Vec2d> gen;
+    FractalViewParam param;
+    Vec2d origin;           // Curve point at world pixel (0, 0)
+    double baseScale{};     // Pixels per curve unit at zoom level 0
+    uint64_t hash{};        // Of all the above
+};
+
+auto tileSourceHash(std::span<const Vec2d> base,
+                    std::span<const Vec2d> gen,
+                    const FractalViewParam& param,
+                    const Vec2d& origin,
+                    double baseScale)
+    -> uint64_t;
+
+auto makeTileSource(std::span<const Vec2d> base,
+                    std::span<const Vec2d> gen,
+                    const FractalViewParam& param,
+                    const Vec2d& origin,
+                    double baseScale)
+    -> std::shared_ptr<const TileSource>;
+
+struct TileKey
+{
+    uint64_t source{};      // TileSource::hash
+    int zoom{};
+    int64_t x{};
+    int64_t y{};
+
+    auto operator==(const TileKey&) const -> bool = default;
+};
+
+struct TileKeyHash
+{
+    auto operator()(const TileKey& key) const noexcept
+        -> size_t;
+};
+
+// Pixels per curve unit at the zoom level
+auto tileScale(const TileSource& source, int zoom)
+    -> double;
+
+// Maps curve coordinates to the tile image
+auto tileTransform(const TileSource& source, const TileKey& key)
+    -> FractalViewTransform;
+
+struct RenderedTile
+{
+    TileKey key;
+    QImage image;
+    RenderFractlalResult renderResult;
+};
+
+auto renderTile(const TileSource& source,
+                const TileKey& key,
+                RenderScratch& scratch,
+                std::stop_token stop = {})
+    -> RenderedTile;
+
+
+// Least recently used tile images, up to a memory limit
+class TileCache final
+{
+public:
+    explicit TileCache(size_t maxBytes) :
+        maxBytes_{ maxBytes }
+    {}
+
+    // Returns null if the tile is not cached
+    auto find(const TileKey& key)
+        -> const QImage*;
+
+    auto insert(const TileKey& key, QImage image)
+        -> void;
+
+    auto size() const noexcept
+        -> size_t
+    { return items_.size(); }
+
+    auto bytes() const noexcept
+        -> size_t
+    { return bytes_; }
+
+private:
+    using Items = std::list<std::pair<TileKey, QImage>>;
+
+    size_t maxBytes_;
+    size_t bytes_{};
+    Items items_;   // Most recently used first
+    std::unordered_map<TileKey, Items::iterator, TileKeyHash> index_;
+};
+
+
+// Renders tiles on background threads. A request replaces the tiles still
+// pending from previous ones, so that only tiles currently needed
+// are rendered. Destruction stops the tiles being rendered.
+class TileRenderer final
+{
+public:
+    // Called on a worker thread
+    using OnRendered = std::function<void(RenderedTile)>;
+
+    TileRenderer(size_t threadCount, OnRendered onRendered);
+    ~TileRenderer();
+
+    // Tiles are rendered in the order given; tiles being rendered
+    // are not rendered again
+    auto request(std::shared_ptr<const TileSource> source,
+                 std::vector<TileKey> keys)
+        -> void;
+
+    auto pendingCount() const
+        -> size_t;
+
+private:
+    auto work(std::stop_token stop)
+        -> void;
+
+    OnRendered onRendered_;
+    mutable std::mutex mutex_;
+    std::condition_variable_any pendingChanged_;
+    std::shared_ptr<const TileSource> source_;
+    std::deque<TileKey> pending_;
+    std::unordered_set<TileKey, TileKeyHash> inFlight_;
+
+    // Last, so that threads are stopped before the state they use is gone
+    std::vector<std::jthread> threads_;
+};
@@ -0,0 +1,191 @@
+#include "trace.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace detail {
+
+std::atomic<bool> traceEnabled{ false };
+
+} // namespace detail
+
+namespace {
+
+struct TraceEvent final
+{
+    const char* name;
+    const char* argName;
+    long long argValue;
+    detail::TraceClock::time_point begin;
+    detail::TraceClock::time_point end;
+};
+
+struct ThreadTraceBuffer final
+{
+    size_t tid{};
+    std::string threadName;
+
+    // Only contended while the session is being written
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+};
+
+struct TraceRegistry final
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadTraceBuffer>> buffers;
+    detail::TraceClock::time_point start;
+};
+
+auto registry()
+    -> TraceRegistry&
+{
+    static auto instance = TraceRegistry{};
+    return instance;
+}
+
+auto threadBuffer()
+    -> ThreadTraceBuffer&
+{
+    thread_local auto buffer = []
+    {
+        auto result = std::make_shared<ThreadTraceBuffer>();
+        auto& r = registry();
+        auto lock = std::lock_guard{ r.mutex };
+        result->tid = r.buffers.size() + 1;
+        r.buffers.push_back(result);
+        return result;
+    }();
+    return *buffer;
+}
+
+auto writeJsonString(std::ostream& s, std::string_view str)
+    -> void
+{
+    s << '"';
+    for (auto c: str)
+    {
+        if (c == '"' || c == '\\')
+            s << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            s << ' ';
+        else
+            s << c;
+    }
+    s << '"';
+}
+
+auto writeTrace(std::ostream& s)
+    -> void
+{
+    auto& r = registry();
+    auto lock = std::lock_guard{ r.mutex };
+
+    auto usec = [&](detail::TraceClock::time_point t)
+    {
+        return std::chrono::duration<double, std::micro>(t - r.start).count();
+    };
+
+    s << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    auto first = true;
+    auto delim = [&]() -> std::ostream&
+    {
+        if (!first)
+            s << ",\n";
+        first = false;
+        return s;
+    };
+
+    for (const auto& buffer: r.buffers)
+    {
+        auto bufferLock = std::lock_guard{ buffer->mutex };
+
+        if (!buffer->threadName.empty())
+        {
+            delim() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                       "\"tid\":" << buffer->tid << ",\"args\":{\"name\":";
+            writeJsonString(s, buffer->threadName);
+            s << "}}";
+        }
+
+        for (const auto& e: buffer->events)
+        {
+            delim() << "{\"name\":";
+            writeJsonString(s, e.name);
+            s << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+              << ",\"ts\":" << usec(e.begin)
+              << ",\"dur\":" << usec(e.end) - usec(e.begin);
+            if (e.argName)
+            {
+                s << ",\"args\":{";
+                writeJsonString(s, e.argName);
+                s << ':' << e.argValue << '}';
+            }
+            s << '}';
+        }
+    }
+    s << "\n]}\n";
+}
+
+} // anonymous namespace
+
+
+
+auto detail::recordTraceEvent(const char* name,
+                              const char* argName,
+                              long long argValue,
+                              TraceClock::time_point begin,
+                              TraceClock::time_point end)
+    -> void
+{
+    auto& buffer = threadBuffer();
+    auto lock = std::lock_guard{ buffer.mutex };
+    buffer.events.push_back({ name, argName, argValue, begin, end });
+}
+
+auto setTraceThreadName(std::string name)
+    -> void
+{
+    auto& buffer = threadBuffer();
+    auto lock = std::lock_guard{ buffer.mutex };
+    buffer.threadName = std::move(name);
+}
+
+TraceSession::TraceSession(std::string fileName):
+    fileName_{ std::move(fileName) }
+{
+    if (fileName_.empty())
+        return;
+
+    auto& r = registry();
+    {
+        auto lock = std::lock_guard{ r.mutex };
+        r.start = detail::TraceClock::now();
+        for (auto& buffer: r.buffers)
+        {
+            auto bufferLock = std::lock_guard{ buffer->mutex };
+            buffer->events.clear();
+        }
+    }
+    detail::traceEnabled.store(true);
+}
+
+TraceSession::~TraceSession()
+{
+    if (fileName_.empty())
+        return;
+
+    detail::traceEnabled.store(false);
+
+    auto s = std::ofstream(fileName_);
+    if (s.is_open())
+        writeTrace(s);
+    if (!s.is_open() || s.fail())
+        std::cerr << "ERROR: Failed to write trace file '"
+                  << fileName_ << "'" << std::endl;
+    else
+        std::clog << "Trace written to '" << fileName_ << "'" << std::endl;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Opt-in timeline tracing. While a TraceSession is alive, every TraceSpan
+// records a complete event (begin time, duration, thread), and the session
+// writes them as trace_event JSON when destroyed. When no session is active,
+// a span costs one relaxed atomic load.
+
+namespace detail {
+
+extern std::atomic<bool> traceEnabled;
+
+using TraceClock = std::chrono::steady_clock;
+
+auto recordTraceEvent(const char* name,
+                      const char* argName,
+                      long long argValue,
+                      TraceClock::time_point begin,
+                      TraceClock::time_point end)
+    -> void;
+
+} // namespace detail
+
+
+inline auto traceEnabled() noexcept
+    -> bool
+{ return detail::traceEnabled.load(std::memory_order_relaxed); }
+
+// Names the calling thread in the trace viewer
+auto setTraceThreadName(std::string name)
+    -> void;
+
+
+class TraceSession final
+{
+public:
+    // Starts tracing unless fileName is empty
+    explicit TraceSession(std::string fileName);
+
+    // Stops tracing and writes the trace file
+    ~TraceSession();
+
+    TraceSession(const TraceSession&) = delete;
+    TraceSession& operator=(const TraceSession&) = delete;
+
+private:
+    std::string fileName_;
+};
+
+
+// Scoped span; name and argName must be string literals
+class TraceSpan final
+{
+public:
+    explicit TraceSpan(const char* name,
+                       const char* argName = nullptr,
+                       long long argValue = 0) noexcept
+    {
+        if (!traceEnabled())
+            return;
+        name_ = name;
+        argName_ = argName;
+        argValue_ = argValue;
+        begin_ = detail::TraceClock::now();
+    }
+
+    ~TraceSpan()
+    {
+        if (name_)
+            detail::recordTraceEvent(
+                name_, argName_, argValue_,
+                begin_, detail::TraceClock::now());
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_{};
+    const char* argName_{};
+    long long argValue_{};
+    detail::TraceClock::time_point begin_;
+};
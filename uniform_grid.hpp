@@ -0,0 +1,260 @@
+#pragma once
+
+#include "bbox2.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+// Spatial index of objects identified by keys, each occupying the cells of
+// a uniform grid overlapped by its bounding box. Objects can be inserted,
+// moved and removed one at a time. Objects overlapping too many cells are
+// kept in a separate list, checked by every query.
+template <typename Key>
+class UniformGrid final
+{
+public:
+    explicit UniformGrid(double cellSize = 1) :
+        cellSize_{ cellSize }
+    {}
+
+    auto cellSize() const noexcept
+        -> double
+    { return cellSize_; }
+
+    auto size() const noexcept
+        -> size_t
+    { return objects_.size(); }
+
+    auto clear()
+        -> void
+    {
+        cells_.clear();
+        objects_.clear();
+        oversized_.clear();
+        occupied_ = {};
+    }
+
+    // Removes all objects and changes the cell size
+    auto reset(double cellSize)
+        -> void
+    {
+        clear();
+        cellSize_ = cellSize;
+    }
+
+    // Inserts the object or moves it to the new bounding box
+    auto insert(Key key, const Bbox2d& box)
+        -> void
+    {
+        auto range = cellRange(box);
+        auto it = objects_.find(key);
+        if (it != objects_.end())
+        {
+            if (it->second == range)
+                return;
+            unlink(key, it->second);
+            it->second = range;
+        }
+        else
+            objects_.emplace(key, range);
+        link(key, range);
+    }
+
+    auto remove(Key key)
+        -> void
+    {
+        auto it = objects_.find(key);
+        if (it == objects_.end())
+            return;
+        unlink(key, it->second);
+        objects_.erase(it);
+    }
+
+    // Calls f(key) for each object whose cells contain the point;
+    // f may be called for an object whose box does not contain it
+    template <typename F>
+    auto forEachAt(const Vec2d& pos, F&& f) const
+        -> void
+    {
+        for (auto key: oversized_)
+            f(key);
+        auto it = cells_.find(cellKey(cellIndex(pos[0]), cellIndex(pos[1])));
+        if (it != cells_.end())
+            for (auto key: it->second)
+                f(key);
+    }
+
+    // Returns the object closest to the point, according to distance(key),
+    // or defaultKey if there are no objects. The distance to an object
+    // must not be less than the distance to its bounding box.
+    template <typename Distance>
+    auto nearest(const Vec2d& pos, Distance&& distance, Key defaultKey = {}) const
+        -> Key
+    {
+        auto result = defaultKey;
+        auto bestDist = std::numeric_limits<double>::infinity();
+        auto consider = [&](Key key)
+        {
+            auto d = distance(key);
+            if (d < bestDist)
+            {
+                bestDist = d;
+                result = key;
+            }
+        };
+
+        for (auto key: oversized_)
+            consider(key);
+
+        // Empty cells are kept, and would be visited all the way out to
+        // the extent objects once occupied
+        if (objects_.size() == oversized_.size())
+            return result;
+
+        // Visit rings of cells around the cell containing pos; objects in
+        // ring r+1 are at least r cells away
+        auto ix = cellIndex(pos[0]);
+        auto iy = cellIndex(pos[1]);
+        auto maxRing = std::max({ ix - occupied_.ix0, occupied_.ix1 - ix,
+                                  iy - occupied_.iy0, occupied_.iy1 - iy });
+        for (int64_t r=0; r<=maxRing; ++r)
+        {
+            if (r > 0 && bestDist <= (r-1) * cellSize_)
+                break;
+            auto visit = [&](int64_t jx, int64_t jy)
+            {
+                auto it = cells_.find(cellKey(jx, jy));
+                if (it != cells_.end())
+                    for (auto key: it->second)
+                        consider(key);
+            };
+            if (r == 0)
+            {
+                visit(ix, iy);
+                continue;
+            }
+            for (auto jx=ix-r; jx<=ix+r; ++jx)
+            {
+                visit(jx, iy-r);
+                visit(jx, iy+r);
+            }
+            for (auto jy=iy-r+1; jy<iy+r; ++jy)
+            {
+                visit(ix-r, jy);
+                visit(ix+r, jy);
+            }
+        }
+        return result;
+    }
+
+private:
+    static constexpr int64_t maxCellsPerObject = 1024;
+
+    struct CellRange
+    {
+        int64_t ix0{};
+        int64_t iy0{};
+        int64_t ix1{-1};
+        int64_t iy1{-1};
+
+        auto cellCount() const noexcept
+            -> int64_t
+        { return (ix1 - ix0 + 1) * (iy1 - iy0 + 1); }
+
+        auto operator==(const CellRange&) const -> bool = default;
+    };
+
+    static constexpr auto oversizedRange = CellRange{ 0, 0, -1, -2 };
+
+    auto cellIndex(double x) const noexcept
+        -> int64_t
+    {
+        // Clamp so that cell keys of distant objects do not overflow
+        constexpr auto maxIndex = double{ 1 << 30 };
+        return static_cast<int64_t>(
+            std::floor(std::clamp(x / cellSize_, -maxIndex, maxIndex)));
+    }
+
+    static auto cellKey(int64_t ix, int64_t iy) noexcept
+        -> uint64_t
+    {
+        return (static_cast<uint64_t>(ix) << 32) ^
+               static_cast<uint32_t>(iy);
+    }
+
+    auto cellRange(const Bbox2d& box) const noexcept
+        -> CellRange
+    {
+        auto result = CellRange{
+            cellIndex(box.min[0]), cellIndex(box.min[1]),
+            cellIndex(box.max[0]), cellIndex(box.max[1]) };
+        if (result.cellCount() > maxCellsPerObject)
+            return oversizedRange;
+        return result;
+    }
+
+    auto link(Key key, const CellRange& range)
+        -> void
+    {
+        if (range == oversizedRange)
+        {
+            oversized_.push_back(key);
+            return;
+        }
+        if (cells_.empty())
+            occupied_ = range;
+        else
+        {
+            occupied_.ix0 = std::min(occupied_.ix0, range.ix0);
+            occupied_.iy0 = std::min(occupied_.iy0, range.iy0);
+            occupied_.ix1 = std::max(occupied_.ix1, range.ix1);
+            occupied_.iy1 = std::max(occupied_.iy1, range.iy1);
+        }
+        for (auto ix=range.ix0; ix<=range.ix1; ++ix)
+            for (auto iy=range.iy0; iy<=range.iy1; ++iy)
+                cells_[cellKey(ix, iy)].push_back(key);
+    }
+
+    static auto eraseKey(std::vector<Key>& keys, Key key)
+        -> void
+    {
+        auto it = std::find(keys.begin(), keys.end(), key);
+        if (it == keys.end())
+            return;
+        *it = keys.back();
+        keys.pop_back();
+    }
+
+    auto unlink(Key key, const CellRange& range)
+        -> void
+    {
+        if (range == oversizedRange)
+        {
+            eraseKey(oversized_, key);
+            return;
+        }
+        // Without objects in cells, start over
+        if (objects_.size() - oversized_.size() == 1)
+        {
+            cells_.clear();
+            occupied_ = {};
+            return;
+        }
+
+        // Empty cells are kept, as objects being moved are likely
+        // to come back; occupied_ is not shrunk for the same reason
+        for (auto ix=range.ix0; ix<=range.ix1; ++ix)
+            for (auto iy=range.iy0; iy<=range.iy1; ++iy)
+                eraseKey(cells_[cellKey(ix, iy)], key);
+    }
+
+    double cellSize_;
+    std::unordered_map<uint64_t, std::vector<Key>> cells_;
+    std::unordered_map<Key, CellRange> objects_;
+    std::vector<Key> oversized_;
+    CellRange occupied_;
+};
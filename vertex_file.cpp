@@ -0,0 +1,124 @@
+#include "vertex_file.hpp"
+
+#include "throw.hpp"
+
+#include <bit>
+#include <charconv>
+
+static_assert(std::endian::native == std::endian::little,
+              "Vertex files are written in native byte order");
+
+namespace {
+
+constexpr char vertexFileMagic[8] = { 'G', 'F', 'V', 'E', 'R', 'T', 'S', 0 };
+constexpr uint32_t vertexFileVersion = 1;
+constexpr long vertexCountOffset = 16;
+
+} // anonymous namespace
+
+
+
+auto parseVertexPrecision(const std::string& name)
+    -> VertexPrecision
+{
+    if (name == "f32")
+        return VertexPrecision::Float32;
+    if (name == "f64")
+        return VertexPrecision::Float64;
+    throw_("Unknown vertex precision '", name, "', expected f32 or f64");
+}
+
+auto parseVertexFormat(const std::string& name)
+    -> VertexFormat
+{
+    if (name.starts_with('q'))
+    {
+        auto bits = unsigned{};
+        auto [end, ec] = std::from_chars(
+            name.data() + 1, name.data() + name.size(), bits);
+        if (ec != std::errc{} ||
+            end != name.data() + name.size() ||
+            bits < 1 || bits > 52)
+            throw_("Invalid vertex quantization '", name,
+                   "', expected q<bits> with bits in [1, 52]");
+        return { .quantizationBits = bits };
+    }
+    if (name == "f32" || name == "f64")
+        return { .precision = parseVertexPrecision(name) };
+    throw_("Unknown vertex format '", name, "', expected f32, f64, or q<bits>");
+}
+
+
+
+VertexFileWriter::VertexFileWriter(const std::string& path,
+                                   VertexPrecision precision):
+    path_{ path },
+    precision_{ precision }
+{
+    if (path_ == "-")
+        file_ = stdout;
+    else
+    {
+        file_ = std::fopen(path_.c_str(), "wb");
+        if (!file_)
+            throw_("Failed to open output file '", path_, "'");
+    }
+
+    buffer_.reserve(bufferCapacity);
+
+    uint32_t scalarSize =
+        precision_ == VertexPrecision::Float32? sizeof(float): sizeof(double);
+    uint64_t unknownCount = ~0ull;
+    uint64_t reserved = 0;
+    writeBytes(vertexFileMagic, sizeof(vertexFileMagic));
+    writeBytes(&vertexFileVersion, sizeof(vertexFileVersion));
+    writeBytes(&scalarSize, sizeof(scalarSize));
+    writeBytes(&unknownCount, sizeof(unknownCount));
+    writeBytes(&reserved, sizeof(reserved));
+}
+
+VertexFileWriter::~VertexFileWriter()
+{
+    if (file_ && file_ != stdout)
+        std::fclose(file_);
+}
+
+auto VertexFileWriter::close()
+    -> void
+{
+    if (!file_)
+        return;
+
+    flushBuffer();
+
+    // Fill in the vertex count, unless the output is not seekable
+    if (std::fseek(file_, vertexCountOffset, SEEK_SET) == 0)
+    {
+        writeBytes(&vertexCount_, sizeof(vertexCount_));
+        std::fseek(file_, 0, SEEK_END);
+    }
+
+    if (std::fflush(file_) != 0)
+        throw_("Failed to write output file '", path_, "'");
+    if (file_ != stdout)
+    {
+        auto file = file_;
+        file_ = nullptr;
+        if (std::fclose(file) != 0)
+            throw_("Failed to close output file '", path_, "'");
+    }
+}
+
+auto VertexFileWriter::flushBuffer()
+    -> void
+{
+    writeBytes(buffer_.data(), buffer_.size());
+    buffer_.clear();
+}
+
+auto VertexFileWriter::writeBytes(const void* data, size_t size)
+    -> void
+{
+    if (std::fwrite(data, 1, size, file_) != size)
+        throw_("Failed to write output file '", path_, "'");
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "vec2.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Binary vertex file: a polyline as contiguous xy pairs, which consumers
+// can memory-map and use without parsing. Little-endian layout:
+//
+//      offset  size  field
+//      0       8     magic "GFVERTS\0"
+//      8       4     format version (1)
+//      12      4     bytes per coordinate: 4 (float32) or 8 (float64)
+//      16      8     vertex count; ~0 if the stream was not seekable
+//      24      8     reserved (0)
+//      32            x0, y0, x1, y1, ...
+//
+// Vertices are written as they are produced, and the count is filled in
+// on close, so the polyline never has to be held in memory.
+
+enum class VertexPrecision
+{
+    Float32,
+    Float64
+};
+
+auto parseVertexPrecision(const std::string& name)
+    -> VertexPrecision;
+
+// Format of exported vertices: raw floats, or a packed vertex file
+// (see vertex_pack.hpp) when quantizationBits is nonzero
+struct VertexFormat
+{
+    VertexPrecision precision{ VertexPrecision::Float64 };
+    unsigned quantizationBits{};
+};
+
+// f32, f64, or q<bits>, e.g., q20
+auto parseVertexFormat(const std::string& name)
+    -> VertexFormat;
+
+class VertexFileWriter final
+{
+public:
+    // path "-" means stdout
+    VertexFileWriter(const std::string& path, VertexPrecision precision);
+
+    ~VertexFileWriter();
+
+    VertexFileWriter(const VertexFileWriter&) = delete;
+    VertexFileWriter& operator=(const VertexFileWriter&) = delete;
+
+    auto write(const Vec2d& v)
+        -> void
+    {
+        if (buffer_.size() + 2*sizeof(double) > bufferCapacity)
+            flushBuffer();
+        if (precision_ == VertexPrecision::Float32)
+            append(static_cast<float>(v[0]), static_cast<float>(v[1]));
+        else
+            append(v[0], v[1]);
+        ++vertexCount_;
+    }
+
+    auto vertexCount() const noexcept
+        -> uint64_t
+    { return vertexCount_; }
+
+    // Flushes the vertices and fills in the count
+    auto close()
+        -> void;
+
+private:
+    static constexpr size_t bufferCapacity = 1 << 20;
+
+    template <typename T>
+    auto append(T x, T y)
+        -> void
+    {
+        auto pos = buffer_.size();
+        buffer_.resize(pos + 2*sizeof(T));
+        T xy[] = { x, y };
+        std::memcpy(buffer_.data() + pos, xy, sizeof(xy));
+    }
+
+    auto flushBuffer()
+        -> void;
+
+    auto writeBytes(const void* data, size_t size)
+        -> void;
+
+    std::string path_;
+    VertexPrecision precision_;
+    FILE* file_{};
+    std::vector<char> buffer_;
+    uint64_t vertexCount_{};
+};
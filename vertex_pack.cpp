@@ -0,0 +1,250 @@
+#include "vertex_pack.hpp"
+
+#include "parallel_frames.hpp"
+#include "throw.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <thread>
+
+static_assert(std::endian::native == std::endian::little,
+              "Packed vertex files are written in native byte order");
+
+namespace {
+
+constexpr char packedVertexMagic[8] = { 'G', 'F', 'V', 'P', 'A', 'C', 'K', 0 };
+constexpr uint32_t packedVertexVersion = 1;
+constexpr size_t headerSize = 40;
+constexpr size_t blockHeaderSize = 8;
+constexpr size_t trailerSize = 24;
+
+template <typename T>
+auto readScalar(const std::vector<char>& data, uint64_t offset)
+    -> T
+{
+    auto result = T{};
+    std::memcpy(&result, data.data() + offset, sizeof(T));
+    return result;
+}
+
+} // anonymous namespace
+
+
+
+PackedVertexWriter::PackedVertexWriter(const std::string& path,
+                                       const Bbox2d& bounds,
+                                       unsigned bits,
+                                       uint32_t blockSize):
+    path_{ path },
+    blockSize_{ blockSize }
+{
+    if (bits < 1 || bits > 52)
+        throw_("Vertex quantization bits must be in [1, 52], got ", bits);
+    if (blockSize_ == 0)
+        throw_("Vertex block size must be positive");
+
+    auto extent = std::max(bounds.size(0), bounds.size(1));
+    if (bounds.empty || !(extent > 0) || !std::isfinite(extent))
+        throw_("Invalid bounds for vertex quantization");
+    origin_ = bounds.min;
+    step_ = std::ldexp(extent, -static_cast<int>(bits));
+    invStep_ = 1 / step_;
+
+    if (path_ == "-")
+        file_ = stdout;
+    else
+    {
+        file_ = std::fopen(path_.c_str(), "wb");
+        if (!file_)
+            throw_("Failed to open output file '", path_, "'");
+    }
+
+    // Varints take at most 10 bytes
+    block_.reserve(blockHeaderSize + size_t{ blockSize_ } * 2 * 10);
+    block_.resize(blockHeaderSize);
+
+    writeBytes(packedVertexMagic, sizeof(packedVertexMagic));
+    writeBytes(&packedVertexVersion, sizeof(packedVertexVersion));
+    writeBytes(&blockSize_, sizeof(blockSize_));
+    writeBytes(&origin_[0], sizeof(double));
+    writeBytes(&origin_[1], sizeof(double));
+    writeBytes(&step_, sizeof(step_));
+}
+
+PackedVertexWriter::~PackedVertexWriter()
+{
+    if (file_ && file_ != stdout)
+        std::fclose(file_);
+}
+
+auto PackedVertexWriter::close()
+    -> void
+{
+    if (!file_)
+        return;
+
+    flushBlock();
+
+    auto indexOffset = offset_;
+    auto blockCount = uint64_t{ index_.size() / 2 };
+    writeBytes(index_.data(), index_.size() * sizeof(uint64_t));
+    writeBytes(&blockCount, sizeof(blockCount));
+    writeBytes(&vertexCount_, sizeof(vertexCount_));
+    writeBytes(&indexOffset, sizeof(indexOffset));
+
+    if (std::fflush(file_) != 0)
+        throw_("Failed to write output file '", path_, "'");
+    if (file_ != stdout)
+    {
+        auto file = file_;
+        file_ = nullptr;
+        if (std::fclose(file) != 0)
+            throw_("Failed to close output file '", path_, "'");
+    }
+}
+
+auto PackedVertexWriter::flushBlock()
+    -> void
+{
+    if (blockVertexCount_ == 0)
+        return;
+
+    index_.push_back(offset_);
+    index_.push_back(vertexCount_ - blockVertexCount_);
+
+    auto payloadSize = static_cast<uint32_t>(block_.size() - blockHeaderSize);
+    std::memcpy(block_.data(), &payloadSize, sizeof(payloadSize));
+    std::memcpy(block_.data() + 4, &blockVertexCount_, sizeof(uint32_t));
+    writeBytes(block_.data(), block_.size());
+
+    block_.resize(blockHeaderSize);
+    blockVertexCount_ = 0;
+}
+
+auto PackedVertexWriter::writeBytes(const void* data, size_t size)
+    -> void
+{
+    if (std::fwrite(data, 1, size, file_) != size)
+        throw_("Failed to write output file '", path_, "'");
+    offset_ += size;
+}
+
+
+
+PackedVertexReader::PackedVertexReader(const std::string& path):
+    path_{ path }
+{
+    auto file = std::fopen(path_.c_str(), "rb");
+    if (!file)
+        throw_("Failed to open vertex file '", path_, "'");
+    char buf[1 << 16];
+    for (size_t n; (n = std::fread(buf, 1, sizeof(buf), file)) > 0;)
+        data_.insert(data_.end(), buf, buf + n);
+    auto failed = std::ferror(file);
+    std::fclose(file);
+    if (failed)
+        throw_("Failed to read vertex file '", path_, "'");
+
+    auto size = data_.size();
+    if (size < headerSize + trailerSize ||
+        std::memcmp(data_.data(), packedVertexMagic, sizeof(packedVertexMagic)))
+        throw_("'", path_, "' is not a packed vertex file");
+    if (auto version = readScalar<uint32_t>(data_, 8);
+        version != packedVertexVersion)
+        throw_("Unsupported packed vertex file version ", version,
+               " in '", path_, "'");
+
+    origin_ = { readScalar<double>(data_, 16), readScalar<double>(data_, 24) };
+    step_ = readScalar<double>(data_, 32);
+
+    auto blockCount = readScalar<uint64_t>(data_, size - trailerSize);
+    vertexCount_ = readScalar<uint64_t>(data_, size - trailerSize + 8);
+    auto indexOffset = readScalar<uint64_t>(data_, size - trailerSize + 16);
+    if (indexOffset < headerSize ||
+        indexOffset > size - trailerSize ||
+        (size - trailerSize - indexOffset) / 16 != blockCount)
+        throw_("Corrupt block index in '", path_, "'");
+
+    blocks_.resize(blockCount);
+    for (size_t i=0; i<blockCount; ++i)
+    {
+        auto& block = blocks_[i];
+        block.offset = readScalar<uint64_t>(data_, indexOffset + 16*i);
+        block.firstVertex = readScalar<uint64_t>(data_, indexOffset + 16*i + 8);
+        if (block.offset < headerSize ||
+            block.offset + blockHeaderSize > indexOffset ||
+            block.firstVertex > vertexCount_)
+            throw_("Corrupt block index in '", path_, "'");
+    }
+}
+
+auto PackedVertexReader::decodeBlock(size_t iblock, Vec2d* out) const
+    -> void
+{
+    const auto& block = blocks_.at(iblock);
+    auto payloadSize = readScalar<uint32_t>(data_, block.offset);
+    auto count = readScalar<uint32_t>(data_, block.offset + 4);
+    const auto* p = reinterpret_cast<const uint8_t*>(
+        data_.data() + block.offset + blockHeaderSize);
+    const auto* end = p + payloadSize;
+    if (block.offset + blockHeaderSize + payloadSize > data_.size() ||
+        block.firstVertex + count > vertexCount_)
+        throw_("Corrupt block ", iblock, " in '", path_, "'");
+
+    auto varint = [&]
+    {
+        auto u = uint64_t{};
+        for (auto shift=0; ; shift+=7)
+        {
+            if (p == end || shift > 63)
+                throw_("Corrupt block ", iblock, " in '", path_, "'");
+            auto byte = *p++;
+            u |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+        return static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+    };
+
+    auto n = std::array<int64_t, 2>{};
+    out += block.firstVertex;
+    for (uint32_t i=0; i<count; ++i)
+    {
+        auto dx = varint();
+        auto dy = varint();
+        n[0] += dx;
+        n[1] += dy;
+        out[i] = { origin_[0] + n[0] * step_, origin_[1] + n[1] * step_ };
+    }
+}
+
+auto PackedVertexReader::decode(size_t threadCount) const
+    -> std::vector<Vec2d>
+{
+    auto result = std::vector<Vec2d>(vertexCount_);
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    threadCount = std::min(threadCount, std::max<size_t>(blocks_.size(), 1));
+
+    auto errors = WorkerErrors{};
+    {
+        auto workers = startWorkers(
+            threadCount,
+            [&](size_t workerIndex)
+            {
+                errors.run(
+                    [&]
+                    {
+                        for (auto i=workerIndex;
+                             i<blocks_.size() && !errors.failed();
+                             i+=threadCount)
+                            decodeBlock(i, result.data());
+                    },
+                    []{});
+            },
+            []{});
+    }
+    errors.rethrow();
+    return result;
+}
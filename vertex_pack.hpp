@@ -0,0 +1,177 @@
+#pragma once
+
+#include "bbox2.hpp"
+#include "vec2.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Packed vertex file: a polyline quantized to a square grid and
+// delta-encoded in blocks, which can be decoded independently, e.g.,
+// in parallel. Little-endian layout:
+//
+//      offset  size  field
+//      0       8     magic "GFVPACK\0"
+//      8       4     format version (1)
+//      12      4     max. vertices per block
+//      16      8     grid origin x (float64)
+//      24      8     grid origin y (float64)
+//      32      8     grid step (float64)
+//      40            blocks
+//
+// Block: u32 payload size in bytes, u32 vertex count, payload. The payload
+// holds zigzag LEB128 varints: the grid coordinates of the first vertex,
+// then differences between consecutive vertices, x before y.
+//
+// The file ends with the block index: for each block, u64 file offset and
+// u64 number of its first vertex, then u64 block count, u64 vertex count,
+// and u64 index offset. It is written last, so that the file can be
+// streamed.
+//
+// A coordinate c is stored as n = round((c - origin) / step), and decoded
+// as origin + n * step: the error is at most step/2 per coordinate, i.e.,
+// step/√2 per vertex, plus float64 rounding.
+
+class PackedVertexWriter final
+{
+public:
+    static constexpr uint32_t defaultBlockSize = 4096;
+
+    // The grid has 2^bits steps along the larger side of bounds, which
+    // need not contain all vertices. path "-" means stdout.
+    PackedVertexWriter(const std::string& path,
+                       const Bbox2d& bounds,
+                       unsigned bits,
+                       uint32_t blockSize = defaultBlockSize);
+
+    ~PackedVertexWriter();
+
+    PackedVertexWriter(const PackedVertexWriter&) = delete;
+    PackedVertexWriter& operator=(const PackedVertexWriter&) = delete;
+
+    auto write(const Vec2d& v)
+        -> void
+    {
+        auto x = quantize(v[0], origin_[0]);
+        auto y = quantize(v[1], origin_[1]);
+        if (blockVertexCount_ == 0)
+        {
+            appendVarint(x);
+            appendVarint(y);
+        }
+        else
+        {
+            appendVarint(x - last_[0]);
+            appendVarint(y - last_[1]);
+        }
+        last_ = { x, y };
+        ++vertexCount_;
+        if (++blockVertexCount_ == blockSize_)
+            flushBlock();
+    }
+
+    auto vertexCount() const noexcept
+        -> uint64_t
+    { return vertexCount_; }
+
+    auto step() const noexcept
+        -> double
+    { return step_; }
+
+    // Bytes written so far
+    auto byteCount() const noexcept
+        -> uint64_t
+    { return offset_; }
+
+    // Flushes the last block and writes the block index
+    auto close()
+        -> void;
+
+private:
+    auto quantize(double c, double origin) const noexcept
+        -> int64_t
+    { return static_cast<int64_t>(std::llround((c - origin) * invStep_)); }
+
+    auto appendVarint(int64_t n)
+        -> void
+    {
+        // Zigzag: small magnitudes of either sign take few bytes
+        auto u = (static_cast<uint64_t>(n) << 1) ^
+                 static_cast<uint64_t>(n >> 63);
+        while (u >= 0x80)
+        {
+            block_.push_back(static_cast<char>(u | 0x80));
+            u >>= 7;
+        }
+        block_.push_back(static_cast<char>(u));
+    }
+
+    auto flushBlock()
+        -> void;
+
+    auto writeBytes(const void* data, size_t size)
+        -> void;
+
+    std::string path_;
+    FILE* file_{};
+    uint32_t blockSize_;
+    Vec2d origin_;
+    double step_;
+    double invStep_;
+
+    std::vector<char> block_;
+    uint32_t blockVertexCount_{};
+    std::array<int64_t, 2> last_{};
+    uint64_t vertexCount_{};
+    uint64_t offset_{};
+
+    // File offset and first vertex number of each block
+    std::vector<uint64_t> index_;
+};
+
+
+// Reads a whole packed vertex file into memory
+class PackedVertexReader final
+{
+public:
+    explicit PackedVertexReader(const std::string& path);
+
+    auto vertexCount() const noexcept
+        -> uint64_t
+    { return vertexCount_; }
+
+    auto blockCount() const noexcept
+        -> size_t
+    { return blocks_.size(); }
+
+    auto step() const noexcept
+        -> double
+    { return step_; }
+
+    // Decodes block iblock into out[firstVertex, firstVertex + count),
+    // where out holds vertexCount() vertices
+    auto decodeBlock(size_t iblock, Vec2d* out) const
+        -> void;
+
+    // Decodes all blocks, on threadCount threads (0 means one per core)
+    auto decode(size_t threadCount = 0) const
+        -> std::vector<Vec2d>;
+
+private:
+    struct Block
+    {
+        uint64_t offset;
+        uint64_t firstVertex;
+    };
+
+    std::string path_;
+    std::vector<char> data_;
+    Vec2d origin_;
+    double step_{};
+    uint64_t vertexCount_{};
+    std::vector<Block> blocks_;
+};